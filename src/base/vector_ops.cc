@@ -0,0 +1,87 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/base/vector_ops.h"
+
+// Clones a function for each instruction set, dispatched at load time
+// by GNU indirect functions.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 6 && \
+    defined(__x86_64__) && defined(__linux__)
+#define VECTOR_OPS_TARGETS \
+  __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define VECTOR_OPS_TARGETS
+#endif
+
+namespace {
+
+template <typename Element>
+inline void Add(int size, const Element* __restrict__ x,
+                Element* __restrict__ y) {
+  for (int i = 0; i < size; ++i) {
+    y[i] += x[i];
+  }
+}
+
+template <typename Element>
+inline void Axpy(int size, Element a, const Element* __restrict__ x,
+                 Element* __restrict__ y) {
+  for (int i = 0; i < size; ++i) {
+    y[i] += a * x[i];
+  }
+}
+
+template <typename Element>
+inline void Scale(int size, Element a, Element* y) {
+  for (int i = 0; i < size; ++i) {
+    y[i] *= a;
+  }
+}
+
+}  // namespace
+
+VECTOR_OPS_TARGETS
+void VectorAdd(int size, const float* x, float* y) {
+  Add(size, x, y);
+}
+
+VECTOR_OPS_TARGETS
+void VectorAdd(int size, const double* x, double* y) {
+  Add(size, x, y);
+}
+
+VECTOR_OPS_TARGETS
+void VectorAxpy(int size, float a, const float* x, float* y) {
+  Axpy(size, a, x, y);
+}
+
+VECTOR_OPS_TARGETS
+void VectorAxpy(int size, double a, const double* x, double* y) {
+  Axpy(size, a, x, y);
+}
+
+VECTOR_OPS_TARGETS
+void VectorScale(int size, float a, float* y) {
+  Scale(size, a, y);
+}
+
+VECTOR_OPS_TARGETS
+void VectorScale(int size, double a, double* y) {
+  Scale(size, a, y);
+}
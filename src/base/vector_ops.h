@@ -0,0 +1,66 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+// Dense vector kernels on float and double arrays and CVectors, e.g.,
+// for summing up gradients in reducers:
+//
+//   VectorAdd(x, &y):       y += x
+//   VectorAxpy(a, x, &y):   y += a * x
+//   VectorScale(a, &y):     y *= a
+//
+// The kernels are plain loops, which the compiler vectorizes.  With
+// GCC on x86-64, each kernel is compiled for AVX-512, AVX2 and the
+// baseline instruction set, and the version for the running CPU is
+// selected when the program is loaded, so a binary built for generic
+// x86-64 still uses the widest vectors available.  x and y must not
+// overlap.
+//
+#ifndef BASE_VECTOR_OPS_H_
+#define BASE_VECTOR_OPS_H_
+
+#include "src/base/common.h"
+#include "src/base/cvector.h"
+
+void VectorAdd(int size, const float* x, float* y);
+void VectorAdd(int size, const double* x, double* y);
+
+void VectorAxpy(int size, float a, const float* x, float* y);
+void VectorAxpy(int size, double a, const double* x, double* y);
+
+void VectorScale(int size, float a, float* y);
+void VectorScale(int size, double a, double* y);
+
+template <typename Element>
+void VectorAdd(const CVector<Element>& x, CVector<Element>* y) {
+  CHECK_EQ(x.size(), y->size());
+  VectorAdd(x.size(), x.data(), y->data());
+}
+
+template <typename Element>
+void VectorAxpy(Element a, const CVector<Element>& x, CVector<Element>* y) {
+  CHECK_EQ(x.size(), y->size());
+  VectorAxpy(x.size(), a, x.data(), y->data());
+}
+
+template <typename Element>
+void VectorScale(Element a, CVector<Element>* y) {
+  VectorScale(y->size(), a, y->data());
+}
+
+#endif  // BASE_VECTOR_OPS_H_
@@ -0,0 +1,58 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/base/vector_ops.h"
+
+#include "gtest/gtest.h"
+
+#include "src/base/common.h"
+#include "src/base/cvector.h"
+
+// Sizes not multiple of vector widths exercise the remainder loops.
+TEST(VectorOpsTest, Float) {
+  for (int size = 0; size < 70; size += 7) {
+    CVector<float> x(size), y(size);
+    for (int i = 0; i < size; ++i) {
+      x.data()[i] = i;
+      y.data()[i] = 1;
+    }
+    VectorAdd(x, &y);
+    VectorAxpy(0.5f, x, &y);
+    VectorScale(2.0f, &y);
+    for (int i = 0; i < size; ++i) {
+      EXPECT_EQ(2 + 3 * i, y.data()[i]);
+    }
+  }
+}
+
+TEST(VectorOpsTest, Double) {
+  const int kSize = 1001;
+  CVector<double> x(kSize, 0.25), y(kSize, 1.0);
+  VectorAxpy(-4.0, x, &y);
+  VectorAdd(x, &y);
+  VectorScale(4.0, &y);
+  for (int i = 0; i < kSize; ++i) {
+    EXPECT_EQ(1.0, y.data()[i]);
+  }
+
+  // Offset arrays are not aligned to vector widths.
+  VectorAdd(kSize - 1, x.data() + 1, y.data());
+  EXPECT_EQ(1.25, y.data()[0]);
+  EXPECT_EQ(1.0, y.data()[kSize - 1]);
+}
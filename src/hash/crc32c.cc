@@ -0,0 +1,76 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/hash/crc32c.h"
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#include <string.h>
+#endif
+
+namespace {
+
+#if !defined(__SSE4_2__)
+// The reflected Castagnoli polynomial.
+const uint32 kCrc32cPolynomial = 0x82f63b78;
+
+class Crc32cTable {
+ public:
+  Crc32cTable() {
+    for (uint32 i = 0; i < 256; ++i) {
+      uint32 crc = i;
+      for (int j = 0; j < 8; ++j) {
+        crc = (crc >> 1) ^ ((crc & 1) ? kCrc32cPolynomial : 0);
+      }
+      table_[i] = crc;
+    }
+  }
+  uint32 operator[](int i) const { return table_[i]; }
+ private:
+  uint32 table_[256];
+};
+
+const Crc32cTable& GetCrc32cTable() {
+  static Crc32cTable table;
+  return table;
+}
+#endif
+
+}  // namespace
+
+uint32 ExtendCrc32c(uint32 crc, const char* data, size_t size) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+  crc = ~crc;
+#if defined(__SSE4_2__)
+  for (; size >= sizeof(uint64); size -= sizeof(uint64), p += sizeof(uint64)) {
+    uint64 word;
+    memcpy(&word, p, sizeof(word));  // p might be unaligned.
+    crc = _mm_crc32_u64(crc, word);
+  }
+  for (; size > 0; --size, ++p) {
+    crc = _mm_crc32_u8(crc, *p);
+  }
+#else
+  const Crc32cTable& table = GetCrc32cTable();
+  for (; size > 0; --size, ++p) {
+    crc = table[(crc ^ *p) & 0xff] ^ (crc >> 8);
+  }
+#endif
+  return ~crc;
+}
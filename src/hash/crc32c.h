@@ -0,0 +1,40 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+// CRC32C, the CRC-32 using the Castagnoli polynomial, which is used by
+// iSCSI and ext4, and which x86 CPUs with SSE4.2 compute in hardware.
+// The hardware instruction is used if the compiler targets SSE4.2
+// (e.g., -msse4.2); otherwise, a table-driven implementation is used.
+//
+#ifndef HASH_CRC32C_H_
+#define HASH_CRC32C_H_
+
+#include <stddef.h>
+
+#include "src/base/common.h"
+
+// Returns the CRC32C of data[0, size), continuing from crc, which is
+// the CRC32C of preceding data, or 0 at the beginning.
+uint32 ExtendCrc32c(uint32 crc, const char* data, size_t size);
+
+inline uint32 Crc32c(const char* data, size_t size) {
+  return ExtendCrc32c(0, data, size);
+}
+
+#endif  // HASH_CRC32C_H_
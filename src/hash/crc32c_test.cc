@@ -0,0 +1,46 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+// Check values are from RFC 3720 (iSCSI), Appendix B.4.
+//
+#include "src/hash/crc32c.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+TEST(Crc32cTest, AsRFC3720) {
+  std::string zeros(32, '\0');
+  EXPECT_EQ(0x8a9136aaU, Crc32c(zeros.data(), zeros.size()));
+  std::string ones(32, '\xff');
+  EXPECT_EQ(0x62a8ab43U, Crc32c(ones.data(), ones.size()));
+  std::string ascending;
+  for (int i = 0; i < 32; ++i) {
+    ascending.push_back(static_cast<char>(i));
+  }
+  EXPECT_EQ(0x46dd794eU, Crc32c(ascending.data(), ascending.size()));
+  EXPECT_EQ(0U, Crc32c("", 0));
+}
+
+TEST(Crc32cTest, Extend) {
+  std::string data = "The quick brown fox jumps over the lazy dog";
+  uint32 crc = ExtendCrc32c(Crc32c(data.data(), 10),
+                            data.data() + 10, data.size() - 10);
+  EXPECT_EQ(Crc32c(data.data(), data.size()), crc);
+}
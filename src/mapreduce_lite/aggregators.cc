@@ -0,0 +1,170 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/mapreduce_lite/aggregators.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "src/mapreduce_lite/flags.h"
+
+namespace mapreduce_lite {
+
+//-----------------------------------------------------------------------------
+// Implementation of TopKAggregator
+//-----------------------------------------------------------------------------
+void AppendTopKEntry(int64 score, const string& item, string* value) {
+  uint32 size = item.size();
+  value->append(reinterpret_cast<const char*>(&score), sizeof(score));
+  value->append(reinterpret_cast<const char*>(&size), sizeof(size));
+  value->append(item);
+}
+
+bool ParseTopKEntries(const string& value, std::vector<TopKEntry>* entries) {
+  entries->clear();
+  size_t pos = 0;
+  while (pos < value.size()) {
+    TopKEntry entry;
+    uint32 size = 0;
+    if (pos + sizeof(entry.score) + sizeof(size) > value.size()) {
+      return false;
+    }
+    memcpy(&entry.score, value.data() + pos, sizeof(entry.score));
+    pos += sizeof(entry.score);
+    memcpy(&size, value.data() + pos, sizeof(size));
+    pos += sizeof(size);
+    if (pos + size > value.size()) {
+      return false;
+    }
+    entry.item.assign(value, pos, size);
+    pos += size;
+    entries->push_back(entry);
+  }
+  return true;
+}
+
+// Orders entries by descending scores, and then ascending items, so
+// that ties are broken in the same way however values are combined.
+static bool BetterTopKEntry(const TopKEntry& a, const TopKEntry& b) {
+  return a.score > b.score || (a.score == b.score && a.item < b.item);
+}
+
+void TopKAggregator::Update(State* state, const string& value) {
+  std::vector<TopKEntry> entries;
+  if (!ParseTopKEntries(value, &entries)) {
+    LOG(FATAL) << "Malformed TopK value of size " << value.size();
+  }
+  // The heap is ordered by BetterTopKEntry, so its front is the worst.
+  for (int i = 0; i < entries.size(); ++i) {
+    if (state->size() < TopK()) {
+      state->push_back(entries[i]);
+      std::push_heap(state->begin(), state->end(), BetterTopKEntry);
+    } else if (BetterTopKEntry(entries[i], state->front())) {
+      std::pop_heap(state->begin(), state->end(), BetterTopKEntry);
+      state->back().score = entries[i].score;
+      state->back().item.swap(entries[i].item);
+      std::push_heap(state->begin(), state->end(), BetterTopKEntry);
+    }
+  }
+}
+
+void TopKAggregator::Output(const State& state, string* value) {
+  State sorted(state);
+  std::sort(sorted.begin(), sorted.end(), BetterTopKEntry);
+  value->clear();
+  for (int i = 0; i < sorted.size(); ++i) {
+    AppendTopKEntry(sorted[i].score, sorted[i].item, value);
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of HyperLogLogAggregator
+//-----------------------------------------------------------------------------
+uint64 HyperLogLogHash(const string& item) {
+  // 64-bit FNV-1a, followed by the finalizer of MurmurHash3, so that
+  // all bits depend on all bytes of item.
+  uint64 h = 14695981039346656037ULL;
+  for (int i = 0; i < item.size(); ++i) {
+    h ^= static_cast<uint8>(item[i]);
+    h *= 1099511628211ULL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+void HyperLogLogAggregator::Init(State* state) {
+  memset(state->registers, 0, sizeof(state->registers));
+}
+
+void HyperLogLogAggregator::Update(State* state, const string& value) {
+  if (value.size() == sizeof(uint64)) {
+    // The first kHyperLogLogPrecision bits select a register, which
+    // keeps the maximum rank of the first 1-bit in the rest bits.
+    uint64 hash = DecodeUint64(value);
+    int index = hash >> (64 - kHyperLogLogPrecision);
+    uint64 rest = hash << kHyperLogLogPrecision;
+    uint8 rank = rest == 0 ? 64 - kHyperLogLogPrecision + 1 :
+        __builtin_clzll(rest) + 1;
+    if (rank > state->registers[index]) {
+      state->registers[index] = rank;
+    }
+  } else if (value.size() == kHyperLogLogRegisters) {
+    // Merging sketches is a loop of byte-wise maximums, which compilers
+    // vectorize.
+    const uint8* other = reinterpret_cast<const uint8*>(value.data());
+    uint8* registers = state->registers;
+    for (int i = 0; i < kHyperLogLogRegisters; ++i) {
+      registers[i] = std::max(registers[i], other[i]);
+    }
+  } else {
+    LOG(FATAL) << "Malformed HyperLogLog value of size " << value.size();
+  }
+}
+
+void HyperLogLogAggregator::Output(const State& state, string* value) {
+  value->assign(reinterpret_cast<const char*>(state.registers),
+                kHyperLogLogRegisters);
+}
+
+int64 HyperLogLogAggregator::Estimate(const State& state) {
+  const double m = kHyperLogLogRegisters;
+  double sum = 0;
+  int num_zeros = 0;
+  for (int i = 0; i < kHyperLogLogRegisters; ++i) {
+    sum += ldexp(1.0, -state.registers[i]);
+    if (state.registers[i] == 0) {
+      ++num_zeros;
+    }
+  }
+  double alpha = 0.7213 / (1 + 1.079 / m);
+  double estimate = alpha * m * m / sum;
+  // Small cardinalities are estimated better by linear counting.
+  if (estimate <= 2.5 * m && num_zeros > 0) {
+    estimate = m * log(m / num_zeros);
+  }
+  return static_cast<int64>(estimate + 0.5);
+}
+
+}  // namespace mapreduce_lite
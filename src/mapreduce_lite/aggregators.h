@@ -0,0 +1,293 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+// Built-in aggregators, which reduce values in the binary encodings
+// of strcodec.h instead of decimal strings.  Each aggregator is
+// registered by REGISTER_AGGREGATOR as both an incremental reducer
+// and a batch reducer of the same name, so the name may be given by
+// --mr_reducer_class in either reduction mode, or by
+// --mr_combiner_class:
+//
+//  Int64Sum, DoubleSum: sums of EncodeInt64 or EncodeDouble values.
+//  Int64Min, Int64Max, DoubleMin, DoubleMax: extremes of such values.
+//  Count: the number of values.  Map outputs are empty values, and
+//    combiners output partial counts by EncodeInt64.
+//  TopK: the --mr_top_k items of the largest scores.  A value is a
+//    list of (score, item) entries built by AppendTopKEntry().  The
+//    output lists entries in descending order of scores.
+//  HyperLogLog: a sketch of distinct items.  Map outputs are hashes of
+//    items, i.e., EncodeUint64(HyperLogLogHash(item)); outputs are
+//    sketches merged from map outputs and other sketches.
+//  DistinctCount: the estimated number of distinct items, by
+//    EncodeInt64, from the same values as HyperLogLog.
+//  FloatVectorSum, DoubleVectorSum: element-wise sums of dense vectors
+//    encoded by EncodeDenseVector() (see dense_vector.h), e.g.,
+//    gradients.  All vectors of a key must have the same size.
+//
+// An aggregator is a class with type State, the fixed-size partial
+// result of a key, and static functions Init(State*), Update(State*,
+// value) and Output(const State&, string* value).  Except for
+// DistinctCount, the output of an aggregator is a valid value for it,
+// so that it works as a combiner.
+//
+// Outputs are binary, so they are usually written in "protofile" or
+// "blockfile" format.
+//
+#ifndef MAPREDUCE_LITE_AGGREGATORS_H_
+#define MAPREDUCE_LITE_AGGREGATORS_H_
+
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/vector_ops.h"
+#include "src/mapreduce_lite/dense_vector.h"
+#include "src/mapreduce_lite/mapreduce_lite.h"
+#include "src/sorted_buffer/sorted_buffer_iterator.h"
+#include "src/strutil/strcodec.h"
+
+namespace mapreduce_lite {
+
+//-----------------------------------------------------------------------------
+// Reducers of an aggregator.
+//-----------------------------------------------------------------------------
+template <class Aggregator>
+class IncrementalAggregator
+    : public TypedIncrementalReducer<typename Aggregator::State> {
+ public:
+  typedef typename Aggregator::State State;
+
+  virtual void Init(State* state) {
+    Aggregator::Init(state);
+  }
+
+  virtual void Update(State* state, const string& value) {
+    Aggregator::Update(state, value);
+  }
+
+  virtual void Finalize(const string& key, const State& state) {
+    Aggregator::Output(state, &output_);
+    this->Output(key, output_);
+  }
+
+ private:
+  string output_;
+};
+
+template <class Aggregator>
+class BatchAggregator : public BatchReducer {
+ public:
+  virtual void Reduce(const string& key, ReduceInputIterator* values) {
+    Aggregator::Init(&state_);
+    for (; !values->Done(); values->Next()) {
+      Aggregator::Update(&state_, values->value());
+    }
+    Aggregator::Output(state_, &output_);
+    Output(key, output_);
+  }
+
+ private:
+  typename Aggregator::State state_;     // Reused for all keys.
+  string output_;
+};
+
+//-----------------------------------------------------------------------------
+// Numerical aggregators.
+//-----------------------------------------------------------------------------
+struct Int64Codec {
+  typedef int64 Type;
+  static int64 Decode(const string& value) { return DecodeInt64(value); }
+  static void Encode(int64 x, string* value) { EncodeInt64(x, value); }
+  static int64 Lowest() { return std::numeric_limits<int64>::min(); }
+};
+
+struct DoubleCodec {
+  typedef double Type;
+  static double Decode(const string& value) { return DecodeDouble(value); }
+  static void Encode(double x, string* value) { EncodeDouble(x, value); }
+  static double Lowest() { return -std::numeric_limits<double>::max(); }
+};
+
+template <class Codec>
+struct SumAggregator {
+  typedef typename Codec::Type State;
+  static void Init(State* state) { *state = 0; }
+  static void Update(State* state, const string& value) {
+    *state += Codec::Decode(value);
+  }
+  static void Output(const State& state, string* value) {
+    Codec::Encode(state, value);
+  }
+};
+
+template <class Codec>
+struct MinAggregator {
+  typedef typename Codec::Type State;
+  static void Init(State* state) {
+    *state = std::numeric_limits<State>::max();
+  }
+  static void Update(State* state, const string& value) {
+    State x = Codec::Decode(value);
+    if (x < *state) {
+      *state = x;
+    }
+  }
+  static void Output(const State& state, string* value) {
+    Codec::Encode(state, value);
+  }
+};
+
+template <class Codec>
+struct MaxAggregator {
+  typedef typename Codec::Type State;
+  static void Init(State* state) { *state = Codec::Lowest(); }
+  static void Update(State* state, const string& value) {
+    State x = Codec::Decode(value);
+    if (x > *state) {
+      *state = x;
+    }
+  }
+  static void Output(const State& state, string* value) {
+    Codec::Encode(state, value);
+  }
+};
+
+struct CountAggregator {
+  typedef int64 State;
+  static void Init(State* state) { *state = 0; }
+  static void Update(State* state, const string& value) {
+    *state += value.empty() ? 1 : DecodeInt64(value);
+  }
+  static void Output(const State& state, string* value) {
+    EncodeInt64(state, value);
+  }
+};
+
+//-----------------------------------------------------------------------------
+// TopK keeps entries in a min-heap of at most --mr_top_k entries, whose
+// front is the entry to be dropped first.
+//-----------------------------------------------------------------------------
+struct TopKEntry {
+  int64 score;
+  string item;
+};
+
+// Appends an entry to a TopK value.  An entry is encoded as an int64
+// score, a uint32 item size, and the item.
+void AppendTopKEntry(int64 score, const string& item, string* value);
+
+// Parses a TopK value.  Returns false if the value is malformed.
+bool ParseTopKEntries(const string& value, std::vector<TopKEntry>* entries);
+
+struct TopKAggregator {
+  typedef std::vector<TopKEntry> State;
+  static void Init(State* state) { state->clear(); }
+  static void Update(State* state, const string& value);
+  static void Output(const State& state, string* value);
+};
+
+//-----------------------------------------------------------------------------
+// HyperLogLog keeps 2^kHyperLogLogPrecision registers per key, whose
+// standard error of estimated distinct counts is about 1.6%.
+//-----------------------------------------------------------------------------
+const int kHyperLogLogPrecision = 12;
+const int kHyperLogLogRegisters = 1 << kHyperLogLogPrecision;
+
+// The 64-bit hash of an item as a HyperLogLog map output.
+uint64 HyperLogLogHash(const string& item);
+
+struct HyperLogLogSketch {
+  uint8 registers[kHyperLogLogRegisters];
+};
+
+struct HyperLogLogAggregator {
+  typedef HyperLogLogSketch State;
+  static void Init(State* state);
+  // value is a hash by EncodeUint64, or a sketch by Output().
+  static void Update(State* state, const string& value);
+  static void Output(const State& state, string* value);
+  static int64 Estimate(const State& state);
+};
+
+struct DistinctCountAggregator : public HyperLogLogAggregator {
+  static void Output(const State& state, string* value) {
+    EncodeInt64(Estimate(state), value);
+  }
+};
+
+//-----------------------------------------------------------------------------
+// VectorSum adds up vectors in place by VectorAdd() of vector_ops.h.
+// The state is a std::vector, as a CVector cannot be copied.
+//-----------------------------------------------------------------------------
+template <typename Element>
+struct VectorSumAggregator {
+  typedef std::vector<Element> State;
+  static void Init(State* state) { state->clear(); }
+  static void Update(State* state, const string& value) {
+    DenseVectorView<Element> vector(value);
+    if (state->empty()) {
+      state->assign(vector.data(), vector.data() + vector.size());
+    } else if (vector.size() != state->size()) {
+      LOG(FATAL) << "Cannot add a vector of size " << vector.size()
+                 << " to a vector of size " << state->size();
+    } else {
+      VectorAdd(vector.size(), vector.data(), &(*state)[0]);
+    }
+  }
+  static void Output(const State& state, string* value) {
+    EncodeDenseVector(state.empty() ? NULL : &state[0], state.size(), value);
+  }
+};
+
+typedef SumAggregator<Int64Codec> Int64SumAggregator;
+typedef SumAggregator<DoubleCodec> DoubleSumAggregator;
+typedef MinAggregator<Int64Codec> Int64MinAggregator;
+typedef MinAggregator<DoubleCodec> DoubleMinAggregator;
+typedef MaxAggregator<Int64Codec> Int64MaxAggregator;
+typedef MaxAggregator<DoubleCodec> DoubleMaxAggregator;
+typedef VectorSumAggregator<float> FloatVectorSumAggregator;
+typedef VectorSumAggregator<double> DoubleVectorSumAggregator;
+
+}  // namespace mapreduce_lite
+
+//-----------------------------------------------------------------------------
+// REGISTER_AGGREGATOR registers an aggregator as an incremental
+// reducer and a batch reducer, both named aggregator_name.  Built-in
+// aggregators are registered in mapreduce_lite.cc, which is linked
+// into every program, so the linker does not drop them from the
+// static library.
+//-----------------------------------------------------------------------------
+#define REGISTER_AGGREGATOR(aggregator_name, aggregator)                \
+  typedef mapreduce_lite::IncrementalAggregator<aggregator>             \
+      aggregator_name##IncrementalAggregator;                           \
+  CLASS_REGISTER_OBJECT_CREATOR(                                        \
+      mapreduce_lite_incremental_reducer_registry,                      \
+      mapreduce_lite::IncrementalReducer,                               \
+      #aggregator_name,                                                 \
+      aggregator_name##IncrementalAggregator);                          \
+  typedef mapreduce_lite::BatchAggregator<aggregator>                   \
+      aggregator_name##BatchAggregator;                                 \
+  CLASS_REGISTER_OBJECT_CREATOR(                                        \
+      mapreduce_lite_batch_reducer_registry,                            \
+      mapreduce_lite::BatchReducer,                                     \
+      #aggregator_name,                                                 \
+      aggregator_name##BatchAggregator)
+
+#endif  // MAPREDUCE_LITE_AGGREGATORS_H_
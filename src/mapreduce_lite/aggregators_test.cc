@@ -0,0 +1,175 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/mapreduce_lite/aggregators.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "src/base/cvector.h"
+#include "src/base/scoped_ptr.h"
+#include "src/mapreduce_lite/flags.h"
+#include "src/strutil/stringprintf.h"
+
+namespace mapreduce_lite {
+
+// Aggregates values as a reducer does, from a state by Init().
+template <class Aggregator>
+typename Aggregator::State Aggregate(const std::vector<std::string>& values) {
+  typename Aggregator::State state;
+  Aggregator::Init(&state);
+  for (int i = 0; i < values.size(); ++i) {
+    Aggregator::Update(&state, values[i]);
+  }
+  return state;
+}
+
+template <class Aggregator>
+std::string AggregateAndOutput(const std::vector<std::string>& values) {
+  std::string output;
+  Aggregator::Output(Aggregate<Aggregator>(values), &output);
+  return output;
+}
+
+TEST(AggregatorsTest, Numerical) {
+  std::vector<std::string> values;
+  values.push_back(EncodeInt64(3));
+  values.push_back(EncodeInt64(-7));
+  values.push_back(EncodeInt64(10));
+  EXPECT_EQ(6, DecodeInt64(AggregateAndOutput<Int64SumAggregator>(values)));
+  EXPECT_EQ(-7, DecodeInt64(AggregateAndOutput<Int64MinAggregator>(values)));
+  EXPECT_EQ(10, DecodeInt64(AggregateAndOutput<Int64MaxAggregator>(values)));
+
+  values.clear();
+  values.push_back(EncodeDouble(-0.5));
+  values.push_back(EncodeDouble(-2.0));
+  EXPECT_EQ(-2.5, DecodeDouble(AggregateAndOutput<DoubleSumAggregator>(values)));
+  EXPECT_EQ(-2.0, DecodeDouble(AggregateAndOutput<DoubleMinAggregator>(values)));
+  EXPECT_EQ(-0.5, DecodeDouble(AggregateAndOutput<DoubleMaxAggregator>(values)));
+}
+
+TEST(AggregatorsTest, Count) {
+  std::vector<std::string> values(3, "");
+  std::string partial = AggregateAndOutput<CountAggregator>(values);
+  EXPECT_EQ(3, DecodeInt64(partial));
+
+  // Partial counts output by combiners.
+  values.push_back(partial);
+  EXPECT_EQ(6, DecodeInt64(AggregateAndOutput<CountAggregator>(values)));
+}
+
+TEST(AggregatorsTest, TopK) {
+  // Entries of 0, ..., 99 in two combined values and single entries.
+  std::vector<std::string> values(2);
+  for (int i = 0; i < 100; ++i) {
+    if (i % 3 == 0) {
+      values.push_back("");
+      AppendTopKEntry(i, StringPrintf("item%d", i), &values.back());
+    } else {
+      AppendTopKEntry(i, StringPrintf("item%d", i), &values[i % 3 - 1]);
+    }
+  }
+  values[0] = AggregateAndOutput<TopKAggregator>(
+      std::vector<std::string>(1, values[0]));     // As a combiner.
+
+  std::vector<TopKEntry> entries;
+  ASSERT_TRUE(ParseTopKEntries(AggregateAndOutput<TopKAggregator>(values),
+                               &entries));
+  ASSERT_EQ(TopK(), entries.size());
+  for (int i = 0; i < entries.size(); ++i) {
+    EXPECT_EQ(99 - i, entries[i].score);
+    EXPECT_EQ(StringPrintf("item%d", 99 - i), entries[i].item);
+  }
+
+  std::string malformed = values[0].substr(0, values[0].size() - 1);
+  EXPECT_FALSE(ParseTopKEntries(malformed, &entries));
+}
+
+TEST(AggregatorsTest, HyperLogLog) {
+  const int kNumItems = 100000;
+  std::vector<std::string> halves[2];
+  for (int i = 0; i < kNumItems; ++i) {
+    // Each item appears twice.
+    std::string hash = EncodeUint64(HyperLogLogHash(StringPrintf("%d", i)));
+    halves[i % 2].push_back(hash);
+    halves[(i + 1) % 2].push_back(hash);
+  }
+  int64 estimate = DecodeInt64(
+      AggregateAndOutput<DistinctCountAggregator>(halves[0]));
+  EXPECT_NEAR(kNumItems, estimate, kNumItems * 0.05);
+
+  // Merging sketches of halves estimates the union.
+  std::vector<std::string> sketches;
+  for (int h = 0; h < 2; ++h) {
+    std::vector<std::string> half;
+    for (int i = h; i < kNumItems; i += 2) {
+      half.push_back(EncodeUint64(HyperLogLogHash(StringPrintf("%d", i))));
+    }
+    sketches.push_back(AggregateAndOutput<HyperLogLogAggregator>(half));
+    EXPECT_EQ(kHyperLogLogRegisters, sketches.back().size());
+  }
+  EXPECT_EQ(estimate, DecodeInt64(
+      AggregateAndOutput<DistinctCountAggregator>(sketches)));
+
+  // Small cardinalities are nearly exact.
+  std::vector<std::string> few;
+  for (int i = 0; i < 100; ++i) {
+    few.push_back(EncodeUint64(HyperLogLogHash(StringPrintf("%d", i % 10))));
+  }
+  EXPECT_EQ(10, DecodeInt64(AggregateAndOutput<DistinctCountAggregator>(few)));
+}
+
+TEST(AggregatorsTest, VectorSum) {
+  const int kSize = 100;
+  CVector<float> gradient(kSize);
+  std::vector<std::string> values;
+  for (int v = 1; v <= 3; ++v) {
+    for (int i = 0; i < kSize; ++i) {
+      gradient.data()[i] = v * i;
+    }
+    values.push_back(EncodeDenseVector(gradient));
+  }
+  std::string sum = AggregateAndOutput<FloatVectorSumAggregator>(values);
+  DenseVectorView<float> view(sum);
+  ASSERT_EQ(kSize, view.size());
+  for (int i = 0; i < kSize; ++i) {
+    EXPECT_EQ(6 * i, view.data()[i]);
+  }
+
+  std::vector<std::string> empty(2);
+  EXPECT_EQ("", AggregateAndOutput<DoubleVectorSumAggregator>(empty));
+}
+
+TEST(AggregatorsTest, Registered) {
+  const char* names[] = { "Int64Sum", "DoubleSum", "Int64Min", "DoubleMin",
+                          "Int64Max", "DoubleMax", "Count", "TopK",
+                          "HyperLogLog", "DistinctCount", "FloatVectorSum",
+                          "DoubleVectorSum" };
+  for (int i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+    scoped_ptr<IncrementalReducer> incremental(
+        CREATE_INCREMENTAL_REDUCER(names[i]));
+    EXPECT_TRUE(incremental.get() != NULL) << names[i];
+    scoped_ptr<BatchReducer> batch(CREATE_BATCH_REDUCER(names[i]));
+    EXPECT_TRUE(batch.get() != NULL) << names[i];
+  }
+}
+
+}  // namespace mapreduce_lite
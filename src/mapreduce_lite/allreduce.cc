@@ -0,0 +1,299 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/mapreduce_lite/allreduce.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "src/base/scoped_ptr.h"
+#include "src/base/stl-util.h"
+#include "src/base/vector_ops.h"
+
+namespace mapreduce_lite {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+// Workers may start at different time.
+const int kMaxConnectRetries = 6000;
+const int kConnectRetryInterval = 100000;   // in microseconds
+
+}  // namespace
+
+AllReduceGroup::AllReduceGroup()
+    : worker_id_(-1),
+      ring_min_bytes_(kDefaultRingAllReduceMinBytes) {}
+
+AllReduceGroup::~AllReduceGroup() {
+  STLDeleteElementsAndClear(&sockets_);
+}
+
+bool AllReduceGroup::Initialize(const vector<string>& addresses,
+                                int worker_id) {
+  CHECK(sockets_.empty());
+  CHECK_LE(0, worker_id);
+  CHECK_LT(worker_id, addresses.size());
+  worker_id_ = worker_id;
+  sockets_.resize(addresses.size(), NULL);
+
+  string ip;
+  uint16 port;
+  TCPSocket listener;
+  if (!SplitAddress(addresses[worker_id], &ip, &port) ||
+      !listener.Bind(ip.c_str(), port) ||
+      !listener.Listen(addresses.size())) {
+    LOG(ERROR) << "Cannot listen on " << addresses[worker_id];
+    return false;
+  }
+
+  // Connect to workers of lower ids, and tell them who this is.
+  for (int peer = 0; peer < worker_id; ++peer) {
+    if (!SplitAddress(addresses[peer], &ip, &port)) {
+      return false;
+    }
+    for (int retry = 0; retry < kMaxConnectRetries; ++retry) {
+      sockets_[peer] = new TCPSocket;
+      if (sockets_[peer]->Connect(ip.c_str(), port)) {
+        break;
+      }
+      delete sockets_[peer];
+      sockets_[peer] = NULL;
+      usleep(kConnectRetryInterval);
+    }
+    int32 id = worker_id;
+    if (sockets_[peer] == NULL ||
+        !SendAll(sockets_[peer], reinterpret_cast<char*>(&id), sizeof(id))) {
+      LOG(ERROR) << "Cannot connect to all-reduce worker " << addresses[peer];
+      return false;
+    }
+  }
+
+  // Accept connections from workers of higher ids.
+  for (int i = worker_id + 1; i < addresses.size(); ++i) {
+    scoped_ptr<TCPSocket> peer(new TCPSocket);
+    string client_ip;
+    uint16 client_port;
+    int32 id = -1;
+    if (!listener.Accept(peer.get(), &client_ip, &client_port) ||
+        !ReceiveAll(peer.get(), reinterpret_cast<char*>(&id), sizeof(id))) {
+      LOG(ERROR) << "Failed accepting all-reduce workers.";
+      return false;
+    }
+    if (id <= worker_id || id >= addresses.size() || sockets_[id] != NULL) {
+      LOG(ERROR) << "Unexpected all-reduce worker id " << id
+                 << " from " << client_ip;
+      return false;
+    }
+    sockets_[id] = peer.release();
+  }
+  LOG(INFO) << "All-reduce worker " << worker_id << " connected to "
+            << addresses.size() - 1 << " workers.";
+  return true;
+}
+
+bool AllReduceGroup::AllReduce(float* data, int size) {
+  return Reduce(data, size);
+}
+
+bool AllReduceGroup::AllReduce(double* data, int size) {
+  return Reduce(data, size);
+}
+
+bool AllReduceGroup::Broadcast(char* data, int size) {
+  CHECK(!sockets_.empty());
+  const int n = num_workers();
+  // Worker id receives from its parent, id - its lowest set bit, and
+  // sends to id + 2^k for 2^k less than the lowest set bit.
+  int mask = 1;
+  while (mask < n && (worker_id_ & mask) == 0) {
+    mask <<= 1;
+  }
+  if (worker_id_ != 0 &&
+      !ReceiveAll(sockets_[worker_id_ - mask], data, size)) {
+    return false;
+  }
+  for (mask >>= 1; mask > 0; mask >>= 1) {
+    if (worker_id_ + mask < n &&
+        !SendAll(sockets_[worker_id_ + mask], data, size)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool AllReduceGroup::Broadcast(string* data) {
+  int64 size = data->size();
+  if (!Broadcast(reinterpret_cast<char*>(&size), sizeof(size))) {
+    return false;
+  }
+  data->resize(size);
+  return size == 0 || Broadcast(&(*data)[0], size);
+}
+
+bool AllReduceGroup::Barrier() {
+  float token = 0;
+  return TreeReduce(&token, 1);
+}
+
+template <typename Element>
+bool AllReduceGroup::Reduce(Element* data, int size) {
+  CHECK(!sockets_.empty());
+  if (num_workers() == 1 || size == 0) {
+    return true;
+  }
+  if (size * sizeof(Element) >= ring_min_bytes_) {
+    return RingReduce(data, size);
+  }
+  return TreeReduce(data, size);
+}
+
+template <typename Element>
+bool AllReduceGroup::RingReduce(Element* data, int size) {
+  const int n = num_workers();
+  vector<int> begins(n + 1);      // Chunk c is [begins[c], begins[c + 1]).
+  for (int c = 0; c <= n; ++c) {
+    begins[c] = static_cast<int64>(size) * c / n;
+  }
+  char* bytes = reinterpret_cast<char*>(data);
+  const int e = sizeof(Element);
+
+  // After step s, this worker has the sum of chunk (id - s - 1) over
+  // s + 2 workers.
+  for (int s = 0; s < n - 1; ++s) {
+    int send = (worker_id_ - s + n) % n;
+    int receive = (worker_id_ - s - 1 + n) % n;
+    if (!Exchange(bytes + begins[send] * e,
+                  (begins[send + 1] - begins[send]) * e,
+                  NULL,
+                  (begins[receive + 1] - begins[receive]) * e,
+                  data + begins[receive])) {
+      return false;
+    }
+  }
+  // This worker has the sum of chunk (id + 1).  Pass sums around.
+  for (int s = 0; s < n - 1; ++s) {
+    int send = (worker_id_ + 1 - s + n) % n;
+    int receive = (worker_id_ - s + n) % n;
+    if (!Exchange<Element>(bytes + begins[send] * e,
+                           (begins[send + 1] - begins[send]) * e,
+                           bytes + begins[receive] * e,
+                           (begins[receive + 1] - begins[receive]) * e,
+                           NULL)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename Element>
+bool AllReduceGroup::TreeReduce(Element* data, int size) {
+  const int n = num_workers();
+  const int bytes = size * sizeof(Element);
+  char* array = reinterpret_cast<char*>(data);
+
+  // Reduce: worker id receives from id + 2^k for 2^k less than the
+  // lowest set bit of id, and then sends to id - lowest bit.
+  for (int mask = 1; mask < n; mask <<= 1) {
+    if (worker_id_ & mask) {
+      if (!SendAll(sockets_[worker_id_ - mask], array, bytes)) {
+        return false;
+      }
+      break;
+    }
+    if (worker_id_ + mask < n) {
+      buffer_.resize(bytes);
+      if (!ReceiveAll(sockets_[worker_id_ + mask], &buffer_[0], bytes)) {
+        return false;
+      }
+      VectorAdd(size, reinterpret_cast<Element*>(&buffer_[0]), data);
+    }
+  }
+
+  // Broadcast the sums in the reverse order.
+  return Broadcast(array, bytes);
+}
+
+template <typename Element>
+bool AllReduceGroup::Exchange(const char* send, int send_size,
+                              char* receive, int receive_size,
+                              Element* add_to) {
+  const int n = num_workers();
+  int right = sockets_[(worker_id_ + 1) % n]->Socket();
+  int left = sockets_[(worker_id_ - 1 + n) % n]->Socket();
+  if (add_to != NULL) {
+    buffer_.resize(receive_size);
+    receive = &buffer_[0];
+  }
+
+  int sent = 0;
+  int received = 0;
+  int added = 0;                  // Received elements added to add_to.
+  while (sent < send_size || received < receive_size) {
+    // With two workers, left and right are the same socket.
+    struct pollfd fds[2];
+    fds[0].fd = sent < send_size ? right : -1;
+    fds[0].events = POLLOUT;
+    fds[1].fd = received < receive_size ? left : -1;
+    fds[1].events = POLLIN;
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG(ERROR) << "poll() failed in all-reduce.";
+      return false;
+    }
+    if (fds[0].revents & (POLLOUT | POLLERR | POLLHUP)) {
+      int bytes = ::send(right, send + sent, send_size - sent,
+                         MSG_DONTWAIT | MSG_NOSIGNAL);
+      if (bytes < 0 && errno != EAGAIN && errno != EINTR) {
+        LOG(ERROR) << "Failed sending to all-reduce worker "
+                   << (worker_id_ + 1) % n;
+        return false;
+      }
+      sent += std::max(bytes, 0);
+    }
+    if (fds[1].revents & (POLLIN | POLLERR | POLLHUP)) {
+      int bytes = ::recv(left, receive + received, receive_size - received,
+                         MSG_DONTWAIT);
+      if (bytes == 0 || (bytes < 0 && errno != EAGAIN && errno != EINTR)) {
+        LOG(ERROR) << "Failed receiving from all-reduce worker "
+                   << (worker_id_ - 1 + n) % n;
+        return false;
+      }
+      received += std::max(bytes, 0);
+      if (add_to != NULL) {
+        int complete = received / sizeof(Element);
+        VectorAdd(complete - added,
+                  reinterpret_cast<Element*>(receive) + added,
+                  add_to + added);
+        added = complete;
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace mapreduce_lite
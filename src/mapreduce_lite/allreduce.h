@@ -0,0 +1,114 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+// AllReduceGroup sums arrays element-wise over a group of workers, so
+// that every worker gets the sums.  Iterative learning algorithms use
+// it to synchronize model updates of map workers (see
+// Mapper::AllReduce and --mr_allreduce_workers), instead of shuffling
+// and sorting the updates as map outputs.
+//
+// Worker i of a group listens on addresses[i], connects to workers of
+// lower ids, and accepts connections from workers of higher ids, so
+// each pair of workers shares a TCP connection.  All workers must
+// invoke AllReduce() in the same order and with arrays of the same
+// size.
+//
+// Arrays of at least ring_min_bytes() are reduced along a ring of
+// workers.  An array is split into one chunk per worker.  In each of
+// n - 1 reduce-scatter steps, a worker sends a chunk to its right
+// neighbor and adds the one received from its left neighbor, so that
+// each worker ends up with the sum of one chunk.  In n - 1 all-gather
+// steps, the sums travel around the ring.  So each worker sends and
+// receives about twice the array, regardless of the number of
+// workers.  Received bytes are added as they arrive, overlapping the
+// additions with the transfer.  Smaller arrays, where the latency of
+// 2(n - 1) steps dominates, are reduced to worker 0 and then broadcast
+// along a binomial tree, in 2 log(n) steps.
+//
+#ifndef MAPREDUCE_LITE_ALLREDUCE_H_
+#define MAPREDUCE_LITE_ALLREDUCE_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/mapreduce_lite/tcp_socket.h"
+
+namespace mapreduce_lite {
+
+// By default, arrays of at least this size are reduced by the ring.
+const int kDefaultRingAllReduceMinBytes = 64 * 1024;     // 64 KB
+
+class AllReduceGroup {
+ public:
+  AllReduceGroup();
+  ~AllReduceGroup();
+
+  // Connect to all other workers.  Blocks until all of them started.
+  bool Initialize(const std::vector<std::string>& addresses, int worker_id);
+
+  // Replace data by the element-wise sums over all workers.  Returns
+  // false on network errors, after which the group is unusable.
+  bool AllReduce(float* data, int size);
+  bool AllReduce(double* data, int size);
+
+  // Replace data by that of worker 0, along the binomial tree.  All
+  // workers must pass the same size.
+  bool Broadcast(char* data, int size);
+  // Replace data by that of worker 0, whose size may differ.
+  bool Broadcast(std::string* data);
+
+  // Blocks until all workers invoke Barrier().
+  bool Barrier();
+
+  int ring_min_bytes() const { return ring_min_bytes_; }
+  void set_ring_min_bytes(int bytes) { ring_min_bytes_ = bytes; }
+
+  int worker_id() const { return worker_id_; }
+  int num_workers() const { return sockets_.size(); }
+
+ private:
+  template <typename Element>
+  bool Reduce(Element* data, int size);
+
+  template <typename Element>
+  bool RingReduce(Element* data, int size);
+
+  template <typename Element>
+  bool TreeReduce(Element* data, int size);
+
+  // Send send_size bytes to the right neighbor while receiving
+  // receive_size bytes from the left one.  If add_to is not NULL,
+  // received elements are added to add_to instead of being stored in
+  // receive.
+  template <typename Element>
+  bool Exchange(const char* send, int send_size,
+                char* receive, int receive_size, Element* add_to);
+
+  int worker_id_;
+  int ring_min_bytes_;
+  std::vector<TCPSocket*> sockets_;    // NULL for this worker.
+  std::vector<char> buffer_;           // Received elements to be added.
+
+  DISALLOW_COPY_AND_ASSIGN(AllReduceGroup);
+};
+
+}  // namespace mapreduce_lite
+
+#endif  // MAPREDUCE_LITE_ALLREDUCE_H_
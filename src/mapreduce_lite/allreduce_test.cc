@@ -0,0 +1,101 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/mapreduce_lite/allreduce.h"
+
+#include <string>
+#include <vector>
+
+#include "boost/bind.hpp"
+#include "boost/thread.hpp"
+#include "gtest/gtest.h"
+
+#include "src/base/common.h"
+#include "src/base/scoped_ptr.h"
+#include "src/strutil/stringprintf.h"
+
+namespace {
+
+using mapreduce_lite::AllReduceGroup;
+
+// Worker i contributes i + j to the j-th element of an array of size,
+// and checks the sums after each of the all-reduces by the tree and
+// the ring.
+template <typename Element>
+void AllReduceWorker(const std::vector<std::string>& addresses,
+                     int worker_id, int size, bool* succeeded) {
+  AllReduceGroup group;
+  *succeeded = group.Initialize(addresses, worker_id);
+  const int n = addresses.size();
+  std::vector<Element> data(size);
+  for (int ring_min_bytes = size * sizeof(Element) + 1;
+       *succeeded && ring_min_bytes >= 0;
+       ring_min_bytes -= size * sizeof(Element) + 1) {
+    group.set_ring_min_bytes(ring_min_bytes);
+    for (int j = 0; j < size; ++j) {
+      data[j] = worker_id + j;
+    }
+    *succeeded = group.AllReduce(&data[0], size);
+    for (int j = 0; *succeeded && j < size; ++j) {
+      *succeeded = data[j] == n * (n - 1) / 2 + n * j;
+    }
+  }
+
+  std::string message = StringPrintf("from %d", worker_id);
+  if (*succeeded) {
+    *succeeded = group.Barrier() && group.Broadcast(&message) &&
+        message == "from 0";
+  }
+}
+
+template <typename Element>
+void TestAllReduce(int num_workers, int size, int first_port) {
+  std::vector<std::string> addresses;
+  for (int i = 0; i < num_workers; ++i) {
+    addresses.push_back(StringPrintf("127.0.0.1:%d", first_port + i));
+  }
+  scoped_array<bool> succeeded(new bool[num_workers]);
+  boost::thread_group workers;
+  for (int i = 0; i < num_workers; ++i) {
+    workers.create_thread(boost::bind(&AllReduceWorker<Element>,
+                                      addresses, i, size, &succeeded[i]));
+  }
+  workers.join_all();
+  for (int i = 0; i < num_workers; ++i) {
+    EXPECT_TRUE(succeeded[i]) << "worker " << i << " of " << num_workers
+                              << ", size " << size;
+  }
+}
+
+}  // namespace
+
+TEST(AllReduceTest, SingleWorker) {
+  TestAllReduce<float>(1, 10, 11400);
+}
+
+TEST(AllReduceTest, Float) {
+  TestAllReduce<float>(2, 1000, 11410);
+  TestAllReduce<float>(3, 1, 11420);           // Some chunks are empty.
+  TestAllReduce<float>(5, 100000, 11430);
+}
+
+TEST(AllReduceTest, Double) {
+  TestAllReduce<double>(4, 12345, 11440);
+  TestAllReduce<double>(7, 777, 11450);
+}
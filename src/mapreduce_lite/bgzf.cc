@@ -0,0 +1,231 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/mapreduce_lite/bgzf.h"
+
+#include <string.h>
+
+#include "zlib.h"
+
+#include "src/base/stl-util.h"
+
+namespace mapreduce_lite {
+
+using std::string;
+
+// The header of a block, whose last two bytes are the block size
+// minus 1, and the trailer of a block is CRC32 and the data size.
+static const int kHeaderSize = 18;
+static const int kTrailerSize = 8;
+static const char kHeader[kHeaderSize - 2] = {
+  0x1f, static_cast<char>(0x8b), 8, 4,  // gzip magic, deflate, FEXTRA
+  0, 0, 0, 0,                            // modification time
+  0, static_cast<char>(0xff),            // extra flags, unknown OS
+  6, 0,                                  // extra field length
+  'B', 'C', 2, 0                         // BC subfield of length 2
+};
+
+const char kBgzfEofBlock[kBgzfEofBlockSize] = {
+  0x1f, static_cast<char>(0x8b), 8, 4, 0, 0, 0, 0, 0, static_cast<char>(0xff),
+  6, 0, 'B', 'C', 2, 0, 0x1b, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static uint32 DecodeUint32(const char* p) {
+  const unsigned char* q = reinterpret_cast<const unsigned char*>(p);
+  return q[0] | (q[1] << 8) | (q[2] << 16) | (static_cast<uint32>(q[3]) << 24);
+}
+
+static void AppendUint32(uint32 value, string* buffer) {
+  for (int i = 0; i < 4; ++i) {
+    buffer->push_back(static_cast<char>(value >> (8 * i)));
+  }
+}
+
+bool ReadBgzfBlock(FILE* input, string* block) {
+  block->resize(kHeaderSize);
+  size_t header_size = fread(&(*block)[0], 1, kHeaderSize, input);
+  if (header_size == 0) {
+    return false;
+  }
+  if (header_size != kHeaderSize ||
+      memcmp(block->data(), kHeader, kHeaderSize - 2) != 0) {
+    LOG(FATAL) << "Not a BGZF block, which may be a plain gzip member.";
+  }
+  const unsigned char* size_bytes =
+      reinterpret_cast<const unsigned char*>(block->data() + kHeaderSize - 2);
+  int block_size = (size_bytes[0] | (size_bytes[1] << 8)) + 1;
+  if (block_size < kHeaderSize + kTrailerSize) {
+    LOG(FATAL) << "Invalid BGZF block size: " << block_size;
+  }
+  block->resize(block_size);
+  if (fread(&(*block)[kHeaderSize], block_size - kHeaderSize, 1, input) != 1) {
+    LOG(FATAL) << "Unexpected EOF in reading a BGZF block.";
+  }
+  return true;
+}
+
+bool InflateBgzfBlock(const string& block, string* data) {
+  uint32 data_size = DecodeUint32(block.data() + block.size() - 4);
+  uint32 crc = DecodeUint32(block.data() + block.size() - kTrailerSize);
+  if (data_size > kBgzfMaxBlockSize) {
+    return false;
+  }
+  // Leave a byte for zlib even if data is empty.
+  data->resize(data_size + 1);
+
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {  // Raw deflate data.
+    return false;
+  }
+  stream.next_in = reinterpret_cast<Bytef*>(
+      const_cast<char*>(block.data()) + kHeaderSize);
+  stream.avail_in = block.size() - kHeaderSize - kTrailerSize;
+  stream.next_out = reinterpret_cast<Bytef*>(&(*data)[0]);
+  stream.avail_out = data_size + 1;
+  int result = inflate(&stream, Z_FINISH);
+  inflateEnd(&stream);
+  data->resize(data_size);
+  return result == Z_STREAM_END && stream.total_out == data_size &&
+      crc32(0, reinterpret_cast<const Bytef*>(data->data()), data_size) == crc;
+}
+
+void DeflateBgzfBlock(const char* data, int size, string* block) {
+  CHECK_LE(size, kBgzfMaxDataSize);
+  int begin = block->size();
+  block->append(kHeader, kHeaderSize - 2);
+  block->append(2, '\0');                    // The block size.
+  block->resize(begin + kBgzfMaxBlockSize);
+
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  CHECK_EQ(Z_OK, deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                              -MAX_WBITS, 8, Z_DEFAULT_STRATEGY));
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+  stream.avail_in = size;
+  stream.next_out = reinterpret_cast<Bytef*>(&(*block)[begin + kHeaderSize]);
+  stream.avail_out = kBgzfMaxBlockSize - kHeaderSize - kTrailerSize;
+  CHECK_EQ(Z_STREAM_END, deflate(&stream, Z_FINISH));
+  CHECK_EQ(Z_OK, deflateEnd(&stream));
+
+  block->resize(begin + kHeaderSize + stream.total_out);
+  AppendUint32(crc32(0, reinterpret_cast<const Bytef*>(data), size), block);
+  AppendUint32(size, block);
+  int block_size = block->size() - begin;
+  (*block)[begin + kHeaderSize - 2] = static_cast<char>((block_size - 1) & 0xff);
+  (*block)[begin + kHeaderSize - 1] = static_cast<char>((block_size - 1) >> 8);
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of BgzfBlockReader
+//-----------------------------------------------------------------------------
+BgzfBlockReader::BgzfBlockReader(FILE* input, int num_threads)
+    : input_(input),
+      max_blocks_(num_threads > 0 ? 4 * num_threads : 1),
+      eof_(false),
+      stopping_(false) {
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.push_back(new boost::thread(DecompressLoop, this));
+  }
+}
+
+BgzfBlockReader::~BgzfBlockReader() {
+  {
+    MutexLocker locker(&mutex_);
+    stopping_ = true;
+    queued_.Broadcast();
+  }
+  for (int i = 0; i < threads_.size(); ++i) {
+    threads_[i]->join();
+  }
+  STLDeleteElementsAndClear(&threads_);
+  STLDeleteElementsAndClear(&window_);
+  STLDeleteElementsAndClear(&free_blocks_);
+}
+
+bool BgzfBlockReader::Next(string* data) {
+  ReadAhead();
+  if (window_.empty()) {
+    return false;
+  }
+  Block* block = window_.front();
+  window_.pop_front();
+  if (threads_.empty()) {
+    block->ok = InflateBgzfBlock(block->compressed, &block->data);
+  } else {
+    MutexLocker locker(&mutex_);
+    while (!block->done) {
+      done_.Wait(&mutex_);
+    }
+  }
+  free_blocks_.push_back(block);
+  if (!block->ok) {
+    LOG(FATAL) << "Corrupted BGZF block.";
+  }
+  data->swap(block->data);
+  return true;
+}
+
+void BgzfBlockReader::ReadAhead() {
+  while (!eof_ && window_.size() < max_blocks_) {
+    Block* block = NULL;
+    if (free_blocks_.empty()) {
+      block = new Block;
+    } else {
+      block = free_blocks_.back();
+      free_blocks_.pop_back();
+    }
+    if (!ReadBgzfBlock(input_, &block->compressed)) {
+      free_blocks_.push_back(block);
+      eof_ = true;
+      break;
+    }
+    block->done = false;
+    window_.push_back(block);
+    if (!threads_.empty()) {
+      MutexLocker locker(&mutex_);
+      queue_.push_back(block);
+      queued_.Signal();
+    }
+  }
+}
+
+void BgzfBlockReader::DecompressLoop(BgzfBlockReader* reader) {
+  while (true) {
+    Block* block = NULL;
+    {
+      MutexLocker locker(&reader->mutex_);
+      while (reader->queue_.empty() && !reader->stopping_) {
+        reader->queued_.Wait(&reader->mutex_);
+      }
+      if (reader->stopping_) {
+        return;
+      }
+      block = reader->queue_.front();
+      reader->queue_.pop_front();
+    }
+    bool ok = InflateBgzfBlock(block->compressed, &block->data);
+    MutexLocker locker(&reader->mutex_);
+    block->ok = ok;
+    block->done = true;
+    reader->done_.Broadcast();
+  }
+}
+
+}  // namespace mapreduce_lite
@@ -0,0 +1,112 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+// BGZF (blocked gzip, as used by SAMtools) is a series of gzip members,
+// each of which compresses at most 64 KB, and saves its compressed size
+// in a "BC" extra field of the gzip header.  A BGZF file is a valid
+// gzip file, which can be read by gunzip and zcat, and the blocks can
+// be located without decompression, so they can be decompressed in
+// parallel.
+//
+// A BGZF file ends with an empty block (kBgzfEofBlock), which marks
+// the file is complete.
+//
+#ifndef MAPREDUCE_LITE_BGZF_H_
+#define MAPREDUCE_LITE_BGZF_H_
+
+#include <stdio.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "boost/thread.hpp"
+
+#include "src/base/common.h"
+#include "src/system/condition_variable.h"
+#include "src/system/mutex.h"
+
+namespace mapreduce_lite {
+
+// A block compresses at most this number of bytes, so that the
+// compressed block is smaller than 64 KB even if data is random.
+const int kBgzfMaxDataSize = 0xff00;
+const int kBgzfMaxBlockSize = 0x10000;
+
+extern const char kBgzfEofBlock[];
+const int kBgzfEofBlockSize = 28;
+
+// Read the next block from input into block.  Returns false at the
+// end of file.  Dies if the file is not a BGZF or is truncated.
+bool ReadBgzfBlock(FILE* input, std::string* block);
+
+// Decompress a block into data.  Returns false if it is corrupted.
+bool InflateBgzfBlock(const std::string& block, std::string* data);
+
+// Compress at most kBgzfMaxDataSize bytes into a block, which is
+// appended to block.
+void DeflateBgzfBlock(const char* data, int size, std::string* block);
+
+//-----------------------------------------------------------------------------
+// BgzfBlockReader reads blocks from a BGZF file, and decompresses them
+// in a pool of threads, and returns decompressed blocks in order.
+//-----------------------------------------------------------------------------
+class BgzfBlockReader {
+ public:
+  // Reads from input, which is not owned by the reader.  If
+  // num_threads is 0, Next() decompresses blocks.
+  BgzfBlockReader(FILE* input, int num_threads);
+  ~BgzfBlockReader();
+
+  // Returns the data of the next block.  Returns false at the end of
+  // file, and dies if a block is corrupted.
+  bool Next(std::string* data);
+
+ private:
+  struct Block {
+    std::string compressed;
+    std::string data;
+    bool done;                    // data was decompressed.
+    bool ok;                      // compressed was not corrupted.
+  };
+
+  static void DecompressLoop(BgzfBlockReader* reader);
+
+  // Read blocks and queue them until max_blocks_ blocks are ahead.
+  void ReadAhead();
+
+  FILE* input_;
+  int max_blocks_;
+  bool eof_;
+  std::deque<Block*> window_;       // Blocks read, in order.
+  std::vector<Block*> free_blocks_;
+
+  Mutex mutex_;                      // Protects the following four.
+  ConditionVariable queued_;         // Signaled by ReadAhead().
+  ConditionVariable done_;           // Signaled by DecompressLoop().
+  std::deque<Block*> queue_;         // Blocks to decompress.
+  bool stopping_;
+  std::vector<boost::thread*> threads_;
+
+  DISALLOW_COPY_AND_ASSIGN(BgzfBlockReader);
+};
+
+}  // namespace mapreduce_lite
+
+#endif  // MAPREDUCE_LITE_BGZF_H_
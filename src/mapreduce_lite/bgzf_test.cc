@@ -0,0 +1,110 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/mapreduce_lite/bgzf.h"
+
+#include <stdio.h>
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "zlib.h"
+
+#include "src/strutil/stringprintf.h"
+
+namespace mapreduce_lite {
+namespace {
+
+const char* kFilename = "/tmp/bgzf_test";
+const int kNumBlocks = 100;
+
+// Data of the i-th block, some of which are empty or incompressible.
+std::string BlockData(int i) {
+  if (i % 10 == 0) {
+    return "";
+  }
+  std::string data;
+  unsigned int seed = i;
+  while (data.size() < kBgzfMaxDataSize) {
+    data.push_back(i % 2 == 0 ? 'a' + i % 26 : rand_r(&seed) & 0xff);
+  }
+  return data;
+}
+
+void WriteFile() {
+  std::string blocks;
+  for (int i = 0; i < kNumBlocks; ++i) {
+    std::string data = BlockData(i);
+    DeflateBgzfBlock(data.data(), data.size(), &blocks);
+  }
+  blocks.append(kBgzfEofBlock, kBgzfEofBlockSize);
+  FILE* file = fopen(kFilename, "w");
+  CHECK(file != NULL);
+  fwrite(blocks.data(), 1, blocks.size(), file);
+  fclose(file);
+}
+
+}  // namespace
+
+TEST(BgzfTest, ReadBlocks) {
+  WriteFile();
+  int num_threads[] = { 0, 1, 4 };
+  for (int t = 0; t < 3; ++t) {
+    FILE* file = fopen(kFilename, "r");
+    BgzfBlockReader reader(file, num_threads[t]);
+    std::string data;
+    for (int i = 0; i < kNumBlocks; ++i) {
+      ASSERT_TRUE(reader.Next(&data));
+      EXPECT_EQ(BlockData(i), data);
+    }
+    ASSERT_TRUE(reader.Next(&data));  // The EOF block.
+    EXPECT_EQ("", data);
+    EXPECT_FALSE(reader.Next(&data));
+    fclose(file);
+  }
+  remove(kFilename);
+}
+
+TEST(BgzfTest, ReadableByZlib) {
+  WriteFile();
+  gzFile gz = gzopen(kFilename, "r");
+  std::string data(kBgzfMaxDataSize, '\0');
+  for (int i = 0; i < kNumBlocks; ++i) {
+    std::string expected = BlockData(i);
+    if (!expected.empty()) {
+      ASSERT_EQ(expected.size(), gzread(gz, &data[0], expected.size()));
+      EXPECT_EQ(expected, data.substr(0, expected.size()));
+    }
+  }
+  EXPECT_EQ(0, gzread(gz, &data[0], data.size()));
+  gzclose(gz);
+  remove(kFilename);
+}
+
+TEST(BgzfTest, CorruptedBlock) {
+  std::string block;
+  DeflateBgzfBlock("hello", 5, &block);
+  std::string data;
+  EXPECT_TRUE(InflateBgzfBlock(block, &data));
+  EXPECT_EQ("hello", data);
+  block[block.size() - 9] ^= 1;   // The last byte of compressed data.
+  EXPECT_FALSE(InflateBgzfBlock(block, &data));
+}
+
+}  // namespace mapreduce_lite
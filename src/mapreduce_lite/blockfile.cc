@@ -0,0 +1,525 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/mapreduce_lite/blockfile.h"
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+
+#include "src/hash/crc32c.h"
+#include "src/hash/md5_hash.h"
+#include "src/strutil/stringprintf.h"
+
+namespace mapreduce_lite {
+
+using std::string;
+
+static const char kHeaderMagic[] = "MRLBLOCK";
+static const char kFooterMagic[] = "MRLINDEX";
+static const int kMagicSize = 8;
+static const int kHeaderSize = kMagicSize + kBlockFileSyncSize;
+static const int kBlockHeaderSize = 5 * sizeof(uint32);
+static const int kIndexEntrySize = 2 * sizeof(int64);
+static const int kFooterSize = 3 * sizeof(int64) + sizeof(uint32) + kMagicSize;
+
+// A block header claiming a larger block is considered corrupted.
+static const uint32 kMaxBlockSize = 256 * 1024 * 1024;  // 256 MB
+
+// FindSync reads the file in chunks of this size.
+static const int kSyncSearchChunkSize = 64 * 1024;
+
+//-----------------------------------------------------------------------------
+// Codec of varint32 and fixed-size integers in memory
+//-----------------------------------------------------------------------------
+static void AppendVarint32(uint32 value, string* output) {
+  while (value >= 0x80) {
+    output->push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  output->push_back(static_cast<char>(value));
+}
+
+// Returns NULL if the varint32 is incomplete or too long.
+static const char* DecodeVarint32(const char* p, const char* limit,
+                                  uint32* value) {
+  *value = 0;
+  for (int shift = 0; shift <= 28 && p < limit; shift += 7) {
+    uint32 byte = static_cast<unsigned char>(*p++);
+    *value |= (byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      return p;
+    }
+  }
+  return NULL;
+}
+
+template <class Integer>
+static void AppendFixed(Integer value, string* output) {
+  output->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <class Integer>
+static Integer DecodeFixed(const char* p) {
+  Integer value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+// Compares a record index with the first record of an index entry.
+static bool RecordIndexLess(int64 record_index,
+                            const std::pair<int64, int64>& entry) {
+  return record_index < entry.second;
+}
+
+static void NewSyncMarker(char* sync) {
+  string seed = StringPrintf("%lld-%d-%p",
+                             static_cast<long long>(time(NULL)), getpid(),
+                             sync);
+  uint64 high = MD5Hash(seed);
+  uint64 low = MD5Hash(seed + "-");
+  memcpy(sync, &high, sizeof(high));
+  memcpy(sync + sizeof(high), &low, sizeof(low));
+}
+
+static void ZlibCompress(const string& data, string* block) {
+  uLongf compressed_size = compressBound(data.size());
+  block->resize(compressed_size);
+  if (compress2(reinterpret_cast<Bytef*>(&(*block)[0]), &compressed_size,
+                reinterpret_cast<const Bytef*>(data.data()), data.size(),
+                Z_BEST_SPEED) != Z_OK) {
+    LOG(FATAL) << "Failed compressing a block of " << data.size();
+  }
+  block->resize(compressed_size);
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of BlockFileWriter
+//-----------------------------------------------------------------------------
+BlockFileWriter::BlockFileWriter(FILE* output, int block_size,
+                                 BlockFileCompression compression)
+    : output_(output),
+      output_buffer_(NULL),
+      block_size_(block_size),
+      compression_(compression),
+      block_records_(0),
+      written_records_(0),
+      offset_(ftello(output)),
+      num_records_(0),
+      closed_(false),
+      failed_(false) {
+  WriteHeader(0);
+}
+
+BlockFileWriter::BlockFileWriter(string* output, int block_size,
+                                 BlockFileCompression compression,
+                                 int num_threads)
+    : output_(NULL),
+      output_buffer_(output),
+      block_size_(block_size),
+      compression_(compression),
+      block_records_(0),
+      written_records_(0),
+      offset_(0),
+      num_records_(0),
+      closed_(false),
+      failed_(false) {
+  WriteHeader(num_threads);
+}
+
+void BlockFileWriter::WriteHeader(int num_threads) {
+  CHECK_LT(0, block_size_);
+  if (compression_ == kBlockFileZlibCompression) {
+    compressor_.reset(new ParallelCompressor(ZlibCompress, num_threads));
+  }
+  NewSyncMarker(sync_);
+  WriteBytes(kHeaderMagic, kMagicSize);
+  WriteBytes(sync_, kBlockFileSyncSize);
+}
+
+BlockFileWriter::~BlockFileWriter() {
+  if (!closed_) {
+    Close();
+  }
+}
+
+bool BlockFileWriter::Write(const char* key, int key_size,
+                            const char* value, int value_size) {
+  AppendVarint32(key_size, &block_);
+  block_.append(key, key_size);
+  AppendVarint32(value_size, &block_);
+  block_.append(value, value_size);
+  ++block_records_;
+  ++num_records_;
+  if (block_.size() >= block_size_) {
+    return FlushBlock();
+  }
+  return !failed_;
+}
+
+bool BlockFileWriter::Write(const string& key, const string& value) {
+  return Write(key.data(), key.size(), value.data(), value.size());
+}
+
+bool BlockFileWriter::Close() {
+  CHECK(!closed_);
+  closed_ = true;
+  FlushBlock();
+  if (compressor_.get() != NULL) {
+    TakeCompressedBlocks(true);
+  }
+
+  string trailer;
+  for (int i = 0; i < index_.size(); ++i) {
+    AppendFixed<int64>(index_[i].first, &trailer);
+    AppendFixed<int64>(index_[i].second, &trailer);
+  }
+  uint32 index_crc = Crc32c(trailer.data(), trailer.size());
+  AppendFixed<int64>(offset_, &trailer);
+  AppendFixed<int64>(index_.size(), &trailer);
+  AppendFixed<int64>(num_records_, &trailer);
+  AppendFixed<uint32>(index_crc, &trailer);
+  trailer.append(kFooterMagic, kMagicSize);
+  WriteBytes(trailer.data(), trailer.size());
+  if (output_ != NULL && fflush(output_) != 0) {
+    failed_ = true;
+  }
+  return !failed_;
+}
+
+bool BlockFileWriter::FlushBlock() {
+  if (block_records_ == 0) {
+    return !failed_;
+  }
+  if (compressor_.get() == NULL) {
+    WriteBlock(block_records_, block_.size(), block_);
+  } else {
+    compressing_.push_back(std::make_pair(block_records_, block_.size()));
+    compressor_->Add(&block_);
+    TakeCompressedBlocks(false);
+  }
+  block_.clear();
+  block_records_ = 0;
+  return !failed_;
+}
+
+void BlockFileWriter::TakeCompressedBlocks(bool all) {
+  while (compressor_->Take(&compressed_, all || compressor_->Full())) {
+    WriteBlock(compressing_.front().first, compressing_.front().second,
+               compressed_);
+    compressing_.pop_front();
+  }
+}
+
+void BlockFileWriter::WriteBlock(int num_records, int raw_size,
+                                 const string& data) {
+  string header;
+  AppendFixed<uint32>(num_records, &header);
+  AppendFixed<uint32>(raw_size, &header);
+  AppendFixed<uint32>(data.size(), &header);
+  AppendFixed<uint32>(compression_, &header);
+  uint32 crc = ExtendCrc32c(Crc32c(header.data(), header.size()),
+                            data.data(), data.size());
+  AppendFixed<uint32>(crc, &header);
+
+  index_.push_back(std::make_pair(offset_, written_records_));
+  written_records_ += num_records;
+  WriteBytes(sync_, kBlockFileSyncSize);
+  WriteBytes(header.data(), header.size());
+  WriteBytes(data.data(), data.size());
+}
+
+bool BlockFileWriter::WriteBytes(const char* data, int size) {
+  if (output_buffer_ != NULL) {
+    output_buffer_->append(data, size);
+  } else if (size > 0 && fwrite(data, size, 1, output_) != 1) {
+    LOG(ERROR) << "Failed writing " << size << " bytes to a blockfile.";
+    failed_ = true;
+  }
+  offset_ += size;
+  return !failed_;
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of BlockFileReader
+//-----------------------------------------------------------------------------
+BlockFileReader::BlockFileReader(bool skip_corrupted_blocks)
+    : skip_corrupted_blocks_(skip_corrupted_blocks),
+      input_(NULL) {
+  Close();
+}
+
+BlockFileReader::~BlockFileReader() {
+  Close();
+}
+
+void BlockFileReader::Close() {
+  if (input_ != NULL) {
+    fclose(input_);
+    input_ = NULL;
+  }
+  data_end_ = limit_ = position_ = 0;
+  index_.clear();
+  num_records_ = -1;
+  cursor_ = block_end_ = NULL;
+  block_records_ = 0;
+}
+
+bool BlockFileReader::Open(const string& filename) {
+  Close();
+  filename_ = filename;
+  input_ = fopen(filename.c_str(), "r");
+  if (input_ == NULL) {
+    LOG(ERROR) << "Cannot open blockfile: " << filename;
+    return false;
+  }
+  string header;
+  if (!ReadAt(0, kHeaderSize, &header) ||
+      memcmp(header.data(), kHeaderMagic, kMagicSize) != 0) {
+    LOG(ERROR) << "Not a blockfile: " << filename;
+    Close();
+    return false;
+  }
+  memcpy(sync_, header.data() + kMagicSize, kBlockFileSyncSize);
+
+  if (!ReadFooter()) {
+    LOG(WARNING) << "Blockfile " << filename << " has no valid index.  "
+                 << "Was it completely written?";
+    fseeko(input_, 0, SEEK_END);
+    data_end_ = ftello(input_);
+    index_.clear();
+    num_records_ = -1;
+  }
+  position_ = kHeaderSize;
+  limit_ = data_end_;
+  return true;
+}
+
+bool BlockFileReader::ReadFooter() {
+  if (fseeko(input_, 0, SEEK_END) != 0) {
+    return false;
+  }
+  int64 file_size = ftello(input_);
+  string footer;
+  if (file_size < kHeaderSize + kFooterSize ||
+      !ReadAt(file_size - kFooterSize, kFooterSize, &footer) ||
+      memcmp(footer.data() + kFooterSize - kMagicSize, kFooterMagic,
+             kMagicSize) != 0) {
+    return false;
+  }
+  const char* p = footer.data();
+  int64 index_offset = DecodeFixed<int64>(p);
+  int64 num_blocks = DecodeFixed<int64>(p + sizeof(int64));
+  int64 num_records = DecodeFixed<int64>(p + 2 * sizeof(int64));
+  uint32 index_crc = DecodeFixed<uint32>(p + 3 * sizeof(int64));
+  if (index_offset < kHeaderSize || num_blocks < 0 ||
+      index_offset + num_blocks * kIndexEntrySize + kFooterSize !=
+      file_size) {
+    return false;
+  }
+
+  string index;
+  if (!ReadAt(index_offset, num_blocks * kIndexEntrySize, &index) ||
+      Crc32c(index.data(), index.size()) != index_crc) {
+    return false;
+  }
+  for (int64 i = 0; i < num_blocks; ++i) {
+    const char* entry = index.data() + i * kIndexEntrySize;
+    index_.push_back(std::make_pair(DecodeFixed<int64>(entry),
+                                    DecodeFixed<int64>(entry + sizeof(int64))));
+  }
+  data_end_ = index_offset;
+  num_records_ = num_records;
+  return true;
+}
+
+void BlockFileReader::SeekToSplit(int64 begin, int64 end) {
+  position_ = FindSync(std::max<int64>(begin, kHeaderSize));
+  limit_ = std::min(end, data_end_);
+  block_records_ = 0;
+}
+
+bool BlockFileReader::SeekToRecord(int64 record_index) {
+  if (num_records_ < 0 || record_index < 0 || record_index >= num_records_) {
+    return false;
+  }
+  // The last block whose first record is not after record_index.
+  int i = std::upper_bound(index_.begin(), index_.end(), record_index,
+                           RecordIndexLess) - index_.begin() - 1;
+  position_ = index_[i].first;
+  limit_ = data_end_;
+  block_records_ = 0;
+  if (!LoadBlock()) {
+    return false;
+  }
+  const char* key;
+  const char* value;
+  uint32 key_size, value_size;
+  for (int64 skip = record_index - index_[i].second; skip > 0; --skip) {
+    if (!NextRecord(&key, &key_size, &value, &value_size)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool BlockFileReader::Read(string* key, string* value) {
+  const char* key_data;
+  const char* value_data;
+  uint32 key_size, value_size;
+  if (!NextRecord(&key_data, &key_size, &value_data, &value_size)) {
+    return false;
+  }
+  key->assign(key_data, key_size);
+  value->assign(value_data, value_size);
+  return true;
+}
+
+bool BlockFileReader::ReadBatch(RecordBatch* batch,
+                                int max_records, int max_bytes) {
+  const char* key;
+  const char* value;
+  uint32 key_size, value_size;
+  while (batch->Size() < max_records && batch->ByteSize() < max_bytes) {
+    if (!NextRecord(&key, &key_size, &value, &value_size)) {
+      return false;
+    }
+    batch->Add(key, key_size, value, value_size, "", 0);
+  }
+  return true;
+}
+
+bool BlockFileReader::NextRecord(const char** key, uint32* key_size,
+                                 const char** value, uint32* value_size) {
+  while (block_records_ == 0) {
+    if (!LoadBlock()) {
+      return false;
+    }
+  }
+  const char* p = DecodeVarint32(cursor_, block_end_, key_size);
+  if (p == NULL || static_cast<int64>(*key_size) > block_end_ - p) {
+    return SkipCorruptedRecord(key, key_size, value, value_size);
+  }
+  *key = p;
+  p = DecodeVarint32(p + *key_size, block_end_, value_size);
+  if (p == NULL || static_cast<int64>(*value_size) > block_end_ - p) {
+    return SkipCorruptedRecord(key, key_size, value, value_size);
+  }
+  *value = p;
+  cursor_ = p + *value_size;
+  --block_records_;
+  return true;
+}
+
+bool BlockFileReader::SkipCorruptedRecord(const char** key, uint32* key_size,
+                                          const char** value,
+                                          uint32* value_size) {
+  if (!skip_corrupted_blocks_) {
+    LOG(FATAL) << "Corrupted record in blockfile " << filename_;
+  }
+  LOG(ERROR) << "Skipped a corrupted record and the rest of its block "
+             << "in blockfile " << filename_;
+  block_records_ = 0;
+  return NextRecord(key, key_size, value, value_size);
+}
+
+bool BlockFileReader::LoadBlock() {
+  while (position_ < limit_) {
+    string header;
+    if (!ReadAt(position_, kBlockFileSyncSize + kBlockHeaderSize, &header)) {
+      return false;
+    }
+    const char* p = header.data() + kBlockFileSyncSize;
+    uint32 num_records = DecodeFixed<uint32>(p);
+    uint32 raw_size = DecodeFixed<uint32>(p + 4);
+    uint32 data_size = DecodeFixed<uint32>(p + 8);
+    uint32 compression = DecodeFixed<uint32>(p + 12);
+    uint32 crc = DecodeFixed<uint32>(p + 16);
+    int64 data_offset = position_ + header.size();
+
+    bool good = memcmp(header.data(), sync_, kBlockFileSyncSize) == 0 &&
+        raw_size <= kMaxBlockSize && data_size <= kMaxBlockSize &&
+        data_offset + data_size <= data_end_ &&
+        (compression == kBlockFileNoCompression ||
+         compression == kBlockFileZlibCompression) &&
+        ReadAt(data_offset, data_size, &stored_) &&
+        ExtendCrc32c(Crc32c(p, kBlockHeaderSize - sizeof(crc)),
+                     stored_.data(), stored_.size()) == crc;
+    if (good && compression == kBlockFileZlibCompression) {
+      uLongf size = raw_size;
+      block_.resize(raw_size);
+      good = uncompress(reinterpret_cast<Bytef*>(&block_[0]), &size,
+                        reinterpret_cast<const Bytef*>(stored_.data()),
+                        stored_.size()) == Z_OK && size == raw_size;
+    } else if (good) {
+      block_.swap(stored_);
+    }
+    if (!good) {
+      if (!skip_corrupted_blocks_) {
+        LOG(FATAL) << "Corrupted block at offset " << position_
+                   << " of blockfile " << filename_;
+      }
+      LOG(ERROR) << "Skipped a corrupted block at offset " << position_
+                 << " of blockfile " << filename_;
+      position_ = FindSync(position_ + 1);
+      continue;
+    }
+
+    position_ = data_offset + data_size;
+    cursor_ = block_.data();
+    block_end_ = block_.data() + block_.size();
+    block_records_ = num_records;
+    return true;
+  }
+  return false;
+}
+
+int64 BlockFileReader::FindSync(int64 from) {
+  string chunk;
+  while (from < data_end_) {
+    int size = std::min<int64>(kSyncSearchChunkSize, data_end_ - from);
+    if (!ReadAt(from, size, &chunk)) {
+      break;
+    }
+    const char* found = reinterpret_cast<const char*>(
+        memmem(chunk.data(), chunk.size(), sync_, kBlockFileSyncSize));
+    if (found != NULL) {
+      return from + (found - chunk.data());
+    }
+    if (size < kBlockFileSyncSize) {
+      break;
+    }
+    from += size - kBlockFileSyncSize + 1;  // A sync may cross chunks.
+  }
+  return data_end_;
+}
+
+bool BlockFileReader::ReadAt(int64 offset, int size, string* buffer) {
+  buffer->resize(size);
+  if (size == 0) {
+    return true;
+  }
+  return fseeko(input_, offset, SEEK_SET) == 0 &&
+      fread(&(*buffer)[0], size, 1, input_) == 1;
+}
+
+}  // namespace mapreduce_lite
@@ -0,0 +1,191 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+// Blockfile is a container format of key-value records, which, unlike
+// protofile, can be split and read from the middle, and detects
+// corruption.  Records are grouped into blocks of about block_size
+// bytes.  Each block begins with a sync marker, which is 16 random
+// bytes chosen per file, so a reader starting from any offset finds
+// the next block by searching the sync marker.  Each block has a
+// CRC32C checksum, and might be compressed by zlib.  A trailing index
+// saves the offset and the first record index of each block, so a
+// reader can seek to a record by its index.
+//
+// The layout (integers are little-endian):
+//
+//   file   := header block* index footer
+//   header := "MRLBLOCK" sync
+//   block  := sync num_records:uint32 raw_size:uint32 data_size:uint32
+//             compression:uint32 crc32c:uint32 data
+//   data   := (possibly compressed) record*
+//   record := key_size:varint32 key value_size:varint32 value
+//   index  := (block_offset:int64 first_record:int64)*
+//   footer := index_offset:int64 num_blocks:int64 num_records:int64
+//             index_crc32c:uint32 "MRLINDEX"
+//
+// The CRC32C of a block covers its four header fields before crc32c
+// and data.  A corrupted block is logged and skipped.
+//
+#ifndef MAPREDUCE_LITE_BLOCKFILE_H_
+#define MAPREDUCE_LITE_BLOCKFILE_H_
+
+#include <stdio.h>
+
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/scoped_ptr.h"
+#include "src/mapreduce_lite/parallel_compressor.h"
+#include "src/mapreduce_lite/record_batch.h"
+
+namespace mapreduce_lite {
+
+const int kBlockFileSyncSize = 16;
+
+enum BlockFileCompression {
+  kBlockFileNoCompression = 0,
+  kBlockFileZlibCompression = 1,
+};
+
+class BlockFileWriter {
+ public:
+  // Writes the file header to output, which is not owned by the
+  // writer.  A block is written once its records take block_size bytes.
+  BlockFileWriter(FILE* output, int block_size,
+                  BlockFileCompression compression);
+  // Appends the file to output instead, which is not owned by the
+  // writer, and might be consumed and cleared by the caller between
+  // writes.  Blocks are compressed in num_threads threads, so a block
+  // is appended some blocks later than it is filled.
+  BlockFileWriter(std::string* output, int block_size,
+                  BlockFileCompression compression, int num_threads);
+  ~BlockFileWriter();  // Invokes Close() if it was not invoked.
+
+  bool Write(const char* key, int key_size, const char* value, int value_size);
+  bool Write(const std::string& key, const std::string& value);
+
+  // Writes the last block, the index and the footer.  Does not close
+  // output.  Returns false if any write failed.
+  bool Close();
+
+ private:
+  void WriteHeader(int num_threads);
+  bool FlushBlock();
+  // Write compressed blocks, waiting for all if all is true.
+  void TakeCompressedBlocks(bool all);
+  void WriteBlock(int num_records, int raw_size, const std::string& data);
+  bool WriteBytes(const char* data, int size);
+
+  FILE* output_;
+  std::string* output_buffer_;     // Used instead of output_ if not NULL.
+  int block_size_;
+  BlockFileCompression compression_;
+  char sync_[kBlockFileSyncSize];
+  std::string block_;              // Records of the current block.
+  std::string compressed_;
+  int block_records_;
+  scoped_ptr<ParallelCompressor> compressor_;
+  // The number of records and the raw size of blocks being compressed.
+  std::deque<std::pair<int, int> > compressing_;
+  int64 written_records_;          // Records in blocks written.
+  int64 offset_;                   // The offset of the next write.
+  int64 num_records_;
+  std::vector<std::pair<int64, int64> > index_;
+  bool closed_;
+  bool failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockFileWriter);
+};
+
+class BlockFileReader {
+ public:
+  // Dies on corrupted blocks and records, unless skip_corrupted_blocks
+  // is true, in which case they are skipped with an error log.
+  explicit BlockFileReader(bool skip_corrupted_blocks = false);
+  ~BlockFileReader();
+
+  // Returns false if filename is not a blockfile.
+  bool Open(const std::string& filename);
+  void Close();
+
+  // Read only blocks which begin in [begin, end).  Each block belongs
+  // to exactly one of the splits that cover a file.
+  void SeekToSplit(int64 begin, int64 end);
+
+  // Read from the record_index-th record (zero-based) to the end.
+  // Returns false if there is no such record, or the file has no
+  // index (e.g., it was not completely written).
+  bool SeekToRecord(int64 record_index);
+
+  // The number of records in the file, or -1 if it has no index.
+  int64 NumRecords() const { return num_records_; }
+
+  // Returns false if there are no more records.
+  bool Read(std::string* key, std::string* value);
+  bool ReadBatch(RecordBatch* batch, int max_records, int max_bytes);
+
+ private:
+  bool ReadFooter();
+
+  // Decode the next record of the current block, loading the next
+  // block if the current one is exhausted.
+  bool NextRecord(const char** key, uint32* key_size,
+                  const char** value, uint32* value_size);
+
+  // Load the block beginning at position_, or the next good block if
+  // it is corrupted and skip_corrupted_blocks_ is true.  Returns false
+  // if no block begins before limit_.
+  bool LoadBlock();
+
+  // Dies, or skips the rest of the current block and returns the next
+  // record if skip_corrupted_blocks_ is true.
+  bool SkipCorruptedRecord(const char** key, uint32* key_size,
+                           const char** value, uint32* value_size);
+
+  // Returns the offset of the first sync marker at or after from, or
+  // data_end_ if there is none.
+  int64 FindSync(int64 from);
+
+  bool ReadAt(int64 offset, int size, std::string* buffer);
+
+  bool skip_corrupted_blocks_;
+  FILE* input_;
+  std::string filename_;
+  char sync_[kBlockFileSyncSize];
+  int64 data_end_;                 // The end of blocks.
+  int64 limit_;                    // Blocks must begin before it.
+  int64 position_;                 // The offset of the next block.
+  std::vector<std::pair<int64, int64> > index_;
+  int64 num_records_;
+
+  std::string stored_;             // The block as stored in the file.
+  std::string block_;              // The uncompressed block.
+  const char* cursor_;             // The next record in block_.
+  const char* block_end_;
+  int block_records_;              // Records left in block_.
+
+  DISALLOW_COPY_AND_ASSIGN(BlockFileReader);
+};
+
+}  // namespace mapreduce_lite
+
+#endif  // MAPREDUCE_LITE_BLOCKFILE_H_
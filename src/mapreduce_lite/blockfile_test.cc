@@ -0,0 +1,193 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/mapreduce_lite/blockfile.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "src/strutil/stringprintf.h"
+
+using mapreduce_lite::BlockFileCompression;
+using mapreduce_lite::BlockFileReader;
+using mapreduce_lite::BlockFileWriter;
+using mapreduce_lite::kBlockFileNoCompression;
+using mapreduce_lite::kBlockFileZlibCompression;
+
+namespace {
+
+const char* kFilename = "/tmp/blockfile_test";
+const int kNumRecords = 1000;
+const int kBlockSize = 256;   // Tiny, so there are many blocks.
+
+std::string Key(int i) { return StringPrintf("key-%d", i); }
+std::string Value(int i) { return std::string(i % 50, 'a' + i % 26); }
+
+int64 WriteFile(BlockFileCompression compression, int num_records) {
+  FILE* output = fopen(kFilename, "w");
+  CHECK(output != NULL);
+  BlockFileWriter writer(output, kBlockSize, compression);
+  for (int i = 0; i < num_records; ++i) {
+    EXPECT_TRUE(writer.Write(Key(i), Value(i)));
+  }
+  EXPECT_TRUE(writer.Close());
+  int64 size = ftell(output);
+  fclose(output);
+  return size;
+}
+
+// Read records until the end, and check they are consecutive records
+// beginning from the first-th.  Returns the number of records read.
+int ReadAndCheck(BlockFileReader* reader, int first) {
+  std::string key, value;
+  int i = first;
+  while (reader->Read(&key, &value)) {
+    EXPECT_EQ(Key(i), key);
+    EXPECT_EQ(Value(i), value);
+    ++i;
+  }
+  return i - first;
+}
+
+}  // namespace
+
+TEST(BlockFileTest, WriteAndRead) {
+  BlockFileCompression compressions[] = { kBlockFileNoCompression,
+                                          kBlockFileZlibCompression };
+  for (int c = 0; c < 2; ++c) {
+    WriteFile(compressions[c], kNumRecords);
+    BlockFileReader reader;
+    ASSERT_TRUE(reader.Open(kFilename));
+    EXPECT_EQ(kNumRecords, reader.NumRecords());
+    EXPECT_EQ(kNumRecords, ReadAndCheck(&reader, 0));
+
+    ASSERT_TRUE(reader.Open(kFilename));
+    mapreduce_lite::RecordBatch batch;
+    EXPECT_TRUE(reader.ReadBatch(&batch, 10, 1024 * 1024));
+    ASSERT_EQ(10, batch.Size());
+    EXPECT_EQ(Key(9), batch.Key(9));
+    EXPECT_EQ(Value(9), batch.Value(9));
+  }
+
+  // An empty file.
+  WriteFile(kBlockFileNoCompression, 0);
+  BlockFileReader reader;
+  ASSERT_TRUE(reader.Open(kFilename));
+  EXPECT_EQ(0, reader.NumRecords());
+  EXPECT_EQ(0, ReadAndCheck(&reader, 0));
+  remove(kFilename);
+}
+
+TEST(BlockFileTest, CompressInThreads) {
+  std::string output;
+  {
+    BlockFileWriter writer(&output, kBlockSize, kBlockFileZlibCompression, 4);
+    for (int i = 0; i < kNumRecords; ++i) {
+      EXPECT_TRUE(writer.Write(Key(i), Value(i)));
+    }
+    EXPECT_TRUE(writer.Close());
+  }
+  FILE* file = fopen(kFilename, "w");
+  fwrite(output.data(), 1, output.size(), file);
+  fclose(file);
+
+  BlockFileReader reader;
+  ASSERT_TRUE(reader.Open(kFilename));
+  EXPECT_EQ(kNumRecords, reader.NumRecords());
+  ASSERT_TRUE(reader.SeekToRecord(567));
+  EXPECT_EQ(kNumRecords - 567, ReadAndCheck(&reader, 567));
+  remove(kFilename);
+}
+
+TEST(BlockFileTest, ReadSplits) {
+  int64 file_size = WriteFile(kBlockFileZlibCompression, kNumRecords);
+  for (int split_size = 1; split_size < file_size; split_size *= 3) {
+    int count = 0;
+    for (int64 begin = 0; begin < file_size; begin += split_size) {
+      BlockFileReader reader;
+      ASSERT_TRUE(reader.Open(kFilename));
+      reader.SeekToSplit(begin, begin + split_size);
+      std::string key, value;
+      if (reader.Read(&key, &value)) {
+        int first = atoi(key.c_str() + 4);
+        EXPECT_EQ(count, first);  // Splits are read in order.
+        count += 1 + ReadAndCheck(&reader, first + 1);
+      }
+    }
+    EXPECT_EQ(kNumRecords, count);
+  }
+  remove(kFilename);
+}
+
+TEST(BlockFileTest, SeekToRecord) {
+  WriteFile(kBlockFileNoCompression, kNumRecords);
+  BlockFileReader reader;
+  ASSERT_TRUE(reader.Open(kFilename));
+  int indices[] = { 0, 1, 123, kNumRecords - 1 };
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(reader.SeekToRecord(indices[i]));
+    EXPECT_EQ(kNumRecords - indices[i], ReadAndCheck(&reader, indices[i]));
+  }
+  EXPECT_FALSE(reader.SeekToRecord(kNumRecords));
+  remove(kFilename);
+}
+
+TEST(BlockFileTest, SkipCorruptedBlocks) {
+  int64 file_size = WriteFile(kBlockFileNoCompression, kNumRecords);
+  // Corrupt a byte in the middle of the file.
+  FILE* file = fopen(kFilename, "r+");
+  fseek(file, file_size / 2, SEEK_SET);
+  int c = getc(file);
+  fseek(file, file_size / 2, SEEK_SET);
+  putc(c ^ 0xff, file);
+  fclose(file);
+
+  // By default, a corrupted block fails the reader.
+  std::string key, value;
+  BlockFileReader strict_reader;
+  ASSERT_TRUE(strict_reader.Open(kFilename));
+  EXPECT_DEATH(while (strict_reader.Read(&key, &value)) {},
+               "Corrupted block");
+
+  BlockFileReader reader(true);
+  ASSERT_TRUE(reader.Open(kFilename));
+  int count = 0;
+  while (reader.Read(&key, &value)) {
+    int i = atoi(key.c_str() + 4);
+    EXPECT_EQ(Value(i), value);
+    ++count;
+  }
+  EXPECT_LT(kNumRecords / 2, count);   // Only a block is lost.
+  EXPECT_GT(kNumRecords, count);
+
+  // Without the trailing index, records are still readable.
+  ASSERT_EQ(0, truncate(kFilename, file_size - 10));
+  ASSERT_TRUE(reader.Open(kFilename));
+  EXPECT_EQ(-1, reader.NumRecords());
+  count = 0;
+  while (reader.Read(&key, &value)) {
+    ++count;
+  }
+  EXPECT_LT(kNumRecords / 2, count);
+  remove(kFilename);
+}
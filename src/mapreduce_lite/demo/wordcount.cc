@@ -98,16 +98,18 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
   --mrml_log_filebase=/tmp/wordcount-log
  */
 //
-// *** Using Periodic-Flush ***
+// *** Using Periodic Flush ***
 //
-// The WordCountMapperWithCombiner can also be used to demonstrate the
-// periodic-flush mechanism provided by MRML.  Just add a command line
-// parameter to above command line:
+// WordCountReducer can also be used to demonstrate periodic flush of
+// incremental reduction.  Just add command line parameters to above
+// command line:
 /*
-  --mrml_periodic_flush=2
+  --mr_batch_reduction=false                                    \
+  --mr_periodic_flush_outputs=1000
  */
-// The reduce output should be identical to that without using
-// periodic-flush.
+// A word may appear in the reduce output more than once, and the sum
+// of its counts should be identical to its count without periodic
+// flush.
 //
 // *** Using Multi-pass Map ***
 //
@@ -138,7 +140,18 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
   --mrml_batch_reduction=true                                   \
   --mrml_disk_swap_file_dir=/tmp
  */
+//
+// *** Using Map-side Combiner ***
+//
+// In batch reduction mode, map workers merge their map outputs
+// before shipping them to reduce workers.  WordCountCombiner sums up
+// the counts of a word during merging, which reduces the amount of
+// data to be shipped.  Just pass the following flag to map workers:
+/*
+  --mr_combiner_class=WordCountCombiner
+ */
 
+#include <stdlib.h>
 #include <string.h>
 
 #include <iostream>
@@ -162,6 +175,7 @@ using mapreduce_lite::Mapper;
 using mapreduce_lite::IncrementalReducer;
 using mapreduce_lite::BatchReducer;
 using mapreduce_lite::ReduceInputIterator;
+using mapreduce_lite::StaticMapper;
 
 
 class WordCountMapper : public Mapper {
@@ -177,6 +191,23 @@ class WordCountMapper : public Mapper {
 REGISTER_MAPPER(WordCountMapper);
 
 
+// The same as WordCountMapper, but without virtual calls per record.
+class StaticWordCountMapper : public StaticMapper<StaticWordCountMapper> {
+ public:
+  void Map(const std::string& key, const std::string& value) {
+    words_.clear();
+    SplitStringUsing(value, " ", &words_);
+    for (int i = 0; i < words_.size(); ++i) {
+      Emit(words_[i], "1");
+    }
+  }
+
+ private:
+  std::vector<std::string> words_;
+};
+REGISTER_MAPPER(StaticWordCountMapper);
+
+
 class WordCountMapperWithCombiner : public Mapper {
  public:
   void Map(const std::string& key, const std::string& value) {
@@ -275,3 +306,20 @@ class WordCountBatchReducer : public BatchReducer {
   }
 };
 REGISTER_BATCH_REDUCER(WordCountBatchReducer);
+
+
+// A batch reducer used as combiner (by --mr_combiner_class) must keep
+// the key and output values in the same format as map outputs.
+class WordCountCombiner : public BatchReducer {
+ public:
+  void Reduce(const string& key, ReduceInputIterator* values) {
+    int sum = 0;
+    for (; !values->Done(); values->Next()) {
+      sum += atoi(values->value().c_str());
+    }
+    ostringstream formater;
+    formater << sum;
+    Output(key, formater.str());
+  }
+};
+REGISTER_BATCH_REDUCER(WordCountCombiner);
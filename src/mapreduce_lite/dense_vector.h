@@ -0,0 +1,85 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+// Dense vectors as map output values, e.g., gradients of model
+// parameters.  A value is the memory mirror of the elements, like the
+// fast encodings of strcodec.h, so it must not be passed between
+// machines of different endianness.  A mapper outputs a vector by
+//
+//   Output(key, EncodeDenseVector(gradient));
+//
+// and a reducer accesses the elements of a value in place by
+//
+//   DenseVectorView<float> gradient(values->value());
+//   VectorAdd(gradient.size(), gradient.data(), sum);
+//
+// without copying or parsing them.  See also the built-in aggregators
+// FloatVectorSum and DoubleVectorSum in aggregators.h.
+//
+#ifndef MAPREDUCE_LITE_DENSE_VECTOR_H_
+#define MAPREDUCE_LITE_DENSE_VECTOR_H_
+
+#include <string>
+
+#include "src/base/common.h"
+#include "src/base/cvector.h"
+
+namespace mapreduce_lite {
+
+template <typename Element>
+void EncodeDenseVector(const Element* data, int size, std::string* value) {
+  value->assign(reinterpret_cast<const char*>(data), size * sizeof(Element));
+}
+
+template <typename Element>
+std::string EncodeDenseVector(const CVector<Element>& vector) {
+  std::string value;
+  EncodeDenseVector(vector.data(), vector.size(), &value);
+  return value;
+}
+
+// Accesses the elements of a value encoded by EncodeDenseVector().
+// The view is valid as long as the value is not changed.
+template <typename Element>
+class DenseVectorView {
+ public:
+  explicit DenseVectorView(const std::string& value)
+      : data_(reinterpret_cast<const Element*>(value.data())),
+        size_(value.size() / sizeof(Element)) {
+    if (value.size() % sizeof(Element) != 0) {
+      LOG(FATAL) << "A dense vector value of " << value.size()
+                 << " bytes is not an array of " << sizeof(Element)
+                 << "-byte elements.";
+    }
+    // Buffers of std::string are allocated by operator new, and
+    // aligned for all fundamental types.
+    CHECK_EQ(reinterpret_cast<uintptr_t>(data_) % sizeof(Element), 0);
+  }
+
+  const Element* data() const { return data_; }
+  int size() const { return size_; }
+
+ private:
+  const Element* data_;
+  int size_;
+};
+
+}  // namespace mapreduce_lite
+
+#endif  // MAPREDUCE_LITE_DENSE_VECTOR_H_
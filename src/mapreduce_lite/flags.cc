@@ -45,6 +45,9 @@ const int kDefaultReduceInputBufferSize = 256;       // 256 MB
 const int kDefaultMapperMessageQueueSize = 32;       // 32 MB
 const int kDefaultReducerMessageQueueSize = 128;     // 128 MB
 const int kDefaultMapOutputSize = 32 * 1024 * 1024;  // 32 MB
+const int kDefaultMapOutputMergeFactor = 10;
+const int kDefaultReduceMergeMemory = 64;            // 64 MB
+const int kDefaultInputCacheSize = 1024;             // 1 GB
 }  // namespace mapreduce_lite
 
 
@@ -58,6 +61,76 @@ DEFINE_string(mr_reduce_workers, "",
               "This flag is set only for map workers, as each map worker need "
               "to set up network connections to all reduce workers.");
 
+DEFINE_string(mr_map_workers, "",
+              "A set of map workers, each identified by \"hostname:port\".  "
+              "If set in batch reduction mode, each map worker serves its "
+              "reduce input buffer files on its port, and reduce workers "
+              "fetch them directly, instead of the scheduler copying them.  "
+              "This flag is set for both map and reduce workers.");
+
+DEFINE_string(mr_allreduce_workers, "",
+              "A set of addresses, each \"ip:port\", one for each map "
+              "worker.  If set, map workers connect to each other through "
+              "these ports, so that mappers can sum up arrays, e.g., model "
+              "updates, over all map workers by Mapper::AllReduce(), "
+              "instead of outputting them to reduce workers.  Set for map "
+              "workers only.  The ports must differ from those of "
+              "mr_map_workers.");
+
+DEFINE_int32(mr_num_parallel_fetches, 4,
+             "When mr_map_workers is set, the number of map workers from "
+             "which a reduce worker fetches reduce input buffer files "
+             "simultaneously.");
+
+DEFINE_int32(mr_shuffle_timeout, 600,
+             "When mr_map_workers is set, a map worker fails if, after it "
+             "finishes mapping, no reduce worker fetches a file from it in "
+             "this number of seconds before all reduce workers are served.");
+
+DEFINE_int32(mr_reduce_merge_memory,
+             mapreduce_lite::kDefaultReduceMergeMemory,
+             "When mr_map_workers is set, map workers serve each reduce "
+             "input buffer file as soon as it is dumped, and reduce workers "
+             "merge fetched files in background before all map workers "
+             "finish.  This flag, in mega-bytes, bounds the memory used by "
+             "a merge, and thus the number of files merged at a time.");
+
+DEFINE_int32(mr_num_reduce_sub_partitions, 1,
+             "A reduce worker hash-partitions its reduce input into this "
+             "number of sub-partitions, and reduces them in parallel, each "
+             "by its own reducer instance writing to its own output files, "
+             "named after mr_output_files with suffix "
+             "\"-<sub-partition>-of-<sub-partitions>\".  In batch "
+             "reduction mode, this requires mr_map_workers; map workers "
+             "keep sub-partitions as separate reduce input buffer files, "
+             "and must set the same value.  In incremental reduction mode, "
+             "the receiving thread dispatches map outputs to sub-partition "
+             "threads, each owning the partial results of its keys.");
+
+DEFINE_string(mr_spill_dirs, "",
+              "Comma-separated local directories, e.g., one on each disk.  "
+              "If set, reduce input buffer files dumped by map workers, and "
+              "files fetched and merged by reduce workers, are placed in "
+              "these directories round-robin, instead of beside "
+              "mr_reduce_input_filebase, so that disk I/O spreads over "
+              "disks.  Requires mr_map_workers.");
+
+DEFINE_int32(mr_async_io_queue_depth, 0,
+             "In batch reduction mode, if positive, reduce input buffer "
+             "files are written and read asynchronously, with this number "
+             "of 256KB blocks in flight per file, so dumping and merging do "
+             "not block on disk I/O.  0 disables async I/O.");
+
+DEFINE_bool(mr_io_uring, true,
+            "If set with mr_async_io_queue_depth, async I/O is performed by "
+            "io_uring if the kernel supports it.  Otherwise, or if this flag "
+            "is false, it is performed by a pool of I/O threads.");
+
+DEFINE_bool(mr_direct_io, false,
+            "If set with mr_async_io_queue_depth, reduce input buffer files "
+            "are accessed with O_DIRECT, so they do not pollute the page "
+            "cache.");
+
 DEFINE_int32(mr_map_worker_id, -1,
              "A zero-based integer index denoting the map worker id."
              "This flag is set only for map workers to let them know who they "
@@ -88,23 +161,120 @@ DEFINE_string(mr_reducer_class, "",
               "This flag is set only for reduce workers to let them know the "
               "reducer class that they should execute.");
 
+DEFINE_string(mr_combiner_class, "",
+              "In batch reduction mode, a map worker may use a batch reducer "
+              "class as combiner, which reduces values of each key while "
+              "merging map outputs on disk.  This flag is set for map "
+              "workers and requires a positive mr_map_output_merge_factor.  "
+              "If mr_map_workers is set, reduce workers merge map outputs "
+              "instead, so this flag is set for reduce workers.");
+
 DEFINE_string(mr_input_filepattern, "",
               "A set of comma separated input files which will be processed "
               "by one map worker using one mapper class.  This flag is set "
               "only for map workers.");
 
+DEFINE_int32(mr_split_size, 0,
+             "If positive, in mega-bytes, each input file in text, "
+             "mmap_text or blockfile format is divided into byte ranges of "
+             "this size, and each range is mapped separately.  A line (or a "
+             "block) belongs to the range where it begins.  Together with "
+             "mr_num_split_readers, this spreads a few huge files over map "
+             "workers.  0 maps whole files.");
+
+DEFINE_int32(mr_num_split_readers, 1,
+             "If mr_split_size is positive, the number of map workers given "
+             "the same mr_input_filepattern, which must refer to the same "
+             "(e.g., shared) files.  These map workers divide splits "
+             "round-robin, each mapping the splits whose index modulo "
+             "mr_num_split_readers equals its mr_split_reader_id.");
+
+DEFINE_int32(mr_split_reader_id, 0,
+             "A zero-based index in the range of mr_num_split_readers.  See "
+             "mr_num_split_readers.");
+
+DEFINE_int32(mr_input_pipeline_depth, 8,
+             "If positive, a map worker reads inputs in a background thread, "
+             "which keeps up to this number of batches of records (each "
+             "about 1000 records or 1MB) ahead of Map(), and advises the "
+             "kernel to read ahead the next file.  0 reads inputs in the "
+             "thread invoking Map().");
+
+DEFINE_int32(mr_multipass_map, 1,
+             "The number of passes a map worker maps its input, e.g., "
+             "iterations of a learning algorithm.  The map worker keeps "
+             "its process, connections and mapper across passes, and the "
+             "mapper knows the current pass by GetCurrentPass().  Map "
+             "outputs of all passes go to reduce workers.  If "
+             "mr_allreduce_workers is set, map workers wait for each "
+             "other at the end of each pass.");
+
+DEFINE_int32(mr_input_cache_size,
+             mapreduce_lite::kDefaultInputCacheSize,
+             "If mr_multipass_map > 1, the first pass keeps input records "
+             "in memory, at most this number of mega-bytes, so that later "
+             "passes map them without reading and parsing input files "
+             "again.  If inputs exceed it, each pass reads input files.  0 "
+             "disables the cache.");
+
+DEFINE_int32(mr_num_codec_threads, 4,
+             "The number of threads decompressing blocks of each input "
+             "file in \"bgzf_text\" format, and compressing blocks of each "
+             "output file in \"bgzf_text\" or compressed \"blockfile\" "
+             "format.  0 decompresses and compresses in the thread reading "
+             "inputs or writing outputs.");
+
 DEFINE_string(mr_output_files, "",
               "A map-only worker or a reduce worker may generate one or more "
               "output files, each for a reduce output channel.  Usually there "
               "is only one output channel, thus one output file per worker.");
 
 DEFINE_string(mr_input_format, "text",
-              "The input format, can be either \"text\", \"recordio\", or "
-              "\"protofile\".  This flag is set only for map workers.");
+              "The input format, can be either \"text\", \"mmap_text\", "
+              "\"gzip_text\", \"bgzf_text\", \"recordio\", "
+              "\"protofile\", or \"blockfile\".  "
+              "\"mmap_text\" is faster than \"text\" by mapping input "
+              "files into memory and passing empty keys to Map() (see "
+              "Mapper::LazyInputKey).  \"gzip_text\" and \"bgzf_text\" "
+              "read lines of gzip and BGZF (see bgzf.h) files like "
+              "\"mmap_text\".  \"blockfile\" (see blockfile.h) "
+              "supports mr_split_size like text formats.  "
+              "This flag is set only for map workers.");
 
 DEFINE_string(mr_output_format, "text",
-              "The output format, can be either \"text\", \"recordio\", or "
-              "\"protofile\".  This flag is set only for reduce workers.");
+              "The output format, can be either \"text\", \"bgzf_text\", "
+              "\"recordio\", \"protofile\", or \"blockfile\".  "
+              "\"bgzf_text\" writes text lines compressed in blocked gzip, "
+              "which can be read by zcat.  This flag is set only for "
+              "reduce workers.");
+
+DEFINE_bool(mr_compress_output, false,
+            "If set, blocks of output files in \"blockfile\" format are "
+            "compressed by zlib, in --mr_num_codec_threads threads.");
+
+DEFINE_bool(mr_skip_corrupted_blocks, false,
+            "If set, inputs in \"blockfile\" format skip blocks and "
+            "records that fail their checksums with an error log, "
+            "instead of failing the job.");
+
+DEFINE_int32(mr_top_k, 10,
+             "The number of items of the largest scores kept by the "
+             "built-in aggregator TopK (see aggregators.h).");
+
+DEFINE_int32(mr_periodic_flush_outputs, 0,
+             "In incremental reduction mode, if positive, a reducer invokes "
+             "EndReduce() for all its partial results, and forgets them, "
+             "after reducing every this number of map outputs, so memory "
+             "is bounded and results come out before map workers finish.  "
+             "A key may then be output more than once, each time with the "
+             "partial result of the values since the previous flush, which "
+             "downstream programs merge.  0 disables it.");
+
+DEFINE_int32(mr_periodic_flush_seconds, 0,
+             "In incremental reduction mode, if positive, a reducer also "
+             "flushes its partial results (see mr_periodic_flush_outputs) "
+             "if this number of seconds elapsed since the previous flush.  "
+             "It is checked as map outputs arrive.  0 disables it.");
 
 DEFINE_string(mr_reduce_input_filebase, "",
               "In MapReduce Lite, reducer workers recieve and sort map inputs "
@@ -121,6 +291,15 @@ DEFINE_int32(mr_num_reduce_input_buffer_files, -1,
              "output files, a.k.a., reduce input buffer files, into reduce "
              "machines.");
 
+DEFINE_int32(mr_map_output_merge_factor,
+             mapreduce_lite::kDefaultMapOutputMergeFactor,
+             "In batch reduction mode, whenever a map worker has dumped this "
+             "number of reduce input buffer files for a reduce worker, it "
+             "merges them into one in background.  After all inputs are "
+             "mapped, the remaining files are merged, so that only one file "
+             "is shipped to each reduce worker.  0 disables merging.  "
+             "Ignored if mr_map_workers is set.");
+
 DEFINE_string(mr_log_filebase, "",
               "The real log filename is mr_log_filebase appended by worker "
               "type, worker id, date, time, process_id, log type and etc");
@@ -153,6 +332,21 @@ static scoped_ptr<StringVector>& GetReduceWorkers() {
   return reduce_workers;
 }
 
+static scoped_ptr<StringVector>& GetMapWorkers() {
+  static scoped_ptr<StringVector> map_workers(new StringVector);
+  return map_workers;
+}
+
+static scoped_ptr<StringVector>& GetAllReduceWorkers() {
+  static scoped_ptr<StringVector> allreduce_workers(new StringVector);
+  return allreduce_workers;
+}
+
+static scoped_ptr<StringVector>& GetSpillDirectories() {
+  static scoped_ptr<StringVector> spill_dirs(new StringVector);
+  return spill_dirs;
+}
+
 static scoped_ptr<StringVector>& GetOutputFiles() {
   static scoped_ptr<StringVector> output_files(new StringVector);
   return output_files;
@@ -183,6 +377,79 @@ bool ValidateCommandLineFlags() {
     flags_valid = false;
   }
 
+  // If set, mr_map_workers must list all map workers in batch mode.
+  SplitStringUsing(FLAGS_mr_map_workers, ",", GetMapWorkers().get());
+  if (GetMapWorkers()->size() > 0) {
+    if (!FLAGS_mr_batch_reduction || FLAGS_mr_map_only) {
+      LOG(ERROR) << "mr_map_workers is valid only in batch reduction mode.";
+      flags_valid = false;
+    } else if (GetMapWorkers()->size() != FLAGS_mr_num_map_workers) {
+      LOG(ERROR) << "mr_map_workers must specify mr_num_map_workers ("
+                 << FLAGS_mr_num_map_workers << ") map workers.";
+      flags_valid = false;
+    }
+  }
+  SplitStringUsing(FLAGS_mr_allreduce_workers, ",",
+                   GetAllReduceWorkers().get());
+  if (GetAllReduceWorkers()->size() > 0 &&
+      GetAllReduceWorkers()->size() != FLAGS_mr_num_map_workers) {
+    LOG(ERROR) << "mr_allreduce_workers must specify mr_num_map_workers ("
+               << FLAGS_mr_num_map_workers << ") addresses.";
+    flags_valid = false;
+  }
+  if (FLAGS_mr_num_parallel_fetches <= 0) {
+    LOG(ERROR) << "mr_num_parallel_fetches must be positive.";
+    flags_valid = false;
+  }
+  if (FLAGS_mr_shuffle_timeout <= 0) {
+    LOG(ERROR) << "mr_shuffle_timeout must be positive.";
+    flags_valid = false;
+  }
+  if (FLAGS_mr_reduce_merge_memory <= 0) {
+    LOG(ERROR) << "mr_reduce_merge_memory must be positive.";
+    flags_valid = false;
+  }
+  if (FLAGS_mr_num_reduce_sub_partitions <= 0) {
+    LOG(ERROR) << "mr_num_reduce_sub_partitions must be positive.";
+    flags_valid = false;
+  } else if (FLAGS_mr_num_reduce_sub_partitions > 1 && FLAGS_mr_map_only) {
+    LOG(ERROR) << "mr_num_reduce_sub_partitions must be 1 in map-only mode.";
+    flags_valid = false;
+  } else if (FLAGS_mr_num_reduce_sub_partitions > 1 &&
+             FLAGS_mr_batch_reduction && GetMapWorkers()->empty()) {
+    // Without mr_map_workers, the scheduler renames reduce input
+    // buffer files, which loses their sub-partitions.
+    LOG(ERROR) << "mr_num_reduce_sub_partitions > 1 requires mr_map_workers "
+               << "in batch reduction mode.";
+    flags_valid = false;
+  }
+
+  if (FLAGS_mr_async_io_queue_depth < 0) {
+    LOG(ERROR) << "mr_async_io_queue_depth must not be negative.";
+    flags_valid = false;
+  }
+  if (FLAGS_mr_direct_io && FLAGS_mr_async_io_queue_depth <= 0) {
+    LOG(ERROR) << "mr_direct_io requires a positive mr_async_io_queue_depth.";
+    flags_valid = false;
+  }
+
+  // Spill directories must exist.  Without mr_map_workers, the
+  // scheduler looks for reduce input buffer files by filebase.
+  SplitStringUsing(FLAGS_mr_spill_dirs, ",", GetSpillDirectories().get());
+  if (GetSpillDirectories()->size() > 0) {
+    if (GetMapWorkers()->empty()) {
+      LOG(ERROR) << "mr_spill_dirs requires mr_map_workers.";
+      flags_valid = false;
+    }
+    for (int i = 0; i < GetSpillDirectories()->size(); ++i) {
+      if (!boost::filesystem::is_directory((*GetSpillDirectories())[i])) {
+        LOG(ERROR) << "Spill directory does not exist: "
+                   << (*GetSpillDirectories())[i];
+        flags_valid = false;
+      }
+    }
+  }
+
   // In map-only mode, only map_worker_id, but not reduce_worker_id, is set.
   // If not in map-only mode, either map_worker_id or reduce_worker_id is set.
   // This check makes sure that IAmMapWorker() can predicate the worker role.
@@ -235,9 +502,9 @@ bool ValidateCommandLineFlags() {
       flags_valid = false;
     } else if (IAmMapWorker() && boost::filesystem::exists(
         ::sorted_buffer::SortedBuffer::SortedFilename(
-            MapOutputBufferFilebase(0), 0))) {
+            MapOutputBufferFilebase(0, 0), 0))) {
       LOG(ERROR) << "Please delete existing reduce input buffer files: "
-                 << MapOutputBufferFilebase(0) << "* ";
+                 << MapOutputBufferFilebase(0, 0) << "* ";
       flags_valid = false;
     } else if (FLAGS_mr_reduce_input_buffer_size < 1 ||
                FLAGS_mr_reduce_input_buffer_size > 2 * 1024) {
@@ -246,18 +513,86 @@ bool ValidateCommandLineFlags() {
     }
   }
 
+  // Combiner merges map outputs in batch mode only, on map workers, or
+  // on reduce workers if they fetch from map workers.
+  if (!FLAGS_mr_combiner_class.empty() &&
+      (!FLAGS_mr_batch_reduction || FLAGS_mr_map_only ||
+       (FLAGS_mr_map_output_merge_factor <= 0 &&
+        GetMapWorkers()->empty()))) {
+    LOG(ERROR) << "mr_combiner_class requires batch reduction mode (but not "
+               << "map-only mode), and a positive mr_map_output_merge_factor "
+               << "or mr_map_workers.";
+    flags_valid = false;
+  }
+  if (FLAGS_mr_map_output_merge_factor < 0) {
+    LOG(ERROR) << "mr_map_output_merge_factor must not be negative.";
+    flags_valid = false;
+  }
+
   // If input file format is unknown, set it to text.
   if (FLAGS_mr_input_format != "text" &&
+      FLAGS_mr_input_format != "mmap_text" &&
+      FLAGS_mr_input_format != "gzip_text" &&
+      FLAGS_mr_input_format != "bgzf_text" &&
       FLAGS_mr_input_format != "recordio" &&
-      FLAGS_mr_input_format != "protofile") {
+      FLAGS_mr_input_format != "protofile" &&
+      FLAGS_mr_input_format != "blockfile") {
     LOG(ERROR) << "Unknown input_format: " << FLAGS_mr_input_format;
     flags_valid = false;
   }
 
+  if (FLAGS_mr_split_size < 0) {
+    LOG(ERROR) << "mr_split_size must not be negative.";
+    flags_valid = false;
+  }
+  if (FLAGS_mr_num_split_readers <= 0 ||
+      FLAGS_mr_split_reader_id < 0 ||
+      FLAGS_mr_split_reader_id >= FLAGS_mr_num_split_readers) {
+    LOG(ERROR) << "mr_split_reader_id (" << FLAGS_mr_split_reader_id
+               << ") must be in range [0, mr_num_split_readers ("
+               << FLAGS_mr_num_split_readers << ")).";
+    flags_valid = false;
+  }
+
+  if (FLAGS_mr_input_pipeline_depth < 0) {
+    LOG(ERROR) << "mr_input_pipeline_depth must not be negative.";
+    flags_valid = false;
+  }
+  if (FLAGS_mr_multipass_map <= 0) {
+    LOG(ERROR) << "mr_multipass_map must be positive.";
+    flags_valid = false;
+  }
+  if (FLAGS_mr_input_cache_size < 0) {
+    LOG(ERROR) << "mr_input_cache_size must not be negative.";
+    flags_valid = false;
+  }
+  if (FLAGS_mr_num_codec_threads < 0) {
+    LOG(ERROR) << "mr_num_codec_threads must not be negative.";
+    flags_valid = false;
+  }
+  if (FLAGS_mr_top_k <= 0) {
+    LOG(ERROR) << "mr_top_k must be positive.";
+    flags_valid = false;
+  }
+  if (FLAGS_mr_periodic_flush_outputs < 0 ||
+      FLAGS_mr_periodic_flush_seconds < 0) {
+    LOG(ERROR) << "mr_periodic_flush_outputs and mr_periodic_flush_seconds "
+               << "must not be negative.";
+    flags_valid = false;
+  } else if ((FLAGS_mr_periodic_flush_outputs > 0 ||
+              FLAGS_mr_periodic_flush_seconds > 0) &&
+             FLAGS_mr_batch_reduction) {
+    LOG(ERROR) << "Periodic flush is valid only in incremental reduction "
+               << "mode.";
+    flags_valid = false;
+  }
+
   // If output file format is unknown, set it to text.
   if (FLAGS_mr_output_format != "text" &&
+      FLAGS_mr_output_format != "bgzf_text" &&
       FLAGS_mr_output_format != "recordio" &&
-      FLAGS_mr_output_format != "protofile") {
+      FLAGS_mr_output_format != "protofile" &&
+      FLAGS_mr_output_format != "blockfile") {
     LOG(ERROR) << "Unknown output_format: " << FLAGS_mr_output_format;
     flags_valid = false;
   }
@@ -356,10 +691,105 @@ const std::string& OutputFormat() {
   return FLAGS_mr_output_format;
 }
 
+bool CompressOutput() {
+  return FLAGS_mr_compress_output;
+}
+
+bool SkipCorruptedBlocks() {
+  return FLAGS_mr_skip_corrupted_blocks;
+}
+
 const std::vector<std::string>& ReduceWorkers() {
   return *GetReduceWorkers();
 }
 
+const std::vector<std::string>& MapWorkers() {
+  return *GetMapWorkers();
+}
+
+const std::vector<std::string>& AllReduceWorkers() {
+  return *GetAllReduceWorkers();
+}
+
+bool UseShuffleServer() {
+  return !MapWorkers().empty();
+}
+
+int NumParallelFetches() {
+  return FLAGS_mr_num_parallel_fetches;
+}
+
+int ShuffleTimeout() {
+  return FLAGS_mr_shuffle_timeout;
+}
+
+int NumReduceSubPartitions() {
+  return FLAGS_mr_num_reduce_sub_partitions;
+}
+
+int AsyncIOQueueDepth() {
+  return FLAGS_mr_async_io_queue_depth;
+}
+
+bool DirectIO() {
+  return FLAGS_mr_direct_io;
+}
+
+bool UseIOUring() {
+  return FLAGS_mr_io_uring;
+}
+
+const std::vector<std::string>& SpillDirectories() {
+  return *GetSpillDirectories();
+}
+
+int64 ReduceMergeMemory() {
+  // Converts MB to bytes.
+  return static_cast<int64>(FLAGS_mr_reduce_merge_memory) * 1024 * 1024;
+}
+
+int64 SplitSize() {
+  // Converts MB to bytes.
+  return static_cast<int64>(FLAGS_mr_split_size) * 1024 * 1024;
+}
+
+int NumSplitReaders() {
+  return FLAGS_mr_num_split_readers;
+}
+
+int SplitReaderId() {
+  return FLAGS_mr_split_reader_id;
+}
+
+int InputPipelineDepth() {
+  return FLAGS_mr_input_pipeline_depth;
+}
+
+int NumMapPasses() {
+  return FLAGS_mr_multipass_map;
+}
+
+int64 InputCacheSize() {
+  // Converts MB to bytes.
+  return static_cast<int64>(FLAGS_mr_input_cache_size) * 1024 * 1024;
+}
+
+int PeriodicFlushOutputs() {
+  return FLAGS_mr_periodic_flush_outputs;
+}
+
+int PeriodicFlushSeconds() {
+  return FLAGS_mr_periodic_flush_seconds;
+}
+
+int NumCodecThreads() {
+  return FLAGS_mr_num_codec_threads;
+}
+
+int TopK() {
+  return FLAGS_mr_top_k;
+}
+
 const std::string& InputFilepattern() {
   return FLAGS_mr_input_filepattern;
 }
@@ -368,14 +798,20 @@ const std::vector<std::string>& OutputFiles() {
   return *GetOutputFiles();
 }
 
-std::string MapOutputBufferFilebase(int reducer_id) {
+std::string MapOutputBufferFilebase(int reducer_id, int sub_partition) {
   // For map worker, to distinguish reduce input buffer files for different
   // reducer workers, mapper-id and reducer-id are appended to filebase.
   CHECK_LE(0, reducer_id);
   CHECK_GT(NumReduceWorkers(), reducer_id);
-  return StringPrintf("%s-mapper-%05d-reducer-%05d",
-                      FLAGS_mr_reduce_input_filebase.c_str(),
-                      MapWorkerId(), reducer_id);
+  CHECK_LE(0, sub_partition);
+  CHECK_GT(NumReduceSubPartitions(), sub_partition);
+  std::string filebase = StringPrintf("%s-mapper-%05d-reducer-%05d",
+                                      FLAGS_mr_reduce_input_filebase.c_str(),
+                                      MapWorkerId(), reducer_id);
+  if (NumReduceSubPartitions() > 1) {
+    StringAppendF(&filebase, "-sub-%05d", sub_partition);
+  }
+  return filebase;
 }
 
 std::string ReduceInputBufferFilebase() {
@@ -391,6 +827,10 @@ int NumReduceInputBufferFiles() {
   return FLAGS_mr_num_reduce_input_buffer_files;
 }
 
+int MapOutputMergeFactor() {
+  return FLAGS_mr_map_output_merge_factor;
+}
+
 int MapOutputBufferSize() {
   // The buffer holds the map output data and two uint32 values of key and
   // value size.
@@ -465,4 +905,15 @@ ReducerBase* CreateReducer() {
   return reducer;
 }
 
+BatchReducer* CreateCombiner() {
+  BatchReducer* combiner = NULL;
+  if (!FLAGS_mr_combiner_class.empty()) {
+    combiner = CREATE_BATCH_REDUCER(FLAGS_mr_combiner_class);
+    if (combiner == NULL) {
+      LOG(ERROR) << "Cannot create combiner: " << FLAGS_mr_combiner_class;
+    }
+  }
+  return combiner;
+}
+
 }  // namespace mapreduce_lite
@@ -35,6 +35,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
 //-----------------------------------------------------------------------------
 DECLARE_string(mr_mapper_class);
 DECLARE_string(mr_reducer_class);
+DECLARE_string(mr_combiner_class);
 DECLARE_string(mr_input_format);
 DECLARE_string(mr_output_format);
 DECLARE_bool(mr_batch_reduction);
@@ -63,16 +64,41 @@ int MessageQueueSize();
 int NumReduceInputBufferFiles();
 const std::string& InputFormat();
 const std::string& OutputFormat();
+bool CompressOutput();
+bool SkipCorruptedBlocks();
 const std::vector<std::string>& ReduceWorkers();
+const std::vector<std::string>& MapWorkers();
+const std::vector<std::string>& AllReduceWorkers();
+bool UseShuffleServer();
+int NumParallelFetches();
+int ShuffleTimeout();
+int NumReduceSubPartitions();
+int64 ReduceMergeMemory();
+const std::vector<std::string>& SpillDirectories();
+int AsyncIOQueueDepth();
+bool DirectIO();
+bool UseIOUring();
 const std::string& InputFilepattern();
+int64 SplitSize();
+int NumSplitReaders();
+int SplitReaderId();
+int InputPipelineDepth();
+int NumMapPasses();
+int64 InputCacheSize();
+int NumCodecThreads();
+int TopK();
+int PeriodicFlushOutputs();
+int PeriodicFlushSeconds();
 const std::vector<std::string>& OutputFiles();
-std::string MapOutputBufferFilebase(int reducer_id);
+std::string MapOutputBufferFilebase(int reducer_id, int sub_partition);
 std::string ReduceInputBufferFilebase();
 int ReduceInputBufferSize();
 int MapOutputBufferSize();
+int MapOutputMergeFactor();
 std::string LogFilebase();
 Mapper* CreateMapper();
 ReducerBase* CreateReducer();
+BatchReducer* CreateCombiner();
 
 }  // namespace mapreduce_lite
 
@@ -0,0 +1,169 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/mapreduce_lite/input_pipeline.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "src/base/stl-util.h"
+
+namespace mapreduce_lite {
+
+// The number of bytes at the beginning of the next split, which are
+// read ahead while reading the current split.
+static const int kReadAheadBytes = 4 * 1024 * 1024;       // 4 MB
+
+InputPipeline::InputPipeline(const std::string& input_format,
+                             bool read_splits,
+                             int max_batches)
+    : input_format_(input_format),
+      read_splits_(read_splits),
+      max_batches_(max_batches),
+      current_(NULL),
+      finished_(false),
+      stopping_(false) {
+  CHECK_LT(0, max_batches_);
+}
+
+InputPipeline::~InputPipeline() {
+  if (read_thread_.get() != NULL) {
+    {
+      MutexLocker locker(&mutex_);
+      stopping_ = true;
+      not_full_.Broadcast();
+    }
+    read_thread_->join();
+  }
+  delete current_;
+  STLDeleteElementsAndClear(&queue_);
+  STLDeleteElementsAndClear(&free_batches_);
+}
+
+void InputPipeline::Start(const std::vector<InputSplit>& splits) {
+  CHECK(read_thread_.get() == NULL);
+  splits_ = splits;
+  read_thread_.reset(new boost::thread(ReadLoop, this));
+}
+
+const InputBatch* InputPipeline::NextBatch() {
+  MutexLocker locker(&mutex_);
+  if (current_ != NULL) {
+    free_batches_.push_back(current_);
+    current_ = NULL;
+  }
+  while (queue_.empty() && !finished_) {
+    not_empty_.Wait(&mutex_);
+  }
+  if (queue_.empty()) {
+    return NULL;
+  }
+  current_ = queue_.front();
+  queue_.pop_front();
+  not_full_.Signal();
+  return current_;
+}
+
+void InputPipeline::ReadLoop(InputPipeline* pipeline) {
+  for (int i = 0; i < pipeline->splits_.size(); ++i) {
+    if (i + 1 < pipeline->splits_.size()) {
+      ReadAhead(pipeline->splits_[i + 1]);
+    }
+    if (!pipeline->ReadSplit(i)) {
+      return;
+    }
+  }
+  MutexLocker locker(&pipeline->mutex_);
+  pipeline->finished_ = true;
+  pipeline->not_empty_.Broadcast();
+}
+
+bool InputPipeline::ReadSplit(int split_index) {
+  const InputSplit& split = splits_[split_index];
+  scoped_ptr<Reader> reader(CREATE_READER(input_format_));
+  if (reader.get() == NULL) {
+    LOG(FATAL) << "Creating reader for: " << split.filename;
+  }
+  if (read_splits_) {
+    reader->OpenSplit(split.filename, split.begin, split.end);
+  } else {
+    reader->Open(split.filename);
+  }
+
+  InputBatch* batch = NewBatch(split_index);
+  while (reader->ReadBatch(&batch->records,
+                           kMaxInputBatchRecords,
+                           kMaxInputBatchBytes)) {
+    if (!Push(batch)) {
+      return false;
+    }
+    batch = NewBatch(split_index);
+  }
+  // Push the last batch even if it is empty, so that the map thread
+  // knows every split.
+  return Push(batch);
+}
+
+bool InputPipeline::Push(InputBatch* batch) {
+  MutexLocker locker(&mutex_);
+  while (queue_.size() >= max_batches_ && !stopping_) {
+    not_full_.Wait(&mutex_);
+  }
+  if (stopping_) {
+    delete batch;
+    return false;
+  }
+  queue_.push_back(batch);
+  not_empty_.Signal();
+  return true;
+}
+
+InputBatch* InputPipeline::NewBatch(int split_index) {
+  InputBatch* batch = NULL;
+  {
+    MutexLocker locker(&mutex_);
+    if (!free_batches_.empty()) {
+      batch = free_batches_.back();
+      free_batches_.pop_back();
+    }
+  }
+  if (batch == NULL) {
+    batch = new InputBatch;
+  }
+  batch->split_index = split_index;
+  batch->records.Clear();
+  return batch;
+}
+
+void InputPipeline::ReadAhead(const InputSplit& split) {
+  int fd = open(split.filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;  // The reader will report the error.
+  }
+  // WILLNEED initiates reading without blocking.  The page cache is
+  // kept after closing fd.
+  posix_fadvise(fd, split.begin,
+                std::min<int64>(split.end - split.begin, kReadAheadBytes),
+                POSIX_FADV_WILLNEED);
+  close(fd);
+}
+
+}  // namespace mapreduce_lite
@@ -0,0 +1,117 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+// InputPipeline reads input splits in a background thread, so that a
+// map worker maps records while the next ones are being read.  The
+// reader thread fills a bounded queue of record batches, which the
+// map thread consumes by NextBatch().  Before reading a split, the
+// reader thread advises the kernel to read ahead the beginning of the
+// next split, so mapping many small files does not pay the open and
+// first-read latency of each file serially.
+//
+// Records are read by Reader::ReadBatch().  Lazy keys of text lines
+// are kept as offsets in batches, and built by the map thread only if
+// the mapper asks for them (see RecordBatch).
+//
+#ifndef MAPREDUCE_LITE_INPUT_PIPELINE_H_
+#define MAPREDUCE_LITE_INPUT_PIPELINE_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "boost/thread.hpp"
+
+#include "src/base/common.h"
+#include "src/base/scoped_ptr.h"
+#include "src/mapreduce_lite/reader.h"
+#include "src/mapreduce_lite/record_batch.h"
+#include "src/system/condition_variable.h"
+#include "src/system/mutex.h"
+
+namespace mapreduce_lite {
+
+// A batch of map inputs is full if it has this number of records, or
+// this number of bytes.
+const int kMaxInputBatchRecords = 1024;
+const int kMaxInputBatchBytes = 1024 * 1024;          // 1 MB
+
+// Records read from one split.  Each split results in one or more
+// batches; the batch of an empty split has no record.
+struct InputBatch {
+  int split_index;                  // The index in the splits to read.
+  RecordBatch records;
+
+  InputBatch() : split_index(-1) {}
+};
+
+class InputPipeline {
+ public:
+  // Read at most max_batches batches ahead of the map thread.  If
+  // read_splits is false, each split is read as a whole file.
+  InputPipeline(const std::string& input_format,
+                bool read_splits,
+                int max_batches);
+  ~InputPipeline();  // Stops the reader thread if it is running.
+
+  // Start reading splits in the background.  Invoke only once.
+  void Start(const std::vector<InputSplit>& splits);
+
+  // Blocks until a batch is read, or returns NULL if all splits were
+  // read.  The returned batch is valid until the next invocation.
+  const InputBatch* NextBatch();
+
+ private:
+  static void ReadLoop(InputPipeline* pipeline);
+
+  // Read a split into batches.  Returns false if the pipeline is
+  // stopping.
+  bool ReadSplit(int split_index);
+
+  // Blocks while the queue is full.  Returns false if the pipeline is
+  // stopping.
+  bool Push(InputBatch* batch);
+
+  // Returns a free batch for split_index.
+  InputBatch* NewBatch(int split_index);
+
+  // Advise the kernel to start reading the beginning of split.
+  static void ReadAhead(const InputSplit& split);
+
+  std::string input_format_;
+  bool read_splits_;
+  int max_batches_;
+  std::vector<InputSplit> splits_;
+  InputBatch* current_;              // Returned by NextBatch().
+
+  Mutex mutex_;                      // Protects the following four.
+  ConditionVariable not_full_;       // Signaled by NextBatch().
+  ConditionVariable not_empty_;      // Signaled by Push() and ReadLoop().
+  std::deque<InputBatch*> queue_;
+  std::vector<InputBatch*> free_batches_;
+  bool finished_;                    // All splits were read.
+  bool stopping_;                    // Set by the destructor.
+  scoped_ptr<boost::thread> read_thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(InputPipeline);
+};
+
+}  // namespace mapreduce_lite
+
+#endif  // MAPREDUCE_LITE_INPUT_PIPELINE_H_
@@ -0,0 +1,116 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/mapreduce_lite/input_pipeline.h"
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "src/strutil/stringprintf.h"
+
+using mapreduce_lite::InputBatch;
+using mapreduce_lite::InputPipeline;
+using mapreduce_lite::InputSplit;
+using mapreduce_lite::ListInputSplits;
+
+namespace {
+
+const int kNumFiles = 3;
+const int kNumLines[kNumFiles] = { 3000, 0, 5 };  // The second is empty.
+
+void WriteInputFiles(std::vector<std::string>* filenames) {
+  for (int i = 0; i < kNumFiles; ++i) {
+    filenames->push_back(StringPrintf("/tmp/input_pipeline_test-%d", i));
+    FILE* file = fopen(filenames->back().c_str(), "w");
+    for (int j = 0; j < kNumLines[i]; ++j) {
+      fprintf(file, "%d-%d\n", i, j);
+    }
+    fclose(file);
+  }
+}
+
+// Read all files using a pipeline, and check that each line is read
+// once and in order.
+void ReadAndCheck(const char* input_format, int max_batches) {
+  std::vector<std::string> filenames;
+  WriteInputFiles(&filenames);
+  std::vector<InputSplit> splits;
+  ListInputSplits(filenames, 0, &splits);
+  splits.push_back(splits[0]);   // An empty split of the empty file.
+  splits.back().filename = filenames[1];
+  splits.back().end = 0;
+
+  InputPipeline pipeline(input_format, true, max_batches);
+  pipeline.Start(splits);
+  std::vector<std::vector<std::string> > values(splits.size());
+  int last_split = -1;
+  const InputBatch* batch;
+  while ((batch = pipeline.NextBatch()) != NULL) {
+    EXPECT_LE(last_split, batch->split_index);
+    last_split = batch->split_index;
+    const mapreduce_lite::RecordBatch& records = batch->records;
+    for (int i = 0; i < records.Size(); ++i) {
+      values[batch->split_index].push_back(records.Value(i));
+      // Either the key or the lazy key is built by the reader.
+      EXPECT_NE(records.KeySize(i) == 0, records.LazyKey(i).empty());
+    }
+  }
+  EXPECT_EQ(splits.size() - 1, last_split);  // Every split has a batch.
+
+  ASSERT_EQ(kNumLines[0], values[0].size());
+  ASSERT_EQ(kNumLines[2], values[1].size());
+  EXPECT_EQ(0, values[2].size());
+  for (int j = 0; j < kNumLines[0]; ++j) {
+    EXPECT_EQ(StringPrintf("0-%d", j), values[0][j]);
+  }
+  for (int i = 0; i < kNumFiles; ++i) {
+    remove(filenames[i].c_str());
+  }
+}
+
+}  // namespace
+
+TEST(InputPipelineTest, ReadText) {
+  ReadAndCheck("text", 1);
+  ReadAndCheck("text", 8);
+}
+
+TEST(InputPipelineTest, ReadMmapText) {
+  ReadAndCheck("mmap_text", 1);
+  ReadAndCheck("mmap_text", 8);
+}
+
+TEST(InputPipelineTest, StopBeforeReadingAll) {
+  std::vector<std::string> filenames;
+  WriteInputFiles(&filenames);
+  std::vector<InputSplit> splits;
+  ListInputSplits(filenames, 0, &splits);
+  {
+    InputPipeline pipeline("text", false, 1);
+    pipeline.Start(splits);
+    ASSERT_TRUE(pipeline.NextBatch() != NULL);
+    // The destructor stops the reader thread blocked on a full queue.
+  }
+  for (int i = 0; i < kNumFiles; ++i) {
+    remove(filenames[i].c_str());
+  }
+}
@@ -20,28 +20,39 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
 #include "src/mapreduce_lite/mapreduce_lite.h"
 
 #include <stdio.h>
+#include <time.h>
 
+#include <algorithm>
 #include <map>
 #include <new>
 #include <set>
 #include <string>
 #include <vector>
 
+#include "boost/bind.hpp"
 #include "boost/filesystem.hpp"
+#include "boost/thread.hpp"
 
 #include "src/base/common.h"
 #include "src/base/scoped_ptr.h"
 #include "src/base/stl-util.h"
 #include "gflags/gflags.h"
 #include "src/hash/simple_hash.h"
+#include "src/mapreduce_lite/aggregators.h"
+#include "src/mapreduce_lite/allreduce.h"
 #include "src/mapreduce_lite/socket_communicator.h"
 #include "src/mapreduce_lite/flags.h"
-#include "src/mapreduce_lite/protofile.h"
+#include "src/mapreduce_lite/input_pipeline.h"
 #include "src/mapreduce_lite/reader.h"
+#include "src/mapreduce_lite/shuffle.h"
+#include "src/mapreduce_lite/signaling_queue.h"
+#include "src/mapreduce_lite/writer.h"
 #include "google/protobuf/message.h"
 #include "src/sorted_buffer/sorted_buffer.h"
 #include "src/sorted_buffer/sorted_buffer.cc"
+#include "src/sorted_buffer/sorted_file_merger.h"
 #include "src/strutil/join_strings.h"
+#include "src/strutil/strcodec.h"
 #include "src/strutil/stringprintf.h"
 #include "src/system/filepattern.h"
 
@@ -53,11 +64,27 @@ CLASS_REGISTER_IMPLEMENT_REGISTRY(mapreduce_lite_incremental_reducer_registry,
 CLASS_REGISTER_IMPLEMENT_REGISTRY(mapreduce_lite_batch_reducer_registry,
                                   mapreduce_lite::BatchReducer);
 
+// Built-in aggregators (see aggregators.h).
+REGISTER_AGGREGATOR(Int64Sum, mapreduce_lite::Int64SumAggregator);
+REGISTER_AGGREGATOR(DoubleSum, mapreduce_lite::DoubleSumAggregator);
+REGISTER_AGGREGATOR(Int64Min, mapreduce_lite::Int64MinAggregator);
+REGISTER_AGGREGATOR(DoubleMin, mapreduce_lite::DoubleMinAggregator);
+REGISTER_AGGREGATOR(Int64Max, mapreduce_lite::Int64MaxAggregator);
+REGISTER_AGGREGATOR(DoubleMax, mapreduce_lite::DoubleMaxAggregator);
+REGISTER_AGGREGATOR(Count, mapreduce_lite::CountAggregator);
+REGISTER_AGGREGATOR(TopK, mapreduce_lite::TopKAggregator);
+REGISTER_AGGREGATOR(HyperLogLog, mapreduce_lite::HyperLogLogAggregator);
+REGISTER_AGGREGATOR(DistinctCount, mapreduce_lite::DistinctCountAggregator);
+REGISTER_AGGREGATOR(FloatVectorSum, mapreduce_lite::FloatVectorSumAggregator);
+REGISTER_AGGREGATOR(DoubleVectorSum,
+                    mapreduce_lite::DoubleVectorSumAggregator);
+
 
 namespace mapreduce_lite {
 
 using sorted_buffer::SortedBuffer;
 using sorted_buffer::SortedBufferIteratorImpl;
+using sorted_buffer::SortedFileMerger;
 using std::map;
 using std::string;
 using std::vector;
@@ -81,9 +108,10 @@ scoped_ptr<Communicator>& GetCommunicator() {
   return communicator;
 }
 
-scoped_ptr<vector<FILE*> >& GetOutputFileDescriptors() {
-  static scoped_ptr<vector<FILE*> > output_files(new vector<FILE*>);
-  return output_files;
+// Each output file has a writer of the output format.
+scoped_ptr<vector<Writer*> >& GetWriters() {
+  static scoped_ptr<vector<Writer*> > writers(new vector<Writer*>);
+  return writers;
 }
 
 scoped_ptr<string>& GetCurrentInputFilename() {
@@ -107,11 +135,110 @@ scoped_ptr<vector<SortedBuffer*> >& GetReduceInputBuffers() {
   return reduce_input_buffers;
 }
 
+scoped_ptr<vector<sorted_buffer::Combiner*> >& GetMapOutputCombiners() {
+  static scoped_ptr<vector<sorted_buffer::Combiner*> > combiners(
+      new vector<sorted_buffer::Combiner*>);
+  return combiners;
+}
+
+scoped_ptr<ShuffleServer>& GetShuffleServer() {
+  static scoped_ptr<ShuffleServer> shuffle_server;
+  return shuffle_server;
+}
+
+// Map workers connect to each other if --mr_allreduce_workers is set.
+scoped_ptr<AllReduceGroup>& GetAllReduceGroup() {
+  static scoped_ptr<AllReduceGroup> allreduce_group;
+  return allreduce_group;
+}
+
+//-----------------------------------------------------------------------------
+// Adapts a BatchReducer to a combiner of reduce input buffers.
+//-----------------------------------------------------------------------------
+class BatchReducerCombiner : public sorted_buffer::Combiner {
+ public:
+  // Takes the ownership of reducer.
+  explicit BatchReducerCombiner(BatchReducer* reducer)
+      : reducer_(reducer), key_(NULL), combined_(NULL) {
+    reducer_->combiner_ = this;
+    reducer_->Start();
+  }
+
+  virtual ~BatchReducerCombiner() {
+    reducer_->Flush();
+  }
+
+  virtual void Combine(const string& key,
+                       ReduceInputIterator* values,
+                       vector<string>* combined) {
+    key_ = &key;
+    combined_ = combined;
+    reducer_->Reduce(key, values);
+    key_ = NULL;
+    combined_ = NULL;
+  }
+
+  void Append(const string& key, const string& value) {
+    if (combined_ == NULL) {
+      LOG(FATAL) << "Combiner must output in Reduce().";
+    }
+    if (key != *key_) {
+      LOG(FATAL) << "Combiner must not change the key: " << *key_
+                 << " to: " << key;
+    }
+    combined_->push_back(value);
+  }
+
+ private:
+  scoped_ptr<BatchReducer> reducer_;
+  const string* key_;         // Key being combined.
+  vector<string>* combined_;  // Values of key_ after combining.
+};
+
+// Each file merged by a reduce worker is read through a buffer of this
+// size.  Together with mr_reduce_merge_memory, this determines the
+// number of files merged at a time.
+const int kReduceMergeReadBufferSize = 1024 * 1024;  // 1 MB
+
+// The block size of async I/O of reduce input buffer files.
+const int kAsyncIOBlockSize = 256 * 1024;  // 256 KB
+
 // Mapper::Output and Mapper::OutputToShard will increase
 // this counter once per invocation.  Mapper::OutputToAllShards
 // increases this counter by the number of reduce workers.
 int g_count_map_output = 0;
 
+// The default Mapper::MapBatch sets these to the record being mapped,
+// so Mapper::LazyInputKey can find its lazy key.
+const RecordBatch* g_map_input_batch = NULL;
+int g_map_input_index = -1;
+
+// The zero-based pass of multi-pass map (see --mr_multipass_map).
+int g_current_pass = 0;
+
+// The output file of channel, written by reducers of sub_partition.
+string OutputFilename(int channel, int sub_partition) {
+  if (NumReduceSubPartitions() == 1) {
+    return OutputFiles()[channel];
+  }
+  return StringPrintf("%s-%05d-of-%05d", OutputFiles()[channel].c_str(),
+                      sub_partition, NumReduceSubPartitions());
+}
+
+// The reduce input sub-partition of key.  The hash value is divided
+// by the number of reduce workers, so that keys sent to a reduce
+// worker by Mapper::Shard spread over sub-partitions.
+int SubPartition(const string& key) {
+  return JSHash(key) / NumReduceWorkers() % NumReduceSubPartitions();
+}
+
+// Map outputs to reduce_worker_id are kept in the reduce input
+// buffer of the sub-partition of key.
+SortedBuffer* ReduceInputBuffer(int reduce_worker_id, const string& key) {
+  return (*GetReduceInputBuffers())[
+      reduce_worker_id * NumReduceSubPartitions() + SubPartition(key)];
+}
+
 //-----------------------------------------------------------------------------
 // Initialiation and finalization of MapReduce Lite:
 //-----------------------------------------------------------------------------
@@ -143,6 +270,15 @@ bool Initialize() {
     }
   }
 
+  // Connect map workers to each other for Mapper::AllReduce().
+  if (IAmMapWorker() && !AllReduceWorkers().empty()) {
+    GetAllReduceGroup().reset(new AllReduceGroup);
+    if (!GetAllReduceGroup()->Initialize(AllReduceWorkers(), MapWorkerId())) {
+      LOG(ERROR) << "Cannot connect to other map workers for all-reduce.";
+      return false;
+    }
+  }
+
   // Create mapper instance.
   if (IAmMapWorker()) {
     GetMapper().reset(CreateMapper());
@@ -159,15 +295,20 @@ bool Initialize() {
     }
   }
 
-  // Open output files.
+  // Open output files, for each reduce input sub-partition.
   if (IAmReduceWorker() || IAmMapOnlyWorker()) {
-    for (int i = 0; i < OutputFiles().size(); ++i) {
-      FILE* file = fopen(OutputFiles()[i].c_str(), "w+");
-      if (file == NULL) {
-        LOG(ERROR) << "Cannot open output file: " << OutputFiles()[i];
-        return false;
+    for (int s = 0; s < NumReduceSubPartitions(); ++s) {
+      for (int i = 0; i < OutputFiles().size(); ++i) {
+        Writer* writer = CREATE_WRITER(OutputFormat());
+        if (writer == NULL) {
+          LOG(ERROR) << "Cannot create writer of format: " << OutputFormat();
+          return false;
+        }
+        GetWriters()->push_back(writer);
+        if (!writer->Open(OutputFilename(i, s))) {
+          return false;
+        }
       }
-      GetOutputFileDescriptors()->push_back(file);
     }
   }
 
@@ -193,20 +334,69 @@ bool Initialize() {
     }
   }
 
-  // Create reduce input buffer files for map worker, if in batch mode
+  // Read and write reduce input buffer files by async I/O, if enabled
+  if (FLAGS_mr_batch_reduction && AsyncIOQueueDepth() > 0) {
+    AsyncFileOptions options;
+    options.block_size = kAsyncIOBlockSize;
+    options.queue_depth = AsyncIOQueueDepth();
+    options.direct = DirectIO();
+    options.io_uring = UseIOUring();
+    SortedBuffer::EnableAsyncIO(options);
+  }
+
+  // Create reduce input buffer files for map worker, if in batch mode.
+  // Each reduce worker has a buffer per sub-partition, which share
+  // mr_reduce_input_buffer_size.  The buffer of sub-partition s of
+  // reduce worker r is the (r * NumReduceSubPartitions() + s)-th.
   if (IAmMapWorker() && FLAGS_mr_batch_reduction) {
-    GetReduceInputBuffers()->resize(NumReduceWorkers());
+    int num_sub_partitions = NumReduceSubPartitions();
+    GetReduceInputBuffers()->resize(NumReduceWorkers() * num_sub_partitions);
     try {
-      for (int i = 0; i < NumReduceWorkers(); ++i) {
+      for (int i = 0; i < GetReduceInputBuffers()->size(); ++i) {
+        string filebase = MapOutputBufferFilebase(i / num_sub_partitions,
+                                                  i % num_sub_partitions);
         (*GetReduceInputBuffers())[i] = new SortedBuffer(
-            MapOutputBufferFilebase(i), ReduceInputBufferSize());
+            filebase, ReduceInputBufferSize() / num_sub_partitions);
+        (*GetReduceInputBuffers())[i]->SetSpillDirectories(
+            SpillDirectories());
         LOG(INFO) << "create map output buffer"
                   << i
-                  << MapOutputBufferFilebase(i);
+                  << filebase;
       }
     } catch(const std::bad_alloc&) {
       LOG(FATAL) << "Insufficient memory for creating reduce input buffer.";
     }
+
+    if (UseShuffleServer()) {
+      // Serve reduce input buffer files to reduce workers as soon as
+      // they are dumped.  Reduce workers merge them.
+      GetShuffleServer().reset(new ShuffleServer);
+      // Each sub-partition is served as if to a reduce worker.
+      if (!GetShuffleServer()->Start(MapWorkers()[MapWorkerId()],
+                                     GetReduceInputBuffers()->size())) {
+        return false;
+      }
+      for (int i = 0; i < GetReduceInputBuffers()->size(); ++i) {
+        (*GetReduceInputBuffers())[i]->SetFlushCallback(
+            boost::bind(&ShuffleServer::Publish, GetShuffleServer().get(),
+                        i, _1));
+      }
+    } else {
+      // Each buffer has its own combiner, as buffers merge in parallel.
+      for (int i = 0; i < GetReduceInputBuffers()->size(); ++i) {
+        BatchReducerCombiner* combiner = NULL;
+        if (!FLAGS_mr_combiner_class.empty()) {
+          BatchReducer* reducer = CreateCombiner();
+          if (reducer == NULL) {
+            return false;
+          }
+          combiner = new BatchReducerCombiner(reducer);
+          GetMapOutputCombiners()->push_back(combiner);
+        }
+        (*GetReduceInputBuffers())[i]->EnableBackgroundMerge(
+            MapOutputMergeFactor(), combiner);
+      }
+    }
   }
 
   return true;
@@ -221,6 +411,17 @@ void Finalize() {
   if (!FLAGS_mr_batch_reduction) {
     GetCommunicator()->Finalize();
   }
+  GetAllReduceGroup().reset(NULL);
+
+  // Write the rest of outputs.
+  for (int i = 0; i < GetWriters()->size(); ++i) {
+    if (!(*GetWriters())[i]->Close()) {
+      LOG(FATAL) << "Failed writing output file: "
+                 << OutputFilename(i % OutputFiles().size(),
+                                   i / OutputFiles().size());
+    }
+  }
+  STLDeleteElementsAndClear(GetWriters().get());
 
   LOG(INFO) << "MapReduce Lite job finalized.";
 }
@@ -230,19 +431,12 @@ void Finalize() {
 //
 // Used by Mapper::Output* in map-only mode and ReducerBase::Output*.
 //-----------------------------------------------------------------------------
-void WriteText(FILE* output_stream, const string& key, const string& value) {
-  fprintf(output_stream, "%s\n", value.c_str());
-}
-
-void ReduceOutput(int channel, const string& key, const string& value) {
+void ReduceOutput(int sub_partition, int channel,
+                  const string& key, const string& value) {
   CHECK_LE(0, channel);
-  CHECK_LT(channel, GetOutputFileDescriptors()->size());
-
-  if (OutputFormat() == "text") {
-    WriteText((*GetOutputFileDescriptors())[channel], key, value);
-  } else if (OutputFormat() == "protofile") {
-    protofile::WriteRecord((*GetOutputFileDescriptors())[channel], key, value);
-  }
+  CHECK_LT(channel, OutputFiles().size());
+  (*GetWriters())[sub_partition * OutputFiles().size() + channel]->Write(
+      key, value);
 }
 
 //-----------------------------------------------------------------------------
@@ -287,12 +481,12 @@ void MapOutput(int reduce_worker_id, const string& key, const string& value) {
     }
   } else {
     if (reduce_worker_id >= 0) {
-      (*GetReduceInputBuffers())[reduce_worker_id]->Insert(
+      ReduceInputBuffer(reduce_worker_id, key)->Insert(
           string(data, *key_size),
           string(data + *key_size, *value_size));
     } else {
       for (int r_id = 0; r_id < NumReduceWorkers(); ++r_id) {
-        (*GetReduceInputBuffers())[r_id]->Insert(
+        ReduceInputBuffer(r_id, key)->Insert(
             string(data, *key_size),
             string(data + *key_size, *value_size));
       }
@@ -304,12 +498,32 @@ void MapOutput(int reduce_worker_id, const string& key, const string& value) {
 // Implementation of ReducerBase:
 //-----------------------------------------------------------------------------
 void ReducerBase::Output(const string& key, const string& value) {
-  ReduceOutput(0, key, value);
+  if (combiner_ != NULL) {
+    combiner_->Append(key, value);
+  } else {
+    ReduceOutput(sub_partition_, 0, key, value);
+  }
 }
 
 void ReducerBase::OutputToChannel(int channel,
                                   const string& key, const string& value) {
-  ReduceOutput(channel, key, value);
+  if (combiner_ != NULL) {
+    combiner_->Append(key, value);
+  } else {
+    ReduceOutput(sub_partition_, channel, key, value);
+  }
+}
+
+void ReducerBase::Output(const string& key, int64 value) {
+  Output(key, EncodeInt64(value));
+}
+
+void ReducerBase::Output(const string& key, double value) {
+  Output(key, EncodeDouble(value));
+}
+
+void ReducerBase::Output(const string& key, const char* value, size_t size) {
+  Output(key, string(value, size));
 }
 
 const string& ReducerBase::GetOutputFormat() const {
@@ -317,7 +531,15 @@ const string& ReducerBase::GetOutputFormat() const {
 }
 
 int ReducerBase::NumOutputChannels() const {
-  return GetOutputFileDescriptors()->size();
+  return GetWriters()->size() / NumReduceSubPartitions();
+}
+
+ReducerBase* CreateSubPartitionReducer(int sub_partition) {
+  ReducerBase* reducer = CreateReducer();
+  if (reducer != NULL) {
+    reducer->sub_partition_ = sub_partition;
+  }
+  return reducer;
 }
 
 //-----------------------------------------------------------------------------
@@ -329,13 +551,28 @@ int Mapper::Shard(const string& key, int num_reduce_workers) {
 
 void Mapper::Output(const string& key, const string& value) {
   if (IAmMapOnlyWorker()) {
-    ReduceOutput(0, key, value);
+    ReduceOutput(0, 0, key, value);
   } else {
     MapOutput(Shard(key, NumReduceWorkers()), key, value);
   }
   ++g_count_map_output;
 }
 
+// The typed outputs invoke the virtual Output(), so that mappers
+// overriding it see all outputs.  Encoded values fit in the small
+// string buffer of std::string, which costs no memory allocation.
+void Mapper::Output(const string& key, int64 value) {
+  Output(key, EncodeInt64(value));
+}
+
+void Mapper::Output(const string& key, double value) {
+  Output(key, EncodeDouble(value));
+}
+
+void Mapper::Output(const string& key, const char* value, size_t size) {
+  Output(key, string(value, size));
+}
+
 void Mapper::OutputToShard(int reduce_shard,
                            const string& key, const string& value) {
   if (IAmMapOnlyWorker()) {
@@ -355,10 +592,68 @@ void Mapper::OutputToAllShards(const string& key, const string& value) {
   g_count_map_output += NumReduceWorkers();
 }
 
+void Mapper::EmitToShard(int reduce_shard,
+                         const string& key, const string& value) {
+  if (IAmMapOnlyWorker()) {
+    ReduceOutput(0, 0, key, value);
+  } else {
+    MapOutput(reduce_shard, key, value);
+  }
+  ++g_count_map_output;
+}
+
+void Mapper::AllReduce(float* data, int size) {
+  if (GetAllReduceGroup().get() == NULL) {
+    LOG(FATAL) << "Mapper::AllReduce requires --mr_allreduce_workers.";
+  }
+  if (!GetAllReduceGroup()->AllReduce(data, size)) {
+    LOG(FATAL) << "All-reduce failed.";
+  }
+}
+
+void Mapper::AllReduce(double* data, int size) {
+  if (GetAllReduceGroup().get() == NULL) {
+    LOG(FATAL) << "Mapper::AllReduce requires --mr_allreduce_workers.";
+  }
+  if (!GetAllReduceGroup()->AllReduce(data, size)) {
+    LOG(FATAL) << "All-reduce failed.";
+  }
+}
+
+void Mapper::Broadcast(string* data) {
+  if (GetAllReduceGroup().get() == NULL) {
+    LOG(FATAL) << "Mapper::Broadcast requires --mr_allreduce_workers.";
+  }
+  if (!GetAllReduceGroup()->Broadcast(data)) {
+    LOG(FATAL) << "Broadcast failed.";
+  }
+}
+
 const string& Mapper::CurrentInputFilename() const {
   return *GetCurrentInputFilename();
 }
 
+string Mapper::LazyInputKey() const {
+  CHECK(g_map_input_batch != NULL);
+  return g_map_input_batch->LazyKey(g_map_input_index);
+}
+
+void Mapper::Map(const string& key, const string& value) {
+  LOG(FATAL) << "A mapper must override either Map() or MapBatch().";
+}
+
+void Mapper::MapBatch(const RecordBatch& batch) {
+  string key, value;
+  g_map_input_batch = &batch;
+  for (int i = 0; i < batch.Size(); ++i) {
+    key.assign(batch.KeyData(i), batch.KeySize(i));
+    value.assign(batch.ValueData(i), batch.ValueSize(i));
+    g_map_input_index = i;
+    Map(key, value);
+  }
+  g_map_input_batch = NULL;
+}
+
 const string& Mapper::GetInputFormat() const {
   return InputFormat();
 }
@@ -379,9 +674,217 @@ bool Mapper::IsMapOnly() const {
   return IAmMapOnlyWorker();
 }
 
+int Mapper::GetCurrentPass() const {
+  return g_current_pass;
+}
+
+int Mapper::GetNumPasses() const {
+  return NumMapPasses();
+}
+
 //-----------------------------------------------------------------------------
 // Implementation of map worker:
 //-----------------------------------------------------------------------------
+
+// Merge buffer files of each reduce worker into one, so fewer and
+// smaller files are shipped.  Buffers are merged in parallel.
+void MergeReduceInputBuffers() {
+  const vector<SortedBuffer*>& buffers = *GetReduceInputBuffers();
+  int max_threads = std::max(1U, boost::thread::hardware_concurrency());
+  for (int begin = 0; begin < buffers.size(); begin += max_threads) {
+    boost::thread_group threads;
+    for (int i = begin; i < buffers.size() && i < begin + max_threads; ++i) {
+      threads.create_thread(boost::bind(&SortedBuffer::MergeFiles,
+                                        buffers[i]));
+    }
+    threads.join_all();
+  }
+  LOG(INFO) << "Merged reduce input buffer files.";
+}
+
+// Flush buffers, whose files have been published to the shuffle
+// server by Flush(), serve reduce workers until they have fetched all
+// files, then remove the files.
+void ServeReduceInputBuffers() {
+  vector<string> filenames;
+  for (int r = 0; r < GetReduceInputBuffers()->size(); ++r) {
+    SortedBuffer* buffer = (*GetReduceInputBuffers())[r];
+    buffer->Flush();
+    vector<string> buffer_files = buffer->Filenames();
+    filenames.insert(filenames.end(), buffer_files.begin(), buffer_files.end());
+  }
+  GetShuffleServer()->Finish();
+
+  LOG(INFO) << "Serving " << filenames.size() << " reduce input buffer files.";
+  if (!GetShuffleServer()->WaitForReduceWorkers(ShuffleTimeout())) {
+    LOG(FATAL) << "Reduce workers failed fetching reduce input buffer files.";
+  }
+  GetShuffleServer().reset(NULL);
+
+  for (int i = 0; i < filenames.size(); ++i) {
+    boost::filesystem::remove(filenames[i]);
+  }
+}
+
+void MapRecordBatch(const RecordBatch& batch, int* count_map_input) {
+  GetMapper()->MapBatch(batch);
+  int count_before = *count_map_input;
+  *count_map_input += batch.Size();
+  if (*count_map_input / 1000 != count_before / 1000) {
+    LOG(INFO) << "Processed " << *count_map_input << " records.";
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Input records kept by the first pass of multi-pass map for later
+// passes.  Each batch is a copy of a RecordBatch, whose records are
+// packed in one buffer.  If records exceed the budget, the cache gives
+// up and later passes read input files.
+//-----------------------------------------------------------------------------
+class InputCache {
+ public:
+  explicit InputCache(int64 max_bytes)
+      : max_bytes_(max_bytes), bytes_(0), overflowed_(false) {}
+  ~InputCache() { STLDeleteElementsAndClear(&batches_); }
+
+  void Add(int split_index, const RecordBatch& records) {
+    if (overflowed_) {
+      return;
+    }
+    // Each record has three int offsets and an int64 offset besides
+    // the buffer.
+    bytes_ += records.ByteSize() +
+        records.Size() * (3 * sizeof(int) + sizeof(int64));
+    if (bytes_ > max_bytes_) {
+      LOG(INFO) << "Map inputs exceed mr_input_cache_size; each pass will "
+                << "read input files.";
+      overflowed_ = true;
+      STLDeleteElementsAndClear(&batches_);
+      return;
+    }
+    InputBatch* batch = new InputBatch;
+    batch->split_index = split_index;
+    batch->records.CopyFrom(records);
+    batches_.push_back(batch);
+  }
+
+  // Returns false if some records were not kept.
+  bool Complete() const { return !overflowed_; }
+
+  const vector<InputBatch*>& batches() const { return batches_; }
+
+ private:
+  int64 max_bytes_;
+  int64 bytes_;
+  bool overflowed_;
+  vector<InputBatch*> batches_;
+
+  DISALLOW_COPY_AND_ASSIGN(InputCache);
+};
+
+// Map records read by the same thread.  Records are also added to
+// cache unless it is NULL.
+void MapInputSplits(const vector<InputSplit>& splits, bool read_splits,
+                    InputCache* cache,
+                    int* count_map_input, int* count_input_shards) {
+  RecordBatch batch;
+  for (int i_split = 0; i_split < splits.size(); ++i_split) {
+    const InputSplit& split = splits[i_split];
+    *GetCurrentInputFilename() = split.filename;
+    LOG(INFO) << "Mapping input file: " << *GetCurrentInputFilename()
+              << " [" << split.begin << ", " << split.end << ")";
+
+    scoped_ptr<Reader> reader(CREATE_READER(InputFormat()));
+    if (read_splits) {
+      reader->OpenSplit(split.filename, split.begin, split.end);
+    } else {
+      reader->Open(split.filename);
+    }
+
+    GetMapper()->Start();
+
+    bool more = true;
+    while (more) {
+      batch.Clear();
+      more = reader->ReadBatch(&batch,
+                               kMaxInputBatchRecords, kMaxInputBatchBytes);
+      if (cache != NULL) {
+        cache->Add(i_split, batch);
+      }
+      MapRecordBatch(batch, count_map_input);
+    }
+
+    GetMapper()->Flush();
+    ++*count_input_shards;
+    LOG(INFO) << "Finished mapping file: " << *GetCurrentInputFilename();
+  }
+}
+
+// Map a batch of records of the split_index-th split.  Each split has
+// at least one batch, and batches of a split are consecutive, so the
+// mapper is started and flushed when the split changes, and flushed
+// for the last time by a NULL batch.
+void MapInputBatch(const vector<InputSplit>& splits,
+                   const InputBatch* batch,
+                   int* current_split,
+                   int* count_map_input,
+                   int* count_input_shards) {
+  if (*current_split >= 0 &&
+      (batch == NULL || batch->split_index != *current_split)) {
+    GetMapper()->Flush();
+    ++*count_input_shards;
+    LOG(INFO) << "Finished mapping file: " << *GetCurrentInputFilename();
+  }
+  if (batch == NULL) {
+    return;
+  }
+  if (batch->split_index != *current_split) {
+    *current_split = batch->split_index;
+    const InputSplit& split = splits[*current_split];
+    *GetCurrentInputFilename() = split.filename;
+    LOG(INFO) << "Mapping input file: " << *GetCurrentInputFilename()
+              << " [" << split.begin << ", " << split.end << ")";
+    GetMapper()->Start();
+  }
+  MapRecordBatch(batch->records, count_map_input);
+}
+
+// Map records read ahead by an InputPipeline.  Records are also added
+// to cache unless it is NULL.
+void MapInputSplitsInPipeline(const vector<InputSplit>& splits,
+                              bool read_splits,
+                              InputCache* cache,
+                              int* count_map_input,
+                              int* count_input_shards) {
+  InputPipeline pipeline(InputFormat(), read_splits, InputPipelineDepth());
+  pipeline.Start(splits);
+  int current_split = -1;
+  const InputBatch* batch = NULL;
+  do {
+    batch = pipeline.NextBatch();
+    if (batch != NULL && cache != NULL) {
+      cache->Add(batch->split_index, batch->records);
+    }
+    MapInputBatch(splits, batch, &current_split,
+                  count_map_input, count_input_shards);
+  } while (batch != NULL);
+}
+
+// Map records kept by the first pass.
+void MapCachedInput(const vector<InputSplit>& splits,
+                    const InputCache& cache,
+                    int* count_map_input,
+                    int* count_input_shards) {
+  int current_split = -1;
+  const vector<InputBatch*>& batches = cache.batches();
+  for (int i = 0; i < batches.size(); ++i) {
+    MapInputBatch(splits, batches[i], &current_split,
+                  count_map_input, count_input_shards);
+  }
+  MapInputBatch(splits, NULL, &current_split,
+                count_map_input, count_input_shards);
+}
+
 void MapWork() {
   // Clear counters.
   g_count_map_output = 0;
@@ -393,35 +896,53 @@ void MapWork() {
     LOG(FATAL) << "Failed matching: " << InputFilepattern();
   }
 
+  // Divide input files into splits if the input format supports it.
+  // Otherwise, each file is a split.
+  vector<string> filenames;
   for (int i_file = 0; i_file < matcher.NumMatched(); ++i_file) {
-    *GetCurrentInputFilename() = matcher.Matched(i_file);
-    LOG(INFO) << "Mapping input file: " << *GetCurrentInputFilename();
-
-    scoped_ptr<Reader> reader(CREATE_READER(InputFormat()));
-    if (reader.get() == NULL) {
-      LOG(FATAL) << "Creating reader for: " << *GetCurrentInputFilename();
+    filenames.push_back(matcher.Matched(i_file));
+  }
+  scoped_ptr<Reader> probe(CREATE_READER(InputFormat()));
+  if (probe.get() == NULL) {
+    LOG(FATAL) << "Creating reader of format: " << InputFormat();
+  }
+  bool split_files = SplitSize() > 0 && probe->SupportsSplit();
+  vector<InputSplit> splits;
+  ListInputSplits(filenames, split_files ? SplitSize() : 0, &splits);
+
+  // Map workers sharing the input files divide splits round-robin.
+  vector<InputSplit> my_splits;
+  SelectInputSplits(splits, split_files, NumSplitReaders(), SplitReaderId(),
+                    &my_splits);
+
+  // In multi-pass map, the first pass keeps input records in memory.
+  scoped_ptr<InputCache> cache;
+  if (NumMapPasses() > 1 && InputCacheSize() > 0) {
+    cache.reset(new InputCache(InputCacheSize()));
+  }
+  for (g_current_pass = 0; g_current_pass < NumMapPasses();
+       ++g_current_pass) {
+    LOG(INFO) << "Map pass " << g_current_pass << " of " << NumMapPasses();
+    InputCache* filling_cache = g_current_pass == 0 ? cache.get() : NULL;
+    if (g_current_pass > 0 && cache.get() != NULL && cache->Complete()) {
+      MapCachedInput(my_splits, *cache,
+                     &count_map_input, &count_input_shards);
+    } else if (InputPipelineDepth() > 0) {
+      MapInputSplitsInPipeline(my_splits, split_files, filling_cache,
+                               &count_map_input, &count_input_shards);
+    } else {
+      MapInputSplits(my_splits, split_files, filling_cache,
+                     &count_map_input, &count_input_shards);
     }
-    reader->Open(GetCurrentInputFilename()->c_str());
+    GetMapper()->EndPass();
 
-    GetMapper()->Start();
-
-    string key, value;
-    while (true) {
-      if (!reader->Read(&key, &value)) {
-        break;
-      }
-
-      GetMapper()->Map(key, value);
-      ++count_map_input;
-      if ((count_map_input % 1000) == 0) {
-        LOG(INFO) << "Processed " << count_map_input << " records.";
-      }
+    // Passes of map workers connected for all-reduce are in lockstep.
+    if (GetAllReduceGroup().get() != NULL &&
+        !GetAllReduceGroup()->Barrier()) {
+      LOG(FATAL) << "Failed waiting for other map workers.";
     }
-
-    GetMapper()->Flush();
-    ++count_input_shards;
-    LOG(INFO) << "Finished mapping file: " << *GetCurrentInputFilename();
   }
+  cache.reset(NULL);
 
   LOG(INFO) << "Map worker succeeded:\n"
             << " count_map_input = " << count_map_input << "\n"
@@ -432,70 +953,271 @@ void MapWork() {
 
   // Flush all reduce_input_buffers
   if (!IAmMapOnlyWorker()) {
+    if (GetShuffleServer().get() != NULL) {
+      ServeReduceInputBuffers();
+    } else if (MapOutputMergeFactor() > 0) {
+      MergeReduceInputBuffers();
+    }
     STLDeleteElementsAndClear(GetReduceInputBuffers().get());
+    STLDeleteElementsAndClear(GetMapOutputCombiners().get());
   }
 }
 
 //-----------------------------------------------------------------------------
 // Implementation of reduce worker:
 //-----------------------------------------------------------------------------
+// Fetch or find the reduce input files of sub_partition, reduce them
+// by reducer, then remove them.  Sub-partitions are reduced in
+// parallel, so each has its own fetcher, merger and combiner.
+void ReduceSubPartition(int sub_partition, BatchReducer* reducer,
+                        int* count_reduce) {
+  int num_sub_partitions = NumReduceSubPartitions();
+  string filebase = ReduceInputBufferFilebase();
+  if (num_sub_partitions > 1) {
+    StringAppendF(&filebase, "-sub-%05d", sub_partition);
+  }
+
+  vector<string> reduce_input_files;
+  int read_buffer_size = 0;
+  if (UseShuffleServer()) {
+    // Fetched files are merged in background while map workers are
+    // still working, and at most merge_factor files are left.
+    // Sub-partitions share mr_reduce_merge_memory.
+    read_buffer_size = kReduceMergeReadBufferSize;
+    int merge_factor = SortedFileMerger::MergeFactorForMemoryBudget(
+        ReduceMergeMemory() / num_sub_partitions, read_buffer_size);
+    scoped_ptr<BatchReducerCombiner> combiner;
+    if (!FLAGS_mr_combiner_class.empty()) {
+      BatchReducer* combiner_reducer = CreateCombiner();
+      if (combiner_reducer == NULL) {
+        LOG(FATAL) << "Failed creating combiner.";
+      }
+      combiner.reset(new BatchReducerCombiner(combiner_reducer));
+    }
+    SortedFileMerger merger(filebase + "-merged",
+                            merge_factor, read_buffer_size, combiner.get());
+    merger.SetSpillDirectories(SpillDirectories());
+
+    // Map workers serve each sub-partition as if to a reduce worker.
+    LOG(INFO) << "Fetching reduce input buffer files of sub-partition "
+              << sub_partition << " from map workers, "
+              << "merge factor = " << merge_factor;
+    ShuffleFetcher fetcher(MapWorkers(),
+                           ReduceWorkerId() * num_sub_partitions +
+                           sub_partition,
+                           filebase,
+                           NumParallelFetches());
+    fetcher.set_merger(&merger);
+    fetcher.set_spill_directories(SpillDirectories());
+    if (!fetcher.FetchAll(&reduce_input_files)) {
+      LOG(FATAL) << "Failed fetching reduce input buffer files.";
+    }
+  } else {
+    for (int i_file = 0; i_file < NumReduceInputBufferFiles(); ++i_file) {
+      reduce_input_files.push_back(SortedBuffer::SortedFilename(
+          filebase, i_file));
+    }
+  }
+
+  LOG(INFO) << "Creating reduce input iterator ... filebase = "
+            << filebase
+            << " with file num = "
+            << reduce_input_files.size();
+  SortedBufferIteratorImpl reduce_input_iterator(reduce_input_files,
+                                                 read_buffer_size);
+  LOG(INFO) << "Succeeded creating reduce input iterator.";
+
+  for (*count_reduce = 0;
+       !(reduce_input_iterator.FinishedAll());
+       reduce_input_iterator.NextKey(), ++*count_reduce) {
+    reducer->Reduce(reduce_input_iterator.key(), &reduce_input_iterator);
+    if (*count_reduce > 0 && (*count_reduce % 5000) == 0) {
+      LOG(INFO) << "Invoked " << *count_reduce << " reduce()s of "
+                << "sub-partition " << sub_partition << ".";
+    }
+  }
+
+  // remove reduce input buffer files
+  for (int i_file = 0; i_file < reduce_input_files.size(); ++i_file) {
+    const string& filename = reduce_input_files[i_file];
+    LOG(INFO) << "Removing : " << filename
+              << " size = "<< boost::filesystem::file_size(filename);
+    boost::filesystem::remove(filename);
+  }
+}
+
+// In order to implement the classical MapReduce API, which defines
+// reduce operation in a ``batch'' way -- reduce is invoked after
+// all reduce values were collected for a map output key.  we
+// employes Berkeley DB to sort and store map outputs arrived in
+// this reduce worker.  Berkeley DB is in response to keep a small
+// memory footprint and does external sort using disk.
+
+// MRML supports in addition ``incremental'' reduction, where
+// reduce() accepts an intermediate reduce result (represented by a
+// void*, and is NULL for the first value in a reduce input comes)
+// and a reduce value.  It should update the intermediate result
+// using the value.
+typedef map<string, void*> PartialReduceResults;
+
+// Begin a new reduce, which insert a partial result, or does partial
+// reduce, which updates a partial result, with a map output received
+// by the communicator.
+void ReduceMapOutput(const char* message,
+                     IncrementalReducer* reducer,
+                     PartialReduceResults* partial_reduce_results) {
+  const uint32* p = reinterpret_cast<const uint32*>(message);
+  uint32 key_size = *p;
+  uint32 value_size = *(p + 1);
+  const char* data = message + sizeof(uint32) * 2;
+
+  string key(data, key_size);
+  string value(data + key_size, value_size);
+
+  PartialReduceResults::iterator iter = partial_reduce_results->find(key);
+  if (iter == partial_reduce_results->end()) {
+    (*partial_reduce_results)[key] = reducer->BeginReduce(key, value);
+  } else {
+    reducer->PartialReduce(key, value, iter->second);
+  }
+}
+
+// Invoke EndReduce for each partial result.  Returns the number of
+// reduced keys.
+int EndReduceAll(IncrementalReducer* reducer,
+                 const PartialReduceResults& partial_reduce_results) {
+  int count_reduce = 0;
+  for (PartialReduceResults::const_iterator iter =
+           partial_reduce_results.begin();
+       iter != partial_reduce_results.end(); ++iter) {
+    reducer->EndReduce(iter->first, iter->second);
+    // Note: the deletion of iter->second must be done by the user
+    // program in EndReduce, because mrml.cc does not know the type of
+    // ReducePartialResult defined by the user program.
+    ++count_reduce;
+  }
+  return count_reduce;
+}
+
+// The state of periodic flush (see --mr_periodic_flush_outputs and
+// --mr_periodic_flush_seconds) of a reducer.
+struct PeriodicFlush {
+  int num_map_outputs;          // Reduced since the previous flush.
+  time_t last_flush_time;
+
+  PeriodicFlush() : num_map_outputs(0), last_flush_time(time(NULL)) {}
+};
+
+// Invoked after reducing a map output.  If either limit of periodic
+// flush was reached, invokes EndReduce for all partial results and
+// forgets them.  Returns the number of reduced keys.
+int MaybeFlushPartialResults(IncrementalReducer* reducer,
+                             PartialReduceResults* partial_reduce_results,
+                             PeriodicFlush* flush) {
+  ++flush->num_map_outputs;
+  bool due = PeriodicFlushOutputs() > 0 &&
+      flush->num_map_outputs >= PeriodicFlushOutputs();
+  if (!due && PeriodicFlushSeconds() > 0) {
+    time_t now = time(NULL);
+    due = now - flush->last_flush_time >= PeriodicFlushSeconds();
+  }
+  if (!due) {
+    return 0;
+  }
+  int count_reduce = EndReduceAll(reducer, *partial_reduce_results);
+  partial_reduce_results->clear();
+  reducer->EndPeriod();
+  LOG(INFO) << "Periodic flush output " << count_reduce << " keys reduced "
+            << "from " << flush->num_map_outputs << " map outputs.";
+  flush->num_map_outputs = 0;
+  flush->last_flush_time = time(NULL);
+  return count_reduce;
+}
+
+// With more than one sub-partition in incremental reduction mode, the
+// receiving thread dispatches map outputs by key to queues, and a
+// thread of each sub-partition reduces map outputs in its queue into
+// its own partial results, then invokes EndReduce for them.
+void ReduceSubPartitionQueue(SignalingQueue* queue,
+                             IncrementalReducer* reducer,
+                             int* count_reduce) {
+  PartialReduceResults partial_reduce_results;
+  PeriodicFlush flush;
+  scoped_array<char> message(new char[MapOutputBufferSize()]);
+  int size = 0;
+  while ((size = queue->Remove(message.get(), MapOutputBufferSize())) > 0) {
+    ReduceMapOutput(message.get(), reducer, &partial_reduce_results);
+    *count_reduce += MaybeFlushPartialResults(reducer,
+                                              &partial_reduce_results,
+                                              &flush);
+  }
+  if (size < 0) {
+    LOG(FATAL) << "Failed removing map output from sub-partition queue.";
+  }
+  *count_reduce += EndReduceAll(reducer, partial_reduce_results);
+}
+
 void ReduceWork() {
   LOG(INFO) << "Reduce worker in "
             << (FLAGS_mr_batch_reduction ? "batch " : "incremental ")
             << "reduction mode.";
   LOG(INFO) << "Output to " << JoinStrings(OutputFiles(), ",");
 
-  // In order to implement the classical MapReduce API, which defines
-  // reduce operation in a ``batch'' way -- reduce is invoked after
-  // all reduce values were collected for a map output key.  we
-  // employes Berkeley DB to sort and store map outputs arrived in
-  // this reduce worker.  Berkeley DB is in response to keep a small
-  // memory footprint and does external sort using disk.
-
-  // MRML supports in addition ``incremental'' reduction, where
-  // reduce() accepts an intermediate reduce result (represented by a
-  // void*, and is NULL for the first value in a reduce input comes)
-  // and a reduce value.  It should update the intermediate result
-  // using the value.
-  typedef map<string, void*> PartialReduceResults;
-  scoped_ptr<PartialReduceResults> partial_reduce_results;
-
-  // Initialize partial reduce results, or reduce input buffer.
-  if (!FLAGS_mr_batch_reduction) {
-    partial_reduce_results.reset(new PartialReduceResults);
-  }
-
-  // Loop over map outputs arrived in this reduce worker.
-  LOG(INFO) << "Start receiving and processing arriving map outputs ...";
   int32 count_reduce = 0;
   int32 count_map_output = 0;
-  int receive_status = 0;
 
   GetReducer()->Start();
 
+  // Each sub-partition is reduced by its own reducer, in its own
+  // thread.  The first sub-partition is reduced by GetReducer().
+  int num_sub_partitions = NumReduceSubPartitions();
+  vector<ReducerBase*> reducers(1, GetReducer().get());
+  for (int s = 1; s < num_sub_partitions; ++s) {
+    ReducerBase* reducer = CreateSubPartitionReducer(s);
+    if (reducer == NULL) {
+      LOG(FATAL) << "Failed creating reducer of sub-partition " << s;
+    }
+    reducer->Start();
+    reducers.push_back(reducer);
+  }
+  vector<int> counts(num_sub_partitions, 0);
+
   if (!FLAGS_mr_batch_reduction) {
+    // Loop over map outputs arrived in this reduce worker.
+    LOG(INFO) << "Start receiving and processing arriving map outputs ...";
+    PartialReduceResults partial_reduce_results;
+    PeriodicFlush flush;
+    vector<SignalingQueue*> queues;
+    boost::thread_group threads;
+    if (num_sub_partitions > 1) {
+      int queue_size = std::max(MessageQueueSize() / num_sub_partitions,
+                                MapOutputBufferSize());
+      for (int s = 0; s < num_sub_partitions; ++s) {
+        queues.push_back(new SignalingQueue(queue_size));
+        threads.create_thread(boost::bind(
+            ReduceSubPartitionQueue, queues[s],
+            reinterpret_cast<IncrementalReducer*>(reducers[s]), &counts[s]));
+      }
+    }
+
+    char* message = GetMapOutputReceiveBuffer().get();
+    int receive_status = 0;
     while ((receive_status =
-            GetCommunicator()->Receive(GetMapOutputReceiveBuffer().get(),
-                                       MapOutputBufferSize())) > 0) {
+            GetCommunicator()->Receive(message, MapOutputBufferSize())) > 0) {
       ++count_map_output;
-      uint32* p = reinterpret_cast<uint32*>(GetMapOutputReceiveBuffer().get());
-      uint32 key_size = *p;
-      uint32 value_size = *(p + 1);
-      char* data = GetMapOutputReceiveBuffer().get() + sizeof(uint32) * 2;
-
-      string key(data, key_size);
-      string value(data + key_size, value_size);
-
-      // Begin a new reduce, which insert a partial result, or does
-      // partial reduce, which updates a partial result.
-      PartialReduceResults::iterator iter = partial_reduce_results->find(key);
-      if (iter == partial_reduce_results->end()) {
-        (*partial_reduce_results)[key] =
-            reinterpret_cast<IncrementalReducer*>(GetReducer().get())->
-            BeginReduce(key, value);
+      if (num_sub_partitions == 1) {
+        IncrementalReducer* reducer =
+            reinterpret_cast<IncrementalReducer*>(reducers[0]);
+        ReduceMapOutput(message, reducer, &partial_reduce_results);
+        counts[0] += MaybeFlushPartialResults(reducer,
+                                              &partial_reduce_results,
+                                              &flush);
       } else {
-        reinterpret_cast<IncrementalReducer*>(GetReducer().get())->
-            PartialReduce(key, value, iter->second);
+        uint32 key_size = *reinterpret_cast<uint32*>(message);
+        string key(message + sizeof(uint32) * 2, key_size);
+        if (queues[SubPartition(key)]->Add(message, receive_status) <= 0) {
+          LOG(FATAL) << "Failed dispatching map output with key = " << key;
+        }
       }
 
       if ((count_map_output % 5000) == 0) {
@@ -506,58 +1228,45 @@ void ReduceWork() {
     if (receive_status < 0) {  // Check the reason of breaking while loop.
       LOG(FATAL) << "Communication error at reducer receiving.";
     }
-  }
+    GetMapOutputReceiveBuffer().reset(NULL);
 
-  GetMapOutputReceiveBuffer().reset(NULL);
-
-  // Invoke EndReduce in incremental reduction mode, or invoke Reduce
-  // in batch reduction mode.
-  if (!FLAGS_mr_batch_reduction) {
+    // Invoke EndReduce, in parallel in sub-partition threads.
     LOG(INFO) << "Finalizing incremental reduction ...";
-    for (PartialReduceResults::const_iterator iter =
-             partial_reduce_results->begin();
-         iter != partial_reduce_results->end(); ++iter) {
-      reinterpret_cast<IncrementalReducer*>(GetReducer().get())->
-          EndReduce(iter->first, iter->second);
-      // Note: the deletion of iter->second must be done by the user
-      // program in EndReduce, because mrml.cc does not know the type of
-      // ReducePartialResult defined by the user program.
-      ++count_reduce;
+    if (num_sub_partitions == 1) {
+      counts[0] += EndReduceAll(
+          reinterpret_cast<IncrementalReducer*>(reducers[0]),
+          partial_reduce_results);
+    } else {
+      for (int s = 0; s < num_sub_partitions; ++s) {
+        queues[s]->Signal(0);
+      }
+      threads.join_all();
+      STLDeleteElementsAndClear(&queues);
     }
     LOG(INFO) << "Succeeded finalizing incremental reduction.";
   } else {
-    LOG(INFO) << "Start batch reduction ...";
-    LOG(INFO) << "Creating reduce input iterator ... filebase = "
-              << ReduceInputBufferFilebase()
-              << " with file num = "
-              << NumReduceInputBufferFiles();
-    SortedBufferIteratorImpl reduce_input_iterator(ReduceInputBufferFilebase(),
-                                                   NumReduceInputBufferFiles());
-    LOG(INFO) << "Succeeded creating reduce input iterator.";
-
-    for (count_reduce = 0;
-         !(reduce_input_iterator.FinishedAll());
-         reduce_input_iterator.NextKey(), ++count_reduce) {
-      reinterpret_cast<BatchReducer*>(GetReducer().get())->
-          Reduce(reduce_input_iterator.key(), &reduce_input_iterator);
-      if (count_reduce > 0 && (count_reduce % 5000) == 0) {
-        LOG(INFO) << "Invoked " << count_reduce << " reduce()s.";
-      }
-    }
+    GetMapOutputReceiveBuffer().reset(NULL);
 
-    // remove reduce input buffer files
-    for (int i_file = 0; i_file < NumReduceInputBufferFiles(); ++i_file) {
-      string filename = SortedBuffer::SortedFilename(
-          ReduceInputBufferFilebase(), i_file);
-      LOG(INFO) << "Removing : " << filename
-                << " size = "<< boost::filesystem::file_size(filename);
-      boost::filesystem::remove(filename);
+    LOG(INFO) << "Start batch reduction ...";
+    boost::thread_group threads;
+    for (int s = 1; s < num_sub_partitions; ++s) {
+      threads.create_thread(boost::bind(
+          ReduceSubPartition, s,
+          reinterpret_cast<BatchReducer*>(reducers[s]), &counts[s]));
     }
-
+    ReduceSubPartition(0, reinterpret_cast<BatchReducer*>(reducers[0]),
+                       &counts[0]);
+    threads.join_all();
     LOG(INFO) << "Finished batch reduction.";
   }
 
-  GetReducer()->Flush();
+  for (int s = 0; s < num_sub_partitions; ++s) {
+    count_reduce += counts[s];
+    reducers[s]->Flush();
+    if (s > 0) {
+      delete reducers[s];
+    }
+  }
 
   LOG(INFO) << " count_reduce = " << count_reduce << "\n"
             << " count_map_output = " << count_map_output << "\n";
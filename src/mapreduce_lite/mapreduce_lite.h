@@ -22,12 +22,22 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
 #ifndef MAPREDUCE_LITE_MAPREDUCE_LITE_H_
 #define MAPREDUCE_LITE_MAPREDUCE_LITE_H_
 
+#include <deque>
 #include <string>
 #include <sstream>
 #include <vector>
 
+#include "google/protobuf/stubs/common.h"
+#if GOOGLE_PROTOBUF_VERSION >= 3000000
+#include "google/protobuf/arena.h"
+#endif
+
 #include "src/base/class_register.h"
+#include "src/base/common.h"
+#include "src/hash/simple_hash.h"
+#include "src/mapreduce_lite/record_batch.h"
 #include "src/sorted_buffer/sorted_buffer.h"
+#include "src/strutil/strcodec.h"
 
 namespace google {
 namespace protobuf {
@@ -59,13 +69,27 @@ using std::string;
 //  2. For each key-value pair in the shard, it invokes Map().
 //  3. After all map input pairs were processed, it invokes Flush().
 //
+// *** Batch Map ***
+//
+// Records are read in batches (see RecordBatch), and each batch is
+// passed to MapBatch(), whose default implementation invokes Map()
+// for each record.  A mapper must override either Map() or MapBatch().
+// Overriding MapBatch() processes a batch at a time, e.g., parsing
+// values with SIMD, and avoids a virtual call and string copies per
+// record.  In MapBatch(), use batch.LazyKey(i) instead of
+// LazyInputKey().
+//
 // *** Multi-pass Map ***
 //
 // A unique feature of MapReduce Lite (differs from Google MapReduce
 // and Hadoop) is that above procedure may be repeated for multiple
-// time, if the command line paramter --mrml_multipass_map is set with
-// a positive value.  In this case, derived classes can invoke
-// GetCurrentPass() to get the current (zero-based) pass id.
+// time, if the command line paramter --mr_multipass_map is set with
+// a value larger than 1.  In this case, derived classes can invoke
+// GetCurrentPass() to get the current (zero-based) pass id.  After
+// the last Flush() of each pass, EndPass() is invoked, e.g., to update
+// a model by AllReduce() or Broadcast().  Records read by the first
+// pass are kept in memory (see --mr_input_cache_size), so later passes
+// do not read and parse input files again.
 //
 // *** Sharding ***
 //
@@ -85,27 +109,247 @@ using std::string;
 //
 // OutputToShard and OutputToAllShards are forbidden in map-only mode.
 //
+// *** AllReduce ***
+//
+// If --mr_allreduce_workers is set, map workers may sum up arrays of
+// numbers over all map workers by AllReduce(), e.g., in Flush() of
+// each pass of an iterative learning algorithm, where each map worker
+// computes the update of a model from its shard.  All map workers must
+// invoke AllReduce() in the same order, with arrays of the same size.
+// After it returns, each map worker has the sums in its array.  This
+// costs about twice the array in network traffic per map worker (see
+// allreduce.h), much less than outputting and reducing the arrays.
+// Similarly, Broadcast() sends data of map worker 0 to all others.
+//
+// *** Typed Outputs ***
+//
+// Numerical map outputs can be passed to Output() as int64 or double
+// values, which are encoded in their 8-byte binary forms by
+// EncodeInt64() and EncodeDouble() (see src/strutil/strcodec.h),
+// instead of formatted as decimal strings.  BatchReducers decode them
+// by ReduceInputIterator::value_int64() and value_double(), and
+// IncrementalReducers by DecodeInt64() and DecodeDouble().  Binary
+// values are shorter than most decimal strings and cost neither
+// formatting nor parsing.  As the encodings are memory mirrors, all
+// workers must run on machines of the same endianness.  A mapper
+// overriding Output() must add "using Mapper::Output;" to keep the
+// typed overloads visible.
+//
 //-----------------------------------------------------------------------------
 class Mapper {
  public:
   virtual ~Mapper() {}
 
   virtual void Start() {}
-  virtual void Map(const string& key, const string& value) = 0;
+  virtual void Map(const string& key, const string& value);
+  virtual void MapBatch(const RecordBatch& batch);
   virtual void Flush() {}
+  virtual void EndPass() {}
   virtual int Shard(const string& key, int num_reduce_shards);
 
  protected:
   virtual void Output(const string& key, const string& value);
+  void Output(const string& key, int64 value);
+  void Output(const string& key, int value) {
+    Output(key, static_cast<int64>(value));
+  }
+  void Output(const string& key, double value);
+  void Output(const string& key, const char* value, size_t size);
   virtual void OutputToShard(int reduce_shard,
                              const string& key, const string& value);
   virtual void OutputToAllShards(const string& key, const string& value);
 
+  // Output to reduce_shard, or to the output file in map-only mode,
+  // where reduce_shard is ignored.  Unlike Output*, this is not
+  // virtual, and is used by StaticMapper.
+  void EmitToShard(int reduce_shard, const string& key, const string& value);
+
+  // Sum data element-wise over all map workers (see "AllReduce").
+  void AllReduce(float* data, int size);
+  void AllReduce(double* data, int size);
+  // Replace data by that of map worker 0.
+  void Broadcast(string* data);
+
   const string& CurrentInputFilename() const;
+  // Some input formats (e.g., "mmap_text") pass an empty key to Map()
+  // for efficiency.  This builds the key of the current map input.
+  string LazyInputKey() const;
   const string& GetInputFormat() const;
   const string& GetOutputFormat() const;
   int GetNumReduceShards() const;
   bool IsMapOnly() const;
+  int GetCurrentPass() const;
+  int GetNumPasses() const;
+};
+
+//-----------------------------------------------------------------------------
+//
+// ProtoMapper class
+//
+// For inputs whose keys and values are serialized protocol messages,
+// e.g., in "protofile" or "blockfile" format, derive the mapper from
+// ProtoMapper<KeyMsg, ValueMsg> and override MapProto() instead of
+// Map().  KeyMsg and ValueMsg are message classes or string.
+//
+// Each record is parsed directly from the buffer of the input batch.
+// With protobuf 3 or later, messages are allocated on an arena, which
+// frees those of a batch at once after the batch is mapped.  With
+// earlier versions, the mapper owns a key and a value message, which
+// are reused for all records; as parsing clears a message but keeps
+// the memory of its strings and repeated sub-messages, mapping records
+// of similar shapes does not allocate nested messages per record.
+// Either way, the messages passed to MapProto() are valid until it
+// returns.  A record which cannot be parsed fails the job.
+//
+//-----------------------------------------------------------------------------
+template <class Message>
+inline bool ParseMapInput(const char* data, int size, Message* message) {
+  return message->ParseFromArray(data, size);
+}
+
+inline bool ParseMapInput(const char* data, int size, string* value) {
+  value->assign(data, size);
+  return true;
+}
+
+#if GOOGLE_PROTOBUF_VERSION >= 3000000
+template <class Message>
+inline Message* NewMapInput(google::protobuf::Arena* arena) {
+  return google::protobuf::Arena::CreateMessage<Message>(arena);
+}
+
+template <>
+inline string* NewMapInput<string>(google::protobuf::Arena* arena) {
+  return google::protobuf::Arena::Create<string>(arena);
+}
+#endif
+
+template <class KeyMsg, class ValueMsg>
+class ProtoMapper : public Mapper {
+ public:
+  virtual void MapProto(const KeyMsg& key, const ValueMsg& value) = 0;
+
+#if GOOGLE_PROTOBUF_VERSION >= 3000000
+  virtual void MapBatch(const RecordBatch& batch) {
+    for (int i = 0; i < batch.Size(); ++i) {
+      KeyMsg* key = NewMapInput<KeyMsg>(&arena_);
+      ValueMsg* value = NewMapInput<ValueMsg>(&arena_);
+      Parse(batch, i, key, value);
+      MapProto(*key, *value);
+    }
+    arena_.Reset();
+  }
+
+ private:
+  google::protobuf::Arena arena_;
+#else
+  virtual void MapBatch(const RecordBatch& batch) {
+    for (int i = 0; i < batch.Size(); ++i) {
+      Parse(batch, i, &key_, &value_);
+      MapProto(key_, value_);
+    }
+  }
+
+ private:
+  KeyMsg key_;
+  ValueMsg value_;
+#endif
+
+  void Parse(const RecordBatch& batch, int i, KeyMsg* key, ValueMsg* value) {
+    if (!ParseMapInput(batch.KeyData(i), batch.KeySize(i), key) ||
+        !ParseMapInput(batch.ValueData(i), batch.ValueSize(i), value)) {
+      LOG(FATAL) << "Cannot parse a map input in " << CurrentInputFilename();
+    }
+  }
+};
+
+//-----------------------------------------------------------------------------
+//
+// StaticMapper class
+//
+// Mapper dispatches virtually for every record: Map(), Output() and
+// Shard().  A mapper whose Map() is cheap, e.g., a tokenizer, may
+// spend much of its time in these calls, which the compiler cannot
+// inline.  StaticMapper binds them at compile time by the curiously
+// recurring template pattern:
+//
+//   class MyMapper : public StaticMapper<MyMapper, MyPartitioner> {
+//    public:
+//     void Map(const string& key, const string& value) {
+//       ...
+//       Emit(word, 1);
+//     }
+//   };
+//   REGISTER_MAPPER(MyMapper);
+//
+// MapBatch() loops over a batch and invokes MyMapper::Map() by a
+// qualified, non-virtual call, and Emit() shards by the static
+// Partitioner::Shard(key, num_reduce_shards), so that the record path
+// from the input batch to MapOutput can be inlined.  The partitioner
+// defaults to HashPartitioner, the sharding of Mapper::Shard().  A
+// StaticMapper is an ordinary Mapper otherwise, and is registered and
+// selected by --mr_mapper_class as usual.  Output() still works, but
+// is a virtual call.
+//
+//-----------------------------------------------------------------------------
+struct HashPartitioner {
+  static int Shard(const string& key, int num_reduce_shards) {
+    return JSHash(key) % num_reduce_shards;
+  }
+};
+
+template <class Derived, class Partitioner = HashPartitioner>
+class StaticMapper : public Mapper {
+ public:
+  StaticMapper()
+      : map_only_(false), num_reduce_shards_(0),
+        batch_(NULL), batch_index_(-1) {}
+
+  virtual void MapBatch(const RecordBatch& batch) {
+    map_only_ = IsMapOnly();
+    num_reduce_shards_ = map_only_ ? 0 : GetNumReduceShards();
+    batch_ = &batch;
+    Derived* derived = static_cast<Derived*>(this);
+    for (batch_index_ = 0; batch_index_ < batch.Size(); ++batch_index_) {
+      key_.assign(batch.KeyData(batch_index_), batch.KeySize(batch_index_));
+      value_.assign(batch.ValueData(batch_index_),
+                    batch.ValueSize(batch_index_));
+      derived->Derived::Map(key_, value_);
+    }
+    batch_ = NULL;
+  }
+
+  virtual int Shard(const string& key, int num_reduce_shards) {
+    return Partitioner::Shard(key, num_reduce_shards);
+  }
+
+ protected:
+  void Emit(const string& key, const string& value) {
+    EmitToShard(map_only_ ? 0 : Partitioner::Shard(key, num_reduce_shards_),
+                key, value);
+  }
+  void Emit(const string& key, int64 value) { Emit(key, EncodeInt64(value)); }
+  void Emit(const string& key, int value) {
+    Emit(key, EncodeInt64(value));
+  }
+  void Emit(const string& key, double value) {
+    Emit(key, EncodeDouble(value));
+  }
+
+  // Replaces Mapper::LazyInputKey(), which works only with the
+  // default MapBatch().
+  string LazyInputKey() const {
+    CHECK(batch_ != NULL);
+    return batch_->LazyKey(batch_index_);
+  }
+
+ private:
+  bool map_only_;               // Cached by MapBatch().
+  int num_reduce_shards_;       // Cached by MapBatch().
+  const RecordBatch* batch_;    // The batch being mapped.
+  int batch_index_;             // The record being mapped.
+  string key_;                  // Reused for all records.
+  string value_;
 };
 
 //-----------------------------------------------------------------------------
@@ -149,9 +393,30 @@ class Mapper {
 //     together with the key of the current reduce input, will be save
 //     as a reduce output pair.
 //
+// *** Periodic Flush ***
+//
+// By default, EndReduce() is invoked after all map workers finished.
+// With --mr_periodic_flush_outputs or --mr_periodic_flush_seconds, a
+// reducer invokes EndReduce() for all its partial results every N map
+// outputs or T seconds, and starts anew with BeginReduce().  This
+// bounds the memory of partial results and outputs results early, at
+// the cost of outputting a key once per flush, each time with the
+// partial result of values since the previous flush.  It suits
+// reducers whose results are merged downstream, e.g., sums or counts.
+// After each periodic flush, EndPeriod() is invoked, e.g., to mark a
+// checkpoint in outputs.  Flush() is invoked only at the end.
+//
 //-----------------------------------------------------------------------------
+class BatchReducerCombiner;
+class ReducerBase;
+
+// Creates a reducer of --mr_reducer_class, which reduces and outputs
+// the given sub-partition (see --mr_num_reduce_sub_partitions).
+ReducerBase* CreateSubPartitionReducer(int sub_partition);
+
 class ReducerBase {
  public:
+  ReducerBase() : combiner_(NULL), sub_partition_(0) {}
   virtual ~ReducerBase() {}
   const string& GetOutputFormat() const;
 
@@ -162,6 +427,15 @@ class ReducerBase {
   virtual void Output(const string& key,
                       const string& value);
 
+  // Typed outputs (see "Typed Outputs" of Mapper), mainly for
+  // combiners, whose outputs are reduce inputs.
+  void Output(const string& key, int64 value);
+  void Output(const string& key, int value) {
+    Output(key, static_cast<int64>(value));
+  }
+  void Output(const string& key, double value);
+  void Output(const string& key, const char* value, size_t size);
+
   // Output to the specified output channel.
   virtual void OutputToChannel(int channel,
                                const string& key,
@@ -170,6 +444,19 @@ class ReducerBase {
   // The number of output channels. The parameter channel in Output*
   // must be in the range [0, NumOutputChannels() - 1].
   virtual int NumOutputChannels() const;
+
+ private:
+  friend class BatchReducerCombiner;
+  friend ReducerBase* CreateSubPartitionReducer(int sub_partition);
+
+  // Not NULL if this reducer works as a map-side combiner (see
+  // --mr_combiner_class), where Output* go to the combiner.
+  BatchReducerCombiner* combiner_;
+
+  // The reduce input sub-partition (see --mr_num_reduce_sub_partitions)
+  // reduced by this reducer, whose Output* go to output files of the
+  // sub-partition.
+  int sub_partition_;
 };
 
 
@@ -184,6 +471,69 @@ class IncrementalReducer : public ReducerBase {
                              void* partial_result) = 0;
   virtual void EndReduce(const string& key,
                          void* partial_result) = 0;
+
+  // Invoked after EndReduce() of all partial results of a periodic
+  // flush (see "Periodic Flush" above).
+  virtual void EndPeriod() {}
+};
+
+//-----------------------------------------------------------------------------
+//
+// TypedIncrementalReducer class
+//
+// An IncrementalReducer whose partial result of a key is a State,
+// e.g., a counter or a struct of accumulators, instead of a void*
+// which BeginReduce() allocates and EndReduce() deletes.  Derive the
+// reducer from TypedIncrementalReducer<State> and override:
+//
+//  1. void Init(State* state): initializes the partial result of a
+//     new key, which is value-initialized (zero for built-in types).
+//  2. void Update(State* state, const string& value): updates a
+//     partial result with a value, including the first value of a key.
+//  3. void Finalize(const string& key, const State& state): outputs
+//     the final result of a key.
+//
+// States are kept in a deque owned by the reducer, which allocates
+// them in chunks instead of one heap allocation per key, and never
+// moves them.  States are released together after the last
+// EndReduce().
+//
+//-----------------------------------------------------------------------------
+template <class State>
+class TypedIncrementalReducer : public IncrementalReducer {
+ public:
+  TypedIncrementalReducer() : num_unfinished_states_(0) {}
+  virtual ~TypedIncrementalReducer() {}
+
+  virtual void Init(State* state) {}
+  virtual void Update(State* state, const string& value) = 0;
+  virtual void Finalize(const string& key, const State& state) = 0;
+
+  virtual void* BeginReduce(const string& key, const string& value) {
+    states_.push_back(State());
+    State* state = &states_.back();
+    ++num_unfinished_states_;
+    Init(state);
+    Update(state, value);
+    return state;
+  }
+
+  virtual void PartialReduce(const string& key,
+                             const string& value,
+                             void* partial_result) {
+    Update(static_cast<State*>(partial_result), value);
+  }
+
+  virtual void EndReduce(const string& key, void* partial_result) {
+    Finalize(key, *static_cast<const State*>(partial_result));
+    if (--num_unfinished_states_ == 0) {
+      states_.clear();
+    }
+  }
+
+ private:
+  std::deque<State> states_;
+  int64 num_unfinished_states_;   // States not passed to EndReduce().
 };
 
 //-----------------------------------------------------------------------------
@@ -207,6 +557,15 @@ class IncrementalReducer : public ReducerBase {
 // MRML_Reducer, please remember to register it using
 // REGISTER_MR_REDUCER instead of REGISTER_REDUCER.
 //
+// *** Combiner ***
+//
+// A BatchReducer can also be used as a combiner by map workers, if
+// its class name is given by --mr_combiner_class.  When a map worker
+// merges its map outputs on disk, Reduce() is invoked for each key and
+// the values passed to Output() replace the merged values.  So the
+// reduce operation must be associative, and the output key must be
+// the reduce input key.
+//
 //-----------------------------------------------------------------------------
 class BatchReducer : public ReducerBase {
  public:
@@ -0,0 +1,115 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/mapreduce_lite/parallel_compressor.h"
+
+#include "src/base/stl-util.h"
+
+namespace mapreduce_lite {
+
+ParallelCompressor::ParallelCompressor(CompressFunction compress,
+                                       int num_threads)
+    : compress_(compress),
+      max_jobs_(num_threads > 0 ? 4 * num_threads : 1),
+      stopping_(false) {
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.push_back(new boost::thread(CompressLoop, this));
+  }
+}
+
+ParallelCompressor::~ParallelCompressor() {
+  {
+    MutexLocker locker(&mutex_);
+    stopping_ = true;
+    queued_.Broadcast();
+  }
+  for (int i = 0; i < threads_.size(); ++i) {
+    threads_[i]->join();
+  }
+  STLDeleteElementsAndClear(&threads_);
+  STLDeleteElementsAndClear(&jobs_);
+  STLDeleteElementsAndClear(&free_jobs_);
+}
+
+void ParallelCompressor::Add(std::string* data) {
+  Job* job = NULL;
+  if (free_jobs_.empty()) {
+    job = new Job;
+  } else {
+    job = free_jobs_.back();
+    free_jobs_.pop_back();
+  }
+  job->data.swap(*data);
+  data->clear();
+  job->block.clear();
+  job->done = false;
+  jobs_.push_back(job);
+
+  if (threads_.empty()) {
+    compress_(job->data, &job->block);
+    job->done = true;
+  } else {
+    MutexLocker locker(&mutex_);
+    queue_.push_back(job);
+    queued_.Signal();
+  }
+}
+
+bool ParallelCompressor::Take(std::string* block, bool wait) {
+  if (jobs_.empty()) {
+    return false;
+  }
+  Job* job = jobs_.front();
+  if (!threads_.empty()) {
+    MutexLocker locker(&mutex_);
+    while (wait && !job->done) {
+      done_.Wait(&mutex_);
+    }
+    if (!job->done) {
+      return false;
+    }
+  }
+  jobs_.pop_front();
+  block->swap(job->block);
+  free_jobs_.push_back(job);
+  return true;
+}
+
+void ParallelCompressor::CompressLoop(ParallelCompressor* compressor) {
+  while (true) {
+    Job* job = NULL;
+    {
+      MutexLocker locker(&compressor->mutex_);
+      while (compressor->queue_.empty() && !compressor->stopping_) {
+        compressor->queued_.Wait(&compressor->mutex_);
+      }
+      if (compressor->stopping_) {
+        return;
+      }
+      job = compressor->queue_.front();
+      compressor->queue_.pop_front();
+    }
+    compressor->compress_(job->data, &job->block);
+    MutexLocker locker(&compressor->mutex_);
+    job->done = true;
+    compressor->done_.Broadcast();
+  }
+}
+
+}  // namespace mapreduce_lite
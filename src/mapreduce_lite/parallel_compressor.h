@@ -0,0 +1,95 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+// ParallelCompressor compresses blocks of an output file in a pool of
+// threads, while the thread producing the output keeps filling the
+// next block.  Compressed blocks are taken in the order they were
+// added, so they can be written sequentially.
+//
+// A typical writer loop:
+//
+//   compressor.Add(&block);
+//   while (compressor.Take(&compressed, compressor.Full())) {
+//     Write(compressed);
+//   }
+//
+#ifndef MAPREDUCE_LITE_PARALLEL_COMPRESSOR_H_
+#define MAPREDUCE_LITE_PARALLEL_COMPRESSOR_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "boost/thread.hpp"
+
+#include "src/base/common.h"
+#include "src/system/condition_variable.h"
+#include "src/system/mutex.h"
+
+namespace mapreduce_lite {
+
+class ParallelCompressor {
+ public:
+  // Compresses data into block, which is cleared before invocation.
+  typedef void (*CompressFunction)(const std::string& data,
+                                   std::string* block);
+
+  // If num_threads is 0, Add() compresses blocks.
+  ParallelCompressor(CompressFunction compress, int num_threads);
+  ~ParallelCompressor();
+
+  // Queue data to be compressed.  The content of data is moved into
+  // the compressor, and data is left empty.
+  void Add(std::string* data);
+
+  // Take the next compressed block.  Returns false if no block was
+  // added but not taken, or if wait is false and the next block is
+  // not compressed yet.
+  bool Take(std::string* block, bool wait);
+
+  // The caller should take blocks before adding more.
+  bool Full() const { return jobs_.size() >= max_jobs_; }
+
+ private:
+  struct Job {
+    std::string data;
+    std::string block;
+    bool done;
+  };
+
+  static void CompressLoop(ParallelCompressor* compressor);
+
+  CompressFunction compress_;
+  int max_jobs_;
+  std::deque<Job*> jobs_;            // Jobs added and not taken, in order.
+  std::vector<Job*> free_jobs_;
+
+  Mutex mutex_;                      // Protects the following four.
+  ConditionVariable queued_;         // Signaled by Add().
+  ConditionVariable done_;           // Signaled by CompressLoop().
+  std::deque<Job*> queue_;           // Jobs to compress.
+  bool stopping_;
+  std::vector<boost::thread*> threads_;
+
+  DISALLOW_COPY_AND_ASSIGN(ParallelCompressor);
+};
+
+}  // namespace mapreduce_lite
+
+#endif  // MAPREDUCE_LITE_PARALLEL_COMPRESSOR_H_
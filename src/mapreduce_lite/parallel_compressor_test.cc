@@ -0,0 +1,64 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/mapreduce_lite/parallel_compressor.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "src/strutil/stringprintf.h"
+
+namespace mapreduce_lite {
+namespace {
+
+// A "compression" which takes different time for different blocks, so
+// blocks are done out of order.
+void Reverse(const std::string& data, std::string* block) {
+  for (int i = 0; i < (data.size() % 7) * 1000; ++i) {
+    block->assign(data.rbegin(), data.rend());
+  }
+  block->assign(data.rbegin(), data.rend());
+}
+
+}  // namespace
+
+TEST(ParallelCompressorTest, BlocksAreTakenInOrder) {
+  for (int num_threads = 0; num_threads <= 4; ++num_threads) {
+    ParallelCompressor compressor(Reverse, num_threads);
+    std::string data, block;
+    int next = 0;
+    for (int i = 0; i < 1000; ++i) {
+      data = StringPrintf("%d", i);
+      compressor.Add(&data);
+      EXPECT_TRUE(data.empty());
+      while (compressor.Take(&block, compressor.Full())) {
+        std::string expected = StringPrintf("%d", next++);
+        EXPECT_EQ(std::string(expected.rbegin(), expected.rend()), block);
+      }
+    }
+    while (compressor.Take(&block, true)) {
+      ++next;
+    }
+    EXPECT_EQ(1000, next);
+    EXPECT_FALSE(compressor.Take(&block, true));
+  }
+}
+
+}  // namespace mapreduce_lite
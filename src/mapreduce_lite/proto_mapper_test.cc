@@ -0,0 +1,87 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "src/mapreduce_lite/mapreduce_lite.h"
+#include "src/mapreduce_lite/protofile.pb.h"
+#include "src/mapreduce_lite/record_batch.h"
+
+namespace {
+
+using mapreduce_lite::KeyValuePair;
+using mapreduce_lite::RecordBatch;
+
+// Saves the value of each key-value pair.
+class PairValueMapper
+    : public mapreduce_lite::ProtoMapper<std::string, KeyValuePair> {
+ public:
+  virtual void MapProto(const std::string& key, const KeyValuePair& value) {
+    keys.push_back(key);
+    values.push_back(value.value());
+    pairs.push_back(&value);
+#if GOOGLE_PROTOBUF_VERSION >= 3000000
+    arenas.push_back(value.GetArena());
+#endif
+  }
+
+  std::vector<std::string> keys;
+  std::vector<std::string> values;
+  std::vector<const KeyValuePair*> pairs;
+#if GOOGLE_PROTOBUF_VERSION >= 3000000
+  std::vector<google::protobuf::Arena*> arenas;
+#endif
+};
+
+}  // namespace
+
+TEST(ProtoMapperTest, MapBatch) {
+  RecordBatch batch;
+  KeyValuePair pair;
+  for (int i = 0; i < 3; ++i) {
+    pair.set_value(std::string(i + 1, 'a'));
+    batch.Add("key", pair.SerializeAsString(), "");
+  }
+  pair.Clear();
+  batch.Add("empty", pair.SerializeAsString(), "");
+
+  PairValueMapper mapper;
+  mapper.MapBatch(batch);
+  ASSERT_EQ(4, mapper.values.size());
+  EXPECT_EQ("key", mapper.keys[0]);
+  EXPECT_EQ("a", mapper.values[0]);
+  EXPECT_EQ("aaa", mapper.values[2]);
+  EXPECT_EQ("empty", mapper.keys[3]);
+  EXPECT_EQ("", mapper.values[3]);
+#if GOOGLE_PROTOBUF_VERSION >= 3000000
+  // Value messages are allocated on the arena of the mapper.
+  EXPECT_TRUE(mapper.arenas[0] != NULL);
+  EXPECT_EQ(mapper.arenas[0], mapper.arenas[3]);
+#else
+  // The value message is reused.
+  EXPECT_EQ(mapper.pairs[0], mapper.pairs[3]);
+#endif
+
+  // A record which is not a KeyValuePair fails the job.
+  batch.Add("bad", "\xff\xff", "");
+  EXPECT_DEATH(mapper.MapBatch(batch), "Cannot parse a map input");
+}
@@ -19,6 +19,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
 //
 #include "src/mapreduce_lite/protofile.h"
 
+#include <string.h>
+
 #include <string>
 
 #include "src/base/common.h"
@@ -33,6 +35,116 @@ typedef ::google::protobuf::Message ProtoMessage;
 
 const int kMRMLRecordIOMaxRecordSize = 64*1024*1024;  // 64 MB
 
+//-----------------------------------------------------------------------------
+// Hand-written codec of a record, i.e., the record size and a
+// serialized KeyValuePair message.  Both fields of KeyValuePair are
+// length-delimited, so a field is a tag byte, a varint32 length and
+// the bytes.
+//-----------------------------------------------------------------------------
+static const int kWireTypeVarint = 0;
+static const int kWireTypeFixed64 = 1;
+static const int kWireTypeLengthDelimited = 2;
+static const int kWireTypeFixed32 = 5;
+
+static const char kKeyTag = (1 << 3) | kWireTypeLengthDelimited;
+static const char kValueTag = (2 << 3) | kWireTypeLengthDelimited;
+
+static int Varint32Size(uint32 value) {
+  int size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    ++size;
+  }
+  return size;
+}
+
+static void AppendVarint32(uint32 value, string* buffer) {
+  while (value >= 0x80) {
+    buffer->push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  buffer->push_back(static_cast<char>(value));
+}
+
+// Returns the byte after the varint, or NULL if it is malformed.
+static const char* DecodeVarint32(const char* p, const char* end,
+                                  uint32* value) {
+  uint32 result = 0;
+  for (int shift = 0; shift < 35 && p < end; shift += 7) {
+    uint32 byte = static_cast<unsigned char>(*p++);
+    result |= (byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      *value = result;
+      return p;
+    }
+  }
+  return NULL;
+}
+
+void AppendRecord(const char* key, int key_size,
+                  const char* value, int value_size,
+                  string* buffer) {
+  uint32 msg_size =
+      1 + Varint32Size(key_size) + key_size +
+      1 + Varint32Size(value_size) + value_size;
+  buffer->append(reinterpret_cast<char*>(&msg_size), sizeof(msg_size));
+  buffer->push_back(kKeyTag);
+  AppendVarint32(key_size, buffer);
+  buffer->append(key, key_size);
+  buffer->push_back(kValueTag);
+  AppendVarint32(value_size, buffer);
+  buffer->append(value, value_size);
+}
+
+// Decode a serialized KeyValuePair into views of the key and the
+// value.  A missing field is decoded as empty, and unknown fields are
+// skipped, as ParseFromArray does.  Returns false if msg is malformed.
+static bool DecodeKeyValuePair(const char* msg, int msg_size,
+                               const char** key, int* key_size,
+                               const char** value, int* value_size) {
+  const char* p = msg;
+  const char* end = msg + msg_size;
+  *key = *value = msg;
+  *key_size = *value_size = 0;
+  while (p < end) {
+    uint32 tag, length;
+    if ((p = DecodeVarint32(p, end, &tag)) == NULL) {
+      return false;
+    }
+    switch (tag & 7) {
+      case kWireTypeVarint:
+        p = DecodeVarint32(p, end, &length);
+        break;
+      case kWireTypeFixed64:
+        p = end - p >= 8 ? p + 8 : NULL;
+        break;
+      case kWireTypeFixed32:
+        p = end - p >= 4 ? p + 4 : NULL;
+        break;
+      case kWireTypeLengthDelimited:
+        if ((p = DecodeVarint32(p, end, &length)) == NULL ||
+            length > end - p) {
+          return false;
+        }
+        if (tag == kKeyTag) {
+          *key = p;
+          *key_size = length;
+        } else if (tag == kValueTag) {
+          *value = p;
+          *value_size = length;
+        }
+        p += length;
+        break;
+      default:
+        return false;
+    }
+    if (p == NULL) {
+      return false;
+    }
+  }
+  return true;
+}
+
 //-----------------------------------------------------------------------------
 // The following two specializations of function templates parse the read value
 // into either (1) an std::string object or (2) a protocol message.
@@ -70,13 +182,11 @@ void ParseKey<ProtoMessage>(KeyValuePair* pair, ProtoMessage* msg) {
 //-----------------------------------------------------------------------------
 // Given ParseKey and ParseValue, the following functiontemplate reads a record
 //-----------------------------------------------------------------------------
-template <class KeyType, class ValueType>
-bool ReadRecord(FILE* input_stream, KeyType* key, ValueType* value) {
+// Read the record size and the serialized KeyValuePair into buffer.
+static bool ReadMessage(FILE* input_stream, string* buffer) {
   uint32 encoded_msg_size;
-  CHECK_EQ(fread(reinterpret_cast<char*>(&encoded_msg_size), 
-		 sizeof(encoded_msg_size), 1, input_stream),
-	   1);
-  if (feof(input_stream) != 0 || ferror(input_stream) != 0) {
+  if (fread(reinterpret_cast<char*>(&encoded_msg_size),
+            sizeof(encoded_msg_size), 1, input_stream) != 1) {
     // Do not LOG(ERROR) here, because users do not want to be
     // bothered when they invoke this function in a loop, e.g.,
     // while(MRML_ReadRecord(...)), to probe the end of a record file.
@@ -92,15 +202,23 @@ bool ReadRecord(FILE* input_stream, KeyType* key, ValueType* value) {
                << __FILE__;
   }
 
-  static char buffer[kMRMLRecordIOMaxRecordSize];
-  CHECK_EQ(fread(buffer, encoded_msg_size, 1, input_stream), 1);
-  if (feof(input_stream) != 0 || ferror(input_stream) != 0) {
+  buffer->resize(encoded_msg_size);
+  if (encoded_msg_size > 0 &&
+      fread(&(*buffer)[0], encoded_msg_size, 1, input_stream) != 1) {
     LOG(ERROR) << "Error or unexpected EOF in reading protofile.";
     return false;
   }
+  return true;
+}
 
+template <class KeyType, class ValueType>
+bool ReadRecord(FILE* input_stream, KeyType* key, ValueType* value) {
+  string buffer;
+  if (!ReadMessage(input_stream, &buffer)) {
+    return false;
+  }
   KeyValuePair pair;
-  CHECK(pair.ParseFromArray(buffer, encoded_msg_size));
+  CHECK(pair.ParseFromString(buffer));
   ParseKey<KeyType>(&pair, key);
   ParseValue<ValueType>(&pair, value);
   return true;
@@ -112,7 +230,20 @@ bool ReadRecord(FILE* input_stream, KeyType* key, ValueType* value) {
 //-----------------------------------------------------------------------------
 
 bool ReadRecord(FILE* input, string* key, string* value) {
-  return ReadRecord<string, string>(input, key, value);
+  string buffer;
+  if (!ReadMessage(input, &buffer)) {
+    return false;
+  }
+  const char* key_data;
+  const char* value_data;
+  int key_size, value_size;
+  if (!DecodeKeyValuePair(buffer.data(), buffer.size(),
+                          &key_data, &key_size, &value_data, &value_size)) {
+    LOG(FATAL) << "Corrupted record in protofile.";
+  }
+  key->assign(key_data, key_size);
+  value->assign(value_data, value_size);
+  return true;
 }
 
 bool ReadRecord(FILE* input, string* key, ProtoMessage* value) {
@@ -165,6 +296,16 @@ void SerializeKey<ProtoMessage>(KeyValuePair* pair, const ProtoMessage& msg) {
 //-----------------------------------------------------------------------------
 // This function template saves a key-value pair.
 //-----------------------------------------------------------------------------
+// Write the record size and the serialized KeyValuePair in one call.
+static bool WriteRecordBuffer(FILE* output_stream, const string& record) {
+  size_t ntimes = fwrite(record.data(), record.size(), 1, output_stream);
+  if (ntimes != 1 || ferror(output_stream) != 0) {
+    LOG(ERROR) << "Failed in writing a record.";
+    return false;
+  }
+  return true;
+}
+
 template <class KeyType, class ValueType>
 bool WriteRecord(FILE* output_stream,
                  const KeyType& key,
@@ -172,26 +313,11 @@ bool WriteRecord(FILE* output_stream,
   KeyValuePair pair;
   SerializeKey<KeyType>(&pair, key);
   SerializeValue<ValueType>(&pair, value);
-  string encoded_msg;
-  CHECK(pair.SerializeToString(&encoded_msg));
-
-  uint32 msg_size = encoded_msg.size();
-  size_t ntimes = fwrite(reinterpret_cast<char*>(&msg_size), sizeof(msg_size),
-                         1, output_stream);
-
-  if (ntimes != 1 || ferror(output_stream) != 0) {
-    LOG(ERROR) << "Failed in writing a record size.";
-    return false;
-  }
-
-  ntimes = fwrite(const_cast<char*>(encoded_msg.data()), msg_size,
-                  1, output_stream);
-
-  if (ntimes != 1 || ferror(output_stream) != 0) {
-    LOG(ERROR) << "Failed in writing a record.";
-    return false;
-  }
-  return true;
+  string record;
+  AppendRecord(pair.key().data(), pair.key().size(),
+               pair.value().data(), pair.value().size(),
+               &record);
+  return WriteRecordBuffer(output_stream, record);
 }
 
 //-----------------------------------------------------------------------------
@@ -200,7 +326,9 @@ bool WriteRecord(FILE* output_stream,
 //-----------------------------------------------------------------------------
 
 bool WriteRecord(FILE* output, const string& key, const string& value) {
-  return WriteRecord<string, string>(output, key, value);
+  string record;
+  AppendRecord(key.data(), key.size(), value.data(), value.size(), &record);
+  return WriteRecordBuffer(output, record);
 }
 
 bool WriteRecord(FILE* output, const string& key, const ProtoMessage& value) {
@@ -217,4 +345,129 @@ bool WriteRecord(FILE* output, const ProtoMessage& key,
 }
 
 }  // namespace protofile
+
+//-----------------------------------------------------------------------------
+// Implementation of ProtofileReader
+//-----------------------------------------------------------------------------
+static const int kProtofileBufferSize = 1024 * 1024;  // 1 MB
+
+ProtofileReader::ProtofileReader(FILE* input)
+    : input_(input),
+      buffer_(kProtofileBufferSize, '\0'),
+      begin_(0),
+      end_(0) {}
+
+bool ProtofileReader::Fill(int size) {
+  if (end_ - begin_ >= size) {
+    return true;
+  }
+  if (begin_ > 0) {
+    memmove(&buffer_[0], buffer_.data() + begin_, end_ - begin_);
+    end_ -= begin_;
+    begin_ = 0;
+  }
+  if (size > buffer_.size()) {
+    buffer_.resize(size);
+  }
+  while (end_ < size) {
+    size_t n = fread(&buffer_[end_], 1, buffer_.size() - end_, input_);
+    if (n == 0) {
+      return false;
+    }
+    end_ += n;
+  }
+  return true;
+}
+
+bool ProtofileReader::ReadView(const char** key, int* key_size,
+                               const char** value, int* value_size) {
+  uint32 msg_size;
+  if (!Fill(sizeof(msg_size))) {
+    if (begin_ < end_) {
+      LOG(ERROR) << "Unexpected EOF in reading protofile.";
+    }
+    return false;
+  }
+  memcpy(&msg_size, buffer_.data() + begin_, sizeof(msg_size));
+  if (msg_size > protofile::kMRMLRecordIOMaxRecordSize) {
+    LOG(FATAL) << "Failed to read a proto message with size = " << msg_size
+               << ", which is larger than kMRMLRecordIOMaxRecordSize ("
+               << protofile::kMRMLRecordIOMaxRecordSize << ").";
+  }
+  if (!Fill(sizeof(msg_size) + msg_size)) {
+    LOG(ERROR) << "Unexpected EOF in reading protofile.";
+    return false;
+  }
+  if (!protofile::DecodeKeyValuePair(buffer_.data() + begin_ + sizeof(msg_size),
+                                     msg_size,
+                                     key, key_size, value, value_size)) {
+    LOG(FATAL) << "Corrupted record in protofile.";
+  }
+  begin_ += sizeof(msg_size) + msg_size;
+  return true;
+}
+
+bool ProtofileReader::Read(std::string* key, std::string* value) {
+  const char* key_data;
+  const char* value_data;
+  int key_size, value_size;
+  if (!ReadView(&key_data, &key_size, &value_data, &value_size)) {
+    return false;
+  }
+  key->assign(key_data, key_size);
+  value->assign(value_data, value_size);
+  return true;
+}
+
+bool ProtofileReader::ReadBatch(RecordBatch* batch,
+                                int max_records, int max_bytes) {
+  const char* key;
+  const char* value;
+  int key_size, value_size;
+  while (batch->Size() < max_records && batch->ByteSize() < max_bytes) {
+    if (!ReadView(&key, &key_size, &value, &value_size)) {
+      return false;
+    }
+    batch->Add(key, key_size, value, value_size, "", 0);
+  }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of ProtofileWriter
+//-----------------------------------------------------------------------------
+ProtofileWriter::ProtofileWriter(FILE* output)
+    : output_(output),
+      failed_(false) {
+  buffer_.reserve(kProtofileBufferSize);
+}
+
+ProtofileWriter::~ProtofileWriter() {
+  Flush();
+}
+
+bool ProtofileWriter::Write(const char* key, int key_size,
+                            const char* value, int value_size) {
+  protofile::AppendRecord(key, key_size, value, value_size, &buffer_);
+  if (buffer_.size() >= kProtofileBufferSize) {
+    return Flush();
+  }
+  return !failed_;
+}
+
+bool ProtofileWriter::Write(const std::string& key, const std::string& value) {
+  return Write(key.data(), key.size(), value.data(), value.size());
+}
+
+bool ProtofileWriter::Flush() {
+  if (!buffer_.empty()) {
+    if (fwrite(buffer_.data(), buffer_.size(), 1, output_) != 1) {
+      LOG(ERROR) << "Failed in writing protofile records.";
+      failed_ = true;
+    }
+    buffer_.clear();
+  }
+  return !failed_;
+}
+
 }  // namespace mapreduce_lite
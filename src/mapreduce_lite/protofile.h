@@ -32,6 +32,13 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
 // We also added an enhancement: to allow both key and value serializations
 // of proto messages.
 //
+// ReadRecord and WriteRecord parse and serialize a KeyValuePair
+// message per record, and access the file twice per record.  For
+// reading and writing many records of string keys and values, use
+// ProtofileReader and ProtofileWriter, which read and write the same
+// format through large per-instance buffers, and encode and decode the
+// two fields of KeyValuePair by hand.
+//
 #ifndef MAPREDUCE_LITE_PROTOFILE_H_
 #define MAPREDUCE_LITE_PROTOFILE_H_
 
@@ -39,6 +46,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
 
 #include <string>
 
+#include "src/base/common.h"
+#include "src/mapreduce_lite/record_batch.h"
+
 namespace google {
 namespace protobuf {
 class Message;
@@ -74,7 +84,62 @@ bool WriteRecord(FILE* output,
                  const ::google::protobuf::Message& key,
                  const ::google::protobuf::Message& value);
 
+// Append a record of key and value to buffer, as WriteRecord would
+// write it.
+void AppendRecord(const char* key, int key_size,
+                  const char* value, int value_size,
+                  std::string* buffer);
+
 }  // namespace protofile
+
+class ProtofileReader {
+ public:
+  // Reads from input, which is not owned by the reader.
+  explicit ProtofileReader(FILE* input);
+
+  // Returns the key and value of the next record as views into the
+  // buffer of the reader, which are valid until the next read.
+  // Returns false at the end of file or if the file is truncated.
+  bool ReadView(const char** key, int* key_size,
+                const char** value, int* value_size);
+
+  bool Read(std::string* key, std::string* value);
+  bool ReadBatch(RecordBatch* batch, int max_records, int max_bytes);
+
+ private:
+  // Ensure there are at least size bytes from begin_ in buffer_.
+  // Returns false if the file ends before that.
+  bool Fill(int size);
+
+  FILE* input_;
+  std::string buffer_;
+  int begin_;                  // The unread bytes are buffer_[begin_, end_).
+  int end_;
+
+  DISALLOW_COPY_AND_ASSIGN(ProtofileReader);
+};
+
+class ProtofileWriter {
+ public:
+  // Writes to output, which is not owned by the writer.
+  explicit ProtofileWriter(FILE* output);
+  ~ProtofileWriter();  // Invokes Flush().
+
+  bool Write(const char* key, int key_size, const char* value, int value_size);
+  bool Write(const std::string& key, const std::string& value);
+
+  // Write buffered records to output.  Returns false if any write
+  // failed.
+  bool Flush();
+
+ private:
+  FILE* output_;
+  std::string buffer_;
+  bool failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(ProtofileWriter);
+};
+
 }  // namespace mapreduce_lite
 
 #endif  // MAPREDUCE_LITE_PROTOFILE_H_
@@ -18,6 +18,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
 // Author: Yi Wang (yiwang@tencent.com)
 //
 #include <stdio.h>
+#include <unistd.h>
+
 #include <string>
 
 #include "gtest/gtest.h"
@@ -25,6 +27,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
 #include "src/base/common.h"
 #include "src/mapreduce_lite/protofile.h"
 #include "src/mapreduce_lite/protofile.pb.h"
+#include "src/strutil/stringprintf.h"
 
 namespace mapreduce_lite {
 namespace protofile {
@@ -66,3 +69,113 @@ TEST(ProtofileTest, LocalRecordIO) {
   static const char* kFilename = "/tmp/ProtofileTestLocalRecordIO";
   mapreduce_lite::protofile::CheckWriteReadConsistency(kFilename);
 }
+
+namespace {
+
+const char* kCodecFilename = "/tmp/ProtofileTestCodec";
+const int kNumRecords = 100000;
+
+std::string Key(int i) { return i % 7 == 0 ? "" : StringPrintf("key-%d", i); }
+std::string Value(int i) { return std::string(i % 300, 'a' + i % 26); }
+
+}  // namespace
+
+TEST(ProtofileTest, WriterIsCompatibleWithReadRecord) {
+  using mapreduce_lite::KeyValuePair;
+  using mapreduce_lite::protofile::kTestKey;
+  using mapreduce_lite::protofile::kTestValue;
+  FILE* file = fopen(kCodecFilename, "w");
+  CHECK(file != NULL);
+  {
+    mapreduce_lite::ProtofileWriter writer(file);
+    for (int i = 0; i < kNumRecords; ++i) {
+      EXPECT_TRUE(writer.Write(Key(i), Value(i)));
+    }
+    std::string large_value(3 * 1024 * 1024, 'x');
+    EXPECT_TRUE(writer.Write("large", large_value));
+    KeyValuePair pair;
+    pair.set_key(kTestKey);
+    pair.set_value(kTestValue);
+    EXPECT_TRUE(writer.Write(kTestKey, pair.SerializeAsString()));
+  }
+  fclose(file);
+
+  CHECK((file = fopen(kCodecFilename, "r")) != NULL);
+  std::string key, value;
+  KeyValuePair pair;
+  for (int i = 0; i < kNumRecords; ++i) {
+    ASSERT_TRUE(mapreduce_lite::protofile::ReadRecord(file, &key, &value));
+    EXPECT_EQ(Key(i), key);
+    EXPECT_EQ(Value(i), value);
+  }
+  ASSERT_TRUE(mapreduce_lite::protofile::ReadRecord(file, &key, &value));
+  EXPECT_EQ(3 * 1024 * 1024, value.size());
+  ASSERT_TRUE(mapreduce_lite::protofile::ReadRecord(file, &key, &pair));
+  EXPECT_EQ(kTestKey, key);
+  EXPECT_EQ(kTestKey, pair.key());
+  EXPECT_EQ(kTestValue, pair.value());
+  EXPECT_FALSE(mapreduce_lite::protofile::ReadRecord(file, &key, &value));
+  fclose(file);
+  remove(kCodecFilename);
+}
+
+TEST(ProtofileTest, ReaderIsCompatibleWithWriteRecord) {
+  using mapreduce_lite::KeyValuePair;
+  FILE* file = fopen(kCodecFilename, "w");
+  CHECK(file != NULL);
+  for (int i = 0; i < kNumRecords; ++i) {
+    mapreduce_lite::protofile::WriteRecord(file, Key(i), Value(i));
+  }
+  // A record whose key field is missing.
+  KeyValuePair pair;
+  pair.set_value("value only");
+  std::string record;
+  pair.SerializeToString(&record);
+  uint32 record_size = record.size();
+  fwrite(&record_size, sizeof(record_size), 1, file);
+  fwrite(record.data(), record.size(), 1, file);
+  std::string large_value(3 * 1024 * 1024, 'x');
+  mapreduce_lite::protofile::WriteRecord(file, "large", large_value);
+  fclose(file);
+
+  CHECK((file = fopen(kCodecFilename, "r")) != NULL);
+  mapreduce_lite::ProtofileReader reader(file);
+  std::string key, value;
+  for (int i = 0; i < kNumRecords / 2; ++i) {
+    ASSERT_TRUE(reader.Read(&key, &value));
+    EXPECT_EQ(Key(i), key);
+    EXPECT_EQ(Value(i), value);
+  }
+  mapreduce_lite::RecordBatch batch;
+  EXPECT_FALSE(reader.ReadBatch(&batch, kNumRecords, 16 * 1024 * 1024));
+  ASSERT_EQ(kNumRecords - kNumRecords / 2 + 2, batch.Size());
+  for (int i = 0; i < kNumRecords - kNumRecords / 2; ++i) {
+    EXPECT_EQ(Key(kNumRecords / 2 + i), batch.Key(i));
+    EXPECT_EQ(Value(kNumRecords / 2 + i), batch.Value(i));
+  }
+  int last = batch.Size() - 2;
+  EXPECT_EQ("", batch.Key(last));
+  EXPECT_EQ("value only", batch.Value(last));
+  EXPECT_EQ("large", batch.Key(last + 1));
+  EXPECT_EQ(large_value, batch.Value(last + 1));
+  fclose(file);
+  remove(kCodecFilename);
+}
+
+TEST(ProtofileTest, ReaderStopsAtTruncatedRecord) {
+  FILE* file = fopen(kCodecFilename, "w");
+  CHECK(file != NULL);
+  mapreduce_lite::protofile::WriteRecord(file, "key", "value");
+  mapreduce_lite::protofile::WriteRecord(file, "key", "value");
+  int64 size = ftell(file);
+  fclose(file);
+  ASSERT_EQ(0, truncate(kCodecFilename, size - 1));
+
+  CHECK((file = fopen(kCodecFilename, "r")) != NULL);
+  mapreduce_lite::ProtofileReader reader(file);
+  std::string key, value;
+  EXPECT_TRUE(reader.Read(&key, &value));
+  EXPECT_FALSE(reader.Read(&key, &value));
+  fclose(file);
+  remove(kCodecFilename);
+}
@@ -19,11 +19,20 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
 
 #include "src/mapreduce_lite/reader.h"
 
+#include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "boost/filesystem.hpp"
+#include "zlib.h"
 
 #include "src/base/common.h"
-#include "src/mapreduce_lite/protofile.h"
+#include "src/mapreduce_lite/flags.h"
 #include "src/mapreduce_lite/utils.h"
 #include "src/strutil/stringprintf.h"
 
@@ -36,9 +45,48 @@ DEFINE_int32(mr_max_input_line_length,
 
 namespace mapreduce_lite {
 
+// GzipTextReader reads and decompresses in chunks of this size.
+static const int kGzipChunkSize = 256 * 1024;             // 256 KB
+
 CLASS_REGISTER_IMPLEMENT_REGISTRY(mapreduce_lite_reader_registry, Reader);
 REGISTER_READER("text", TextReader);
+REGISTER_READER("mmap_text", MmapTextReader);
+REGISTER_READER("gzip_text", GzipTextReader);
+REGISTER_READER("bgzf_text", BgzfTextReader);
 REGISTER_READER("protofile", ProtoRecordReader);
+REGISTER_READER("blockfile", BlockFileRecordReader);
+
+void ListInputSplits(const std::vector<std::string>& filenames,
+                     int64 split_size,
+                     std::vector<InputSplit>* splits) {
+  splits->clear();
+  for (int i = 0; i < filenames.size(); ++i) {
+    int64 file_size = boost::filesystem::file_size(filenames[i]);
+    int64 step = split_size > 0 ? split_size : file_size;
+    for (int64 begin = 0; begin < file_size; begin += step) {
+      InputSplit split;
+      split.filename = filenames[i];
+      split.begin = begin;
+      split.end = std::min(begin + step, file_size);
+      splits->push_back(split);
+    }
+  }
+}
+
+void SelectInputSplits(const std::vector<InputSplit>& splits,
+                       bool split_files,
+                       int num_readers,
+                       int reader_id,
+                       std::vector<InputSplit>* my_splits) {
+  if (!split_files) {
+    *my_splits = splits;
+    return;
+  }
+  my_splits->clear();
+  for (int i = reader_id; i < splits.size(); i += num_readers) {
+    my_splits->push_back(splits[i]);
+  }
+}
 
 //-----------------------------------------------------------------------------
 // Implementation of Reader
@@ -47,6 +95,31 @@ void Reader::Open(const std::string& source_name) {
   Close();  // Ensure to close pre-opened file.
   input_filename_ = source_name;
   input_stream_ = OpenFileOrDie(source_name.c_str(), "r");
+  // Double the read-ahead window of the kernel.
+  posix_fadvise(fileno(input_stream_), 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+bool Reader::ReadBatch(RecordBatch* batch, int max_records, int max_bytes) {
+  batch->set_filename(input_filename_);
+  std::string key, value;
+  while (batch->Size() < max_records && batch->ByteSize() < max_bytes) {
+    if (!Read(&key, &value)) {
+      return false;
+    }
+    if (!key.empty()) {
+      batch->Add(key, value, "");
+    } else if (LazyKeyOffset() >= 0) {
+      batch->AddWithOffset(value.data(), value.size(), LazyKeyOffset());
+    } else {
+      batch->Add(key, value, LazyKey());
+    }
+  }
+  return true;
+}
+
+void Reader::OpenSplit(const std::string& source_name,
+                       int64 begin, int64 end) {
+  LOG(FATAL) << "This reader cannot read a split of " << source_name;
 }
 
 void Reader::Close() {
@@ -61,7 +134,8 @@ void Reader::Close() {
 //-----------------------------------------------------------------------------
 TextReader::TextReader()
     : line_num_(0),
-      reading_a_long_line_(false) {
+      reading_a_long_line_(false),
+      end_(-1) {
   try {
     CHECK_LT(1, FLAGS_mr_max_input_line_length);
     line_.reset(new char[FLAGS_mr_max_input_line_length]);
@@ -70,13 +144,39 @@ TextReader::TextReader()
   }
 }
 
+void TextReader::Open(const std::string& source_name) {
+  Reader::Open(source_name);
+  reading_a_long_line_ = false;
+  end_ = -1;
+}
+
+void TextReader::OpenSplit(const std::string& source_name,
+                           int64 begin, int64 end) {
+  Open(source_name);
+  end_ = end;
+  if (begin > 0) {
+    // Skip the line crossing begin.  If the byte before begin is '\n',
+    // a line begins exactly at begin and nothing is skipped.
+    if (fseeko(input_stream_, begin - 1, SEEK_SET) != 0) {
+      LOG(FATAL) << "Cannot seek to " << begin - 1 << " in " << source_name;
+    }
+    int c;
+    while ((c = getc(input_stream_)) != EOF && c != '\n') {
+    }
+  }
+}
+
 bool TextReader::Read(std::string* key, std::string* value) {
   if (input_stream_ == NULL) {
     return false;
   }
 
-  SStringPrintf(key, "%s-%010lld",
-                input_filename_.c_str(), ftell(input_stream_));
+  int64 offset = ftello(input_stream_);
+  if (end_ >= 0 && offset >= end_ && !reading_a_long_line_) {
+    return false;  // The next line belongs to the next split.
+  }
+  SStringPrintf(key, "%s-%010lld", input_filename_.c_str(),
+                static_cast<long long>(offset));
   value->clear();
 
   if (fgets(line_.get(), FLAGS_mr_max_input_line_length, input_stream_)
@@ -111,14 +211,316 @@ bool TextReader::Read(std::string* key, std::string* value) {
   return true;
 }
 
+//-----------------------------------------------------------------------------
+// Implementation of MmapTextReader
+//-----------------------------------------------------------------------------
+MmapTextReader::MmapTextReader()
+    : data_(NULL), size_(0), end_(0), offset_(0), record_offset_(0) {}
+
+MmapTextReader::~MmapTextReader() {
+  Close();
+}
+
+void MmapTextReader::Open(const std::string& source_name) {
+  Close();  // Ensure to unmap pre-opened file.
+  input_filename_ = source_name;
+
+  int fd = open(source_name.c_str(), O_RDONLY);
+  struct stat file_stat;
+  if (fd < 0 || fstat(fd, &file_stat) < 0) {
+    LOG(FATAL) << "Cannot open file: " << source_name;
+  }
+  size_ = file_stat.st_size;
+  if (size_ > 0) {
+    void* data = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      LOG(FATAL) << "Cannot mmap file: " << source_name;
+    }
+    madvise(data, size_, MADV_SEQUENTIAL);
+    data_ = reinterpret_cast<const char*>(data);
+  }
+  close(fd);  // The mapping remains valid.
+  end_ = size_;
+}
+
+void MmapTextReader::OpenSplit(const std::string& source_name,
+                               int64 begin, int64 end) {
+  Open(source_name);
+  end_ = std::min<size_t>(end, size_);
+  if (begin >= size_) {
+    // The split is past the end, e.g., the file shrank after splits
+    // were listed, so it is empty.
+    offset_ = end_;
+  } else if (begin > 0) {
+    // Skip the line crossing begin.  If the byte before begin is '\n',
+    // a line begins exactly at begin and nothing is skipped.
+    const char* newline = reinterpret_cast<const char*>(
+        memchr(data_ + begin - 1, '\n', size_ - begin + 1));
+    offset_ = (newline != NULL) ? newline - data_ + 1 : size_;
+  }
+}
+
+void MmapTextReader::Close() {
+  if (data_ != NULL) {
+    munmap(const_cast<char*>(data_), size_);
+    data_ = NULL;
+  }
+  size_ = 0;
+  end_ = 0;
+  offset_ = 0;
+  record_offset_ = 0;
+}
+
+const char* MmapTextReader::NextLine(int* length) {
+  // memchr of glibc scans with vector instructions.
+  const char* begin = data_ + offset_;
+  const char* newline = reinterpret_cast<const char*>(
+      memchr(begin, '\n', size_ - offset_));
+  *length = (newline != NULL) ? newline - begin : size_ - offset_;
+
+  record_offset_ = offset_;
+  offset_ += *length + 1;  // Skip the '\n'.
+  if (*length > 0 && begin[*length - 1] == '\r') {  // Handle DOS text format.
+    --*length;
+  }
+  return begin;
+}
+
+bool MmapTextReader::Read(std::string* key, std::string* value) {
+  if (data_ == NULL || offset_ >= end_) {
+    return false;
+  }
+  int length;
+  const char* line = NextLine(&length);
+  key->clear();
+  value->assign(line, length);
+  return true;
+}
+
+bool MmapTextReader::ReadBatch(RecordBatch* batch,
+                               int max_records, int max_bytes) {
+  batch->set_filename(input_filename_);
+  while (batch->Size() < max_records && batch->ByteSize() < max_bytes) {
+    if (data_ == NULL || offset_ >= end_) {
+      return false;
+    }
+    int length;
+    const char* line = NextLine(&length);
+    batch->AddWithOffset(line, length, record_offset_);
+  }
+  return true;
+}
+
+std::string MmapTextReader::LazyKey() const {
+  return TextLineKey(input_filename_, record_offset_);
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of CompressedTextReader
+//-----------------------------------------------------------------------------
+CompressedTextReader::CompressedTextReader()
+    : begin_(0), scanned_(0), buffer_offset_(0), record_offset_(0),
+      eof_(false) {}
+
+void CompressedTextReader::Open(const std::string& source_name) {
+  Reader::Open(source_name);
+  buffer_.clear();
+  begin_ = scanned_ = 0;
+  buffer_offset_ = record_offset_ = 0;
+  eof_ = false;
+}
+
+bool CompressedTextReader::Read(std::string* key, std::string* value) {
+  if (input_stream_ == NULL) {
+    return false;
+  }
+  size_t end;
+  while (true) {
+    const char* newline = static_cast<const char*>(
+        memchr(buffer_.data() + scanned_, '\n', buffer_.size() - scanned_));
+    if (newline != NULL) {
+      end = newline - buffer_.data();
+      break;
+    }
+    scanned_ = buffer_.size();
+    if (begin_ > 0) {  // Drop lines read before.
+      buffer_.erase(0, begin_);
+      buffer_offset_ += begin_;
+      scanned_ -= begin_;
+      begin_ = 0;
+    }
+    if (eof_ || !Decompress(&buffer_)) {
+      eof_ = true;
+      if (begin_ == buffer_.size()) {
+        return false;
+      }
+      end = buffer_.size();  // The last line without '\n'.
+      break;
+    }
+  }
+
+  record_offset_ = buffer_offset_ + begin_;
+  size_t line_end = end;
+  if (line_end > begin_ && buffer_[line_end - 1] == '\r') {
+    --line_end;
+  }
+  key->clear();
+  value->assign(buffer_, begin_, line_end - begin_);
+  begin_ = scanned_ = std::min(end + 1, buffer_.size());
+  return true;
+}
+
+std::string CompressedTextReader::LazyKey() const {
+  return TextLineKey(input_filename_, record_offset_);
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of GzipTextReader
+//-----------------------------------------------------------------------------
+GzipTextReader::GzipTextReader()
+    : input_(kGzipChunkSize, '\0'),
+      member_ended_(true) {}
+
+GzipTextReader::~GzipTextReader() {
+  Close();
+}
+
+void GzipTextReader::Open(const std::string& source_name) {
+  CompressedTextReader::Open(source_name);
+  stream_.reset(new z_stream);
+  memset(stream_.get(), 0, sizeof(*stream_));
+  // Decode the gzip header and trailer.
+  if (inflateInit2(stream_.get(), 16 + MAX_WBITS) != Z_OK) {
+    LOG(FATAL) << "Cannot initialize zlib for " << source_name;
+  }
+  member_ended_ = true;
+}
+
+void GzipTextReader::Close() {
+  if (stream_.get() != NULL) {
+    inflateEnd(stream_.get());
+    stream_.reset(NULL);
+  }
+  Reader::Close();
+}
+
+bool GzipTextReader::Decompress(std::string* buffer) {
+  if (stream_.get() == NULL) {
+    return false;
+  }
+  while (true) {
+    if (stream_->avail_in == 0) {
+      size_t size = fread(&input_[0], 1, input_.size(), input_stream_);
+      if (size == 0) {
+        if (!member_ended_) {
+          LOG(FATAL) << "Unexpected EOF in gzip file: " << input_filename_;
+        }
+        return false;
+      }
+      stream_->next_in = reinterpret_cast<Bytef*>(&input_[0]);
+      stream_->avail_in = size;
+    }
+    if (member_ended_) {  // Another member follows.
+      inflateReset(stream_.get());
+      member_ended_ = false;
+    }
+
+    size_t size = buffer->size();
+    buffer->resize(size + kGzipChunkSize);
+    stream_->next_out = reinterpret_cast<Bytef*>(&(*buffer)[size]);
+    stream_->avail_out = kGzipChunkSize;
+    int result = inflate(stream_.get(), Z_NO_FLUSH);
+    buffer->resize(size + kGzipChunkSize - stream_->avail_out);
+    if (result == Z_STREAM_END) {
+      member_ended_ = true;
+    } else if (result != Z_OK && result != Z_BUF_ERROR) {
+      LOG(FATAL) << "Corrupted gzip file: " << input_filename_;
+    }
+    if (buffer->size() > size) {
+      return true;
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of BgzfTextReader
+//-----------------------------------------------------------------------------
+void BgzfTextReader::Open(const std::string& source_name) {
+  CompressedTextReader::Open(source_name);
+  blocks_.reset(new BgzfBlockReader(input_stream_, NumCodecThreads()));
+}
+
+void BgzfTextReader::Close() {
+  blocks_.reset(NULL);
+  Reader::Close();
+}
+
+bool BgzfTextReader::Decompress(std::string* buffer) {
+  if (blocks_.get() == NULL || !blocks_->Next(&block_)) {
+    return false;
+  }
+  buffer->append(block_);
+  return true;
+}
+
 //-----------------------------------------------------------------------------
 // Implementation of ProtoRecordReader
 //-----------------------------------------------------------------------------
+void ProtoRecordReader::Open(const std::string& source_name) {
+  Reader::Open(source_name);
+  reader_.reset(new ProtofileReader(input_stream_));
+}
+
+void ProtoRecordReader::Close() {
+  reader_.reset(NULL);
+  Reader::Close();
+}
+
 bool ProtoRecordReader::Read(std::string* key, std::string* value) {
-  if (input_stream_ == NULL) {
+  if (reader_.get() == NULL) {
+    return false;
+  }
+  return reader_->Read(key, value);
+}
+
+bool ProtoRecordReader::ReadBatch(RecordBatch* batch,
+                                  int max_records, int max_bytes) {
+  if (reader_.get() == NULL) {
     return false;
   }
-  return protofile::ReadRecord(input_stream_, key, value);
+  return reader_->ReadBatch(batch, max_records, max_bytes);
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of BlockFileRecordReader
+//-----------------------------------------------------------------------------
+BlockFileRecordReader::BlockFileRecordReader()
+    : reader_(SkipCorruptedBlocks()) {}
+
+void BlockFileRecordReader::Open(const std::string& source_name) {
+  input_filename_ = source_name;
+  if (!reader_.Open(source_name)) {
+    LOG(FATAL) << "Cannot open blockfile: " << source_name;
+  }
+}
+
+void BlockFileRecordReader::Close() {
+  reader_.Close();
+}
+
+void BlockFileRecordReader::OpenSplit(const std::string& source_name,
+                                      int64 begin, int64 end) {
+  Open(source_name);
+  reader_.SeekToSplit(begin, end);
+}
+
+bool BlockFileRecordReader::Read(std::string* key, std::string* value) {
+  return reader_.Read(key, value);
+}
+
+bool BlockFileRecordReader::ReadBatch(RecordBatch* batch,
+                                      int max_records, int max_bytes) {
+  return reader_.ReadBatch(batch, max_records, max_bytes);
 }
 
 }  // namespace mapreduce_lite
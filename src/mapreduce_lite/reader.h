@@ -17,20 +17,55 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
 // Copyright 2010 Tencent Inc.
 // Author: Yi Wang (yiwang@tencent.com)
 //
-// Define the interface of Reader and two standard readers: TextReader
-// and ProtoRecordReader.
+// Define the interface of Reader and standard readers: TextReader,
+// MmapTextReader, ProtoRecordReader and BlockFileRecordReader.
 //
 #ifndef MAPREDUCE_LITE_READERS_H_
 #define MAPREDUCE_LITE_READERS_H_
 
 #include <stdio.h>
 #include <string>
+#include <vector>
 
 #include "src/base/class_register.h"
+#include "src/base/common.h"
 #include "src/base/scoped_ptr.h"
+#include "src/mapreduce_lite/bgzf.h"
+#include "src/mapreduce_lite/blockfile.h"
+#include "src/mapreduce_lite/protofile.h"
+#include "src/mapreduce_lite/record_batch.h"
+
+struct z_stream_s;
 
 namespace mapreduce_lite {
 
+//-----------------------------------------------------------------------------
+// A byte range [begin, end) of an input file, which is mapped
+// separately from other ranges of the same file.
+//-----------------------------------------------------------------------------
+struct InputSplit {
+  std::string filename;
+  int64 begin;
+  int64 end;
+};
+
+// Divide each of filenames into splits of split_size bytes, except for
+// the last split of a file, which might be shorter.  If split_size is
+// not positive, each file is a split.  An empty file has no split.
+void ListInputSplits(const std::vector<std::string>& filenames,
+                     int64 split_size,
+                     std::vector<InputSplit>* splits);
+
+// Select the splits mapped by the reader_id-th of num_readers map
+// workers, which share splits round-robin.  If split_files is false,
+// splitting is off and each map worker maps all splits of its own
+// files, which might be local files different from other workers'.
+void SelectInputSplits(const std::vector<InputSplit>& splits,
+                       bool split_files,
+                       int num_readers,
+                       int reader_id,
+                       std::vector<InputSplit>* my_splits);
+
 //-----------------------------------------------------------------------------
 // The interface implemented by ``real'' readers.
 //-----------------------------------------------------------------------------
@@ -46,6 +81,31 @@ class Reader {
   // further reading operations should be performed.
   virtual bool Read(std::string* key, std::string* value) = 0;
 
+  // Append records to batch until it has max_records records or
+  // max_bytes bytes.  Returns false if no further reading operations
+  // should be performed, possibly after appending some records.  The
+  // default implementation invokes Read() per record, and keeps the
+  // lazy key by LazyKeyOffset() if possible, or LazyKey().
+  virtual bool ReadBatch(RecordBatch* batch, int max_records, int max_bytes);
+
+  // Readers of formats, where a record boundary can be found from any
+  // offset, support reading a split.  OpenSplit() opens source_name to
+  // read records beginning in [begin, end): the record crossing begin
+  // is skipped, as it belongs to the previous split, and the record
+  // crossing end is read to its end.
+  virtual bool SupportsSplit() const { return false; }
+  virtual void OpenSplit(const std::string& source_name,
+                         int64 begin, int64 end);
+
+  // For efficiency, a reader may leave the key empty in Read(), and
+  // build the key of the last read record only if this is invoked.
+  virtual std::string LazyKey() const { return ""; }
+
+  // Readers whose LazyKey() is TextLineKey(filename, offset) return
+  // the offset, so that ReadBatch() keeps it instead of the key (see
+  // RecordBatch).  Other readers return -1.
+  virtual int64 LazyKeyOffset() const { return -1; }
+
  protected:
   std::string input_filename_;
   FILE* input_stream_;
@@ -63,11 +123,120 @@ class Reader {
 class TextReader : public Reader {
  public:
   TextReader();
+  virtual void Open(const std::string& source_name);
   virtual bool Read(std::string* key, std::string* value);
+  virtual bool SupportsSplit() const { return true; }
+  virtual void OpenSplit(const std::string& source_name,
+                         int64 begin, int64 end);
  private:
   scoped_array<char> line_;      // input line buffer
   int line_num_;                 // count line number
   bool reading_a_long_line_;     // is reading a lone line
+  int64 end_;                    // no line begins at or after end_
+};
+
+
+//-----------------------------------------------------------------------------
+// Read each record as a line in a text file, which is mapped into
+// memory.  Compared with TextReader:
+// - Read() returns an empty key.  The key, "filename-offset", is built
+//   only if LazyKey() is invoked.
+// - Lines of any length are returned.
+// - A last line without the ending '\n' is returned as well.
+//-----------------------------------------------------------------------------
+class MmapTextReader : public Reader {
+ public:
+  MmapTextReader();
+  virtual ~MmapTextReader();
+
+  virtual void Open(const std::string& source_name);
+  virtual void Close();
+  virtual bool Read(std::string* key, std::string* value);
+  virtual bool ReadBatch(RecordBatch* batch, int max_records, int max_bytes);
+  virtual std::string LazyKey() const;
+  virtual int64 LazyKeyOffset() const { return record_offset_; }
+  virtual bool SupportsSplit() const { return true; }
+  virtual void OpenSplit(const std::string& source_name,
+                         int64 begin, int64 end);
+
+ private:
+  const char* data_;       // The mapped file, or NULL if it is empty.
+  size_t size_;
+  size_t end_;             // No line begins at or after end_.
+  size_t offset_;          // The beginning of the next line.
+  size_t record_offset_;   // The beginning of the last read line.
+
+  // Returns the beginning and length of the next line, without the
+  // ending "\r\n" or "\n", and moves offset_ to the line after it.
+  const char* NextLine(int* length);
+};
+
+
+//-----------------------------------------------------------------------------
+// The base of readers of compressed text files, which read each line
+// as a record like MmapTextReader: Read() returns an empty key, and
+// LazyKey() returns "filename-offset", where offset is in the
+// decompressed file.  Compressed files cannot be split.
+//-----------------------------------------------------------------------------
+class CompressedTextReader : public Reader {
+ public:
+  CompressedTextReader();
+  virtual void Open(const std::string& source_name);
+  virtual bool Read(std::string* key, std::string* value);
+  virtual std::string LazyKey() const;
+  virtual int64 LazyKeyOffset() const { return record_offset_; }
+
+ protected:
+  // Append more decompressed data to buffer.  Returns false at the end
+  // of file, and dies if the file is truncated or corrupted.
+  virtual bool Decompress(std::string* buffer) = 0;
+
+ private:
+  std::string buffer_;     // Decompressed data.
+  size_t begin_;           // The beginning of the next line in buffer_.
+  size_t scanned_;         // There is no '\n' in buffer_[begin_, scanned_).
+  int64 buffer_offset_;    // The offset of buffer_ in decompressed file.
+  int64 record_offset_;    // The offset of the last read line.
+  bool eof_;
+};
+
+
+//-----------------------------------------------------------------------------
+// Read lines of a gzip file, which may consist of multiple gzip
+// members (e.g., concatenated gzip files, or a BGZF file).
+//-----------------------------------------------------------------------------
+class GzipTextReader : public CompressedTextReader {
+ public:
+  GzipTextReader();
+  virtual ~GzipTextReader();
+  virtual void Open(const std::string& source_name);
+  virtual void Close();
+
+ protected:
+  virtual bool Decompress(std::string* buffer);
+
+ private:
+  scoped_ptr<z_stream_s> stream_;
+  std::string input_;      // Compressed data read from the file.
+  bool member_ended_;      // The last gzip member was decompressed.
+};
+
+
+//-----------------------------------------------------------------------------
+// Read lines of a BGZF file (see bgzf.h), whose blocks are decompressed
+// in --mr_num_codec_threads threads.
+//-----------------------------------------------------------------------------
+class BgzfTextReader : public CompressedTextReader {
+ public:
+  virtual void Open(const std::string& source_name);
+  virtual void Close();
+
+ protected:
+  virtual bool Decompress(std::string* buffer);
+
+ private:
+  scoped_ptr<BgzfBlockReader> blocks_;
+  std::string block_;
 };
 
 
@@ -76,7 +245,34 @@ class TextReader : public Reader {
 //-----------------------------------------------------------------------------
 class ProtoRecordReader : public Reader {
  public:
+  virtual void Open(const std::string& source_name);
+  virtual void Close();
   virtual bool Read(std::string* key, std::string* value);
+  virtual bool ReadBatch(RecordBatch* batch, int max_records, int max_bytes);
+
+ private:
+  scoped_ptr<ProtofileReader> reader_;
+};
+
+
+//-----------------------------------------------------------------------------
+// Read each record in a blockfile (see blockfile.h).  A split reads
+// the blocks beginning in it.
+//-----------------------------------------------------------------------------
+class BlockFileRecordReader : public Reader {
+ public:
+  BlockFileRecordReader();  // Reads --mr_skip_corrupted_blocks.
+
+  virtual void Open(const std::string& source_name);
+  virtual void Close();
+  virtual bool Read(std::string* key, std::string* value);
+  virtual bool ReadBatch(RecordBatch* batch, int max_records, int max_bytes);
+  virtual bool SupportsSplit() const { return true; }
+  virtual void OpenSplit(const std::string& source_name,
+                         int64 begin, int64 end);
+
+ private:
+  BlockFileReader reader_;
 };
 
 
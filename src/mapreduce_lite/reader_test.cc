@@ -16,8 +16,18 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
 */
 #include "src/mapreduce_lite/reader.h"
 
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
 #include "src/base/common.h"
+#include "src/base/scoped_ptr.h"
+#include "src/mapreduce_lite/bgzf.h"
+#include "src/strutil/stringprintf.h"
 #include "gtest/gtest.h"
+#include "zlib.h"
 
 namespace mapreduce_lite {
 Reader* CreateReader(const char* format_name) {
@@ -27,8 +37,255 @@ Reader* CreateReader(const char* format_name) {
 
 TEST(ReaderTest, ReaderCreationByName) {
   EXPECT_TRUE(mapreduce_lite::CreateReader("text") != NULL);
+  EXPECT_TRUE(mapreduce_lite::CreateReader("mmap_text") != NULL);
+  EXPECT_TRUE(mapreduce_lite::CreateReader("gzip_text") != NULL);
+  EXPECT_TRUE(mapreduce_lite::CreateReader("bgzf_text") != NULL);
   EXPECT_TRUE(mapreduce_lite::CreateReader("protofile") != NULL);
 
   EXPECT_TRUE(mapreduce_lite::CreateReader("") == NULL);
   EXPECT_TRUE(mapreduce_lite::CreateReader("something_without_name") == NULL);
 }
+
+TEST(ReaderTest, MmapTextReader) {
+  static const char* kFilename = "/tmp/reader_test_mmap_text";
+  std::string long_line(100 * 1024, 'x');  // Longer than TextReader accepts.
+  std::string content = "apple\n\r\n" + long_line + "\nbanana\r\norange";
+  FILE* file = fopen(kFilename, "w");
+  ASSERT_TRUE(file != NULL);
+  fwrite(content.data(), 1, content.size(), file);
+  fclose(file);
+
+  scoped_ptr<mapreduce_lite::Reader> reader(
+      mapreduce_lite::CreateReader("mmap_text"));
+  reader->Open(kFilename);
+  static const char* kValues[] = { "apple", "", NULL, "banana", "orange" };
+  static const int kOffsets[] = { 0, 6, 8, 8 + 100 * 1024 + 1,
+                                  8 + 100 * 1024 + 9 };
+  std::string key, value;
+  for (int i = 0; i < 5; ++i) {
+    ASSERT_TRUE(reader->Read(&key, &value));
+    EXPECT_TRUE(key.empty());
+    EXPECT_EQ(kValues[i] != NULL ? kValues[i] : long_line, value);
+    char expected_key[256];
+    snprintf(expected_key, sizeof(expected_key), "%s-%010d",
+             kFilename, kOffsets[i]);
+    EXPECT_EQ(expected_key, reader->LazyKey());
+  }
+  EXPECT_FALSE(reader->Read(&key, &value));
+  reader->Close();
+  remove(kFilename);
+
+  // An empty file has no records.
+  file = fopen(kFilename, "w");
+  fclose(file);
+  reader->Open(kFilename);
+  EXPECT_FALSE(reader->Read(&key, &value));
+  remove(kFilename);
+}
+
+// Read lines of content from filename in format, and check values and
+// lazy keys.
+static void CheckCompressedTextReader(const char* format,
+                                      const char* filename,
+                                      const std::string& content) {
+  scoped_ptr<mapreduce_lite::Reader> reader(
+      mapreduce_lite::CreateReader(format));
+  reader->Open(filename);
+  std::string key, value;
+  size_t offset = 0;
+  while (offset < content.size()) {
+    size_t end = content.find('\n', offset);
+    if (end == std::string::npos) {
+      end = content.size();
+    }
+    ASSERT_TRUE(reader->Read(&key, &value));
+    EXPECT_TRUE(key.empty());
+    EXPECT_EQ(content.substr(offset, end - offset), value);
+    EXPECT_EQ(StringPrintf("%s-%010d", filename, static_cast<int>(offset)),
+              reader->LazyKey());
+    offset = end + 1;
+  }
+  EXPECT_FALSE(reader->Read(&key, &value));
+  reader->Close();
+}
+
+TEST(ReaderTest, CompressedTextReaders) {
+  static const char* kFilename = "/tmp/reader_test_compressed_text";
+  std::string content;
+  for (int i = 0; i < 100000; ++i) {
+    content += StringPrintf("line %d %s\n", i,
+                            std::string(i % 50, 'x').c_str());
+  }
+  content += std::string(200 * 1024, 'y') + "\nlast line";
+
+  // A gzip file of two members.
+  size_t half = content.size() / 2;
+  gzFile gz = gzopen(kFilename, "w");
+  gzwrite(gz, content.data(), half);
+  gzclose(gz);
+  gz = gzopen(kFilename, "a");
+  gzwrite(gz, content.data() + half, content.size() - half);
+  gzclose(gz);
+  CheckCompressedTextReader("gzip_text", kFilename, content);
+
+  // A BGZF file.
+  std::string blocks;
+  const size_t kBlockSize = mapreduce_lite::kBgzfMaxDataSize;
+  for (size_t i = 0; i < content.size(); i += kBlockSize) {
+    mapreduce_lite::DeflateBgzfBlock(
+        content.data() + i, std::min(kBlockSize, content.size() - i),
+        &blocks);
+  }
+  blocks.append(mapreduce_lite::kBgzfEofBlock,
+                mapreduce_lite::kBgzfEofBlockSize);
+  FILE* file = fopen(kFilename, "w");
+  fwrite(blocks.data(), 1, blocks.size(), file);
+  fclose(file);
+  CheckCompressedTextReader("bgzf_text", kFilename, content);
+  CheckCompressedTextReader("gzip_text", kFilename, content);
+  remove(kFilename);
+}
+
+TEST(ReaderTest, ListInputSplits) {
+  static const char* kFilenames[] = { "/tmp/reader_test_splits_0",
+                                      "/tmp/reader_test_splits_1" };
+  static const int kSizes[] = { 10, 0 };
+  std::vector<std::string> filenames;
+  for (int i = 0; i < 2; ++i) {
+    FILE* file = fopen(kFilenames[i], "w");
+    ASSERT_TRUE(file != NULL);
+    fwrite(std::string(kSizes[i], 'x').data(), 1, kSizes[i], file);
+    fclose(file);
+    filenames.push_back(kFilenames[i]);
+  }
+
+  std::vector<mapreduce_lite::InputSplit> splits;
+  mapreduce_lite::ListInputSplits(filenames, 4, &splits);
+  ASSERT_EQ(3, splits.size());  // The empty file has no split.
+  EXPECT_EQ(kFilenames[0], splits[2].filename);
+  EXPECT_EQ(8, splits[2].begin);
+  EXPECT_EQ(10, splits[2].end);
+
+  mapreduce_lite::ListInputSplits(filenames, 0, &splits);
+  ASSERT_EQ(1, splits.size());
+  EXPECT_EQ(0, splits[0].begin);
+  EXPECT_EQ(10, splits[0].end);
+
+  for (int i = 0; i < 2; ++i) {
+    remove(kFilenames[i]);
+  }
+}
+
+TEST(ReaderTest, SelectInputSplits) {
+  std::vector<mapreduce_lite::InputSplit> splits(5);
+  for (int i = 0; i < splits.size(); ++i) {
+    splits[i].filename = StringPrintf("/tmp/reader_test_select_%d", i);
+    splits[i].begin = 0;
+    splits[i].end = 10;
+  }
+
+  // Splitting is on: two map workers share the splits round-robin.
+  std::vector<mapreduce_lite::InputSplit> my_splits;
+  mapreduce_lite::SelectInputSplits(splits, true, 2, 1, &my_splits);
+  ASSERT_EQ(2, my_splits.size());
+  EXPECT_EQ(splits[1].filename, my_splits[0].filename);
+  EXPECT_EQ(splits[3].filename, my_splits[1].filename);
+
+  // Splitting is off: each map worker of a multi-machine task maps
+  // every file.
+  for (int reader_id = 0; reader_id < 2; ++reader_id) {
+    mapreduce_lite::SelectInputSplits(splits, false, 2, reader_id,
+                                      &my_splits);
+    ASSERT_EQ(splits.size(), my_splits.size());
+    for (int i = 0; i < splits.size(); ++i) {
+      EXPECT_EQ(splits[i].filename, my_splits[i].filename);
+    }
+  }
+}
+
+// Reading all splits of a file, with any split size, must return
+// each line exactly once.
+TEST(ReaderTest, ReadSplits) {
+  static const char* kFilename = "/tmp/reader_test_read_splits";
+  static const char* kLines[] = { "apple", "", "banana", "a", "orange" };
+  std::string content;
+  for (int i = 0; i < 5; ++i) {
+    content += std::string(kLines[i]) + "\n";
+  }
+  FILE* file = fopen(kFilename, "w");
+  ASSERT_TRUE(file != NULL);
+  fwrite(content.data(), 1, content.size(), file);
+  fclose(file);
+
+  static const char* kFormats[] = { "text", "mmap_text" };
+  for (int i_format = 0; i_format < 2; ++i_format) {
+    scoped_ptr<mapreduce_lite::Reader> reader(
+        mapreduce_lite::CreateReader(kFormats[i_format]));
+    ASSERT_TRUE(reader->SupportsSplit());
+    for (int split_size = 1; split_size <= content.size(); ++split_size) {
+      std::vector<std::string> values;
+      for (int begin = 0; begin < content.size(); begin += split_size) {
+        reader->OpenSplit(kFilename, begin, begin + split_size);
+        std::string key, value;
+        while (reader->Read(&key, &value)) {
+          values.push_back(value);
+        }
+        reader->Close();
+      }
+      ASSERT_EQ(5, values.size());
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(kLines[i], values[i]);
+      }
+    }
+
+    // A split past the end, e.g., of a file that shrank after splits
+    // were listed, is empty.
+    reader->OpenSplit(kFilename, content.size() + 10, content.size() + 20);
+    std::string key, value;
+    EXPECT_FALSE(reader->Read(&key, &value));
+    reader->Close();
+  }
+  EXPECT_FALSE(scoped_ptr<mapreduce_lite::Reader>(
+      mapreduce_lite::CreateReader("protofile"))->SupportsSplit());
+  remove(kFilename);
+}
+
+// ReadBatch, overridden or not, returns the same records as Read.
+TEST(ReaderTest, ReadBatch) {
+  static const char* kFilename = "/tmp/reader_test_read_batch";
+  FILE* file = fopen(kFilename, "w");
+  ASSERT_TRUE(file != NULL);
+  for (int i = 0; i < 10; ++i) {
+    fprintf(file, "line-%d\n", i);
+  }
+  fclose(file);
+
+  static const char* kFormats[] = { "text", "mmap_text" };
+  for (int i_format = 0; i_format < 2; ++i_format) {
+    scoped_ptr<mapreduce_lite::Reader> reader(
+        mapreduce_lite::CreateReader(kFormats[i_format]));
+    reader->Open(kFilename);
+    std::vector<std::string> keys;
+    std::string key, value;
+    while (reader->Read(&key, &value)) {
+      keys.push_back(key.empty() ? reader->LazyKey() : key);
+    }
+    ASSERT_EQ(10, keys.size());
+
+    reader->Open(kFilename);
+    mapreduce_lite::RecordBatch batch;
+    EXPECT_TRUE(reader->ReadBatch(&batch, 4, 1024 * 1024));
+    EXPECT_EQ(4, batch.Size());
+    EXPECT_FALSE(reader->ReadBatch(&batch, 100, 1024 * 1024));
+    ASSERT_EQ(10, batch.Size());
+    for (int i = 0; i < 10; ++i) {
+      char expected[100];
+      snprintf(expected, sizeof(expected), "line-%d", i);
+      EXPECT_EQ(expected, batch.Value(i));
+      EXPECT_EQ(keys[i], batch.KeySize(i) > 0 ? batch.Key(i) :
+                batch.LazyKey(i));
+    }
+    reader->Close();
+  }
+  remove(kFilename);
+}
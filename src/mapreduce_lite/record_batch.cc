@@ -0,0 +1,84 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/mapreduce_lite/record_batch.h"
+
+#include "src/strutil/stringprintf.h"
+
+namespace mapreduce_lite {
+
+std::string TextLineKey(const std::string& filename, int64 offset) {
+  return StringPrintf("%s-%010lld", filename.c_str(),
+                      static_cast<long long>(offset));
+}
+
+void RecordBatch::Clear() {
+  buffer_.clear();  // Keeps the capacity.
+  key_offsets_.clear();
+  value_offsets_.clear();
+  lazy_key_offsets_.clear();
+  record_offsets_.clear();
+  filename_.clear();
+}
+
+void RecordBatch::CopyFrom(const RecordBatch& other) {
+  buffer_ = other.buffer_;
+  key_offsets_ = other.key_offsets_;
+  value_offsets_ = other.value_offsets_;
+  lazy_key_offsets_ = other.lazy_key_offsets_;
+  record_offsets_ = other.record_offsets_;
+  filename_ = other.filename_;
+}
+
+void RecordBatch::Add(const char* key, int key_size,
+                      const char* value, int value_size,
+                      const char* lazy_key, int lazy_key_size) {
+  key_offsets_.push_back(buffer_.size());
+  buffer_.append(key, key_size);
+  value_offsets_.push_back(buffer_.size());
+  buffer_.append(value, value_size);
+  lazy_key_offsets_.push_back(buffer_.size());
+  buffer_.append(lazy_key, lazy_key_size);
+  record_offsets_.push_back(-1);
+}
+
+void RecordBatch::Add(const std::string& key, const std::string& value,
+                      const std::string& lazy_key) {
+  Add(key.data(), key.size(), value.data(), value.size(),
+      lazy_key.data(), lazy_key.size());
+}
+
+void RecordBatch::AddWithOffset(const char* value, int value_size,
+                                int64 record_offset) {
+  key_offsets_.push_back(buffer_.size());
+  value_offsets_.push_back(buffer_.size());
+  buffer_.append(value, value_size);
+  lazy_key_offsets_.push_back(buffer_.size());
+  record_offsets_.push_back(record_offset);
+}
+
+std::string RecordBatch::LazyKey(int i) const {
+  if (record_offsets_[i] >= 0) {
+    return TextLineKey(filename_, record_offsets_[i]);
+  }
+  return std::string(buffer_.data() + lazy_key_offsets_[i],
+                     RecordEnd(i) - lazy_key_offsets_[i]);
+}
+
+}  // namespace mapreduce_lite
@@ -0,0 +1,110 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+// RecordBatch holds a batch of map input records, read by
+// Reader::ReadBatch() and consumed by Mapper::MapBatch().  All keys,
+// values and lazy keys (see Reader::LazyKey) are copied into one
+// buffer, and records are accessed by columns of offsets into the
+// buffer, so a batch costs no memory allocation once the buffer has
+// grown, and a mapper may scan values without per-record calls.
+//
+// Lines of text files have lazy keys "filename-offset".  For such a
+// record, the batch keeps only the offset, and the filename once per
+// batch, and LazyKey(i) builds the key only if a mapper asks for it.
+//
+// Pointers returned by KeyData() and ValueData() are invalidated by
+// Add() and Clear().
+//
+#ifndef MAPREDUCE_LITE_RECORD_BATCH_H_
+#define MAPREDUCE_LITE_RECORD_BATCH_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+
+namespace mapreduce_lite {
+
+// Returns "filename-offset", the lazy key of the line beginning at
+// offset of a text file.
+std::string TextLineKey(const std::string& filename, int64 offset);
+
+class RecordBatch {
+ public:
+  RecordBatch() {}
+
+  void Clear();
+  void CopyFrom(const RecordBatch& other);
+  int Size() const { return key_offsets_.size(); }
+  int ByteSize() const { return buffer_.size(); }
+
+  // Copy a record into the batch.  lazy_key is usually empty unless
+  // key is.
+  void Add(const char* key, int key_size,
+           const char* value, int value_size,
+           const char* lazy_key, int lazy_key_size);
+  void Add(const std::string& key, const std::string& value,
+           const std::string& lazy_key);
+
+  // Copy a record with an empty key, whose lazy key is
+  // TextLineKey(filename(), record_offset).
+  void AddWithOffset(const char* value, int value_size, int64 record_offset);
+
+  // The file of records added by AddWithOffset().
+  const std::string& filename() const { return filename_; }
+  void set_filename(const std::string& filename) { filename_ = filename; }
+
+  const char* KeyData(int i) const { return buffer_.data() + key_offsets_[i]; }
+  int KeySize(int i) const { return value_offsets_[i] - key_offsets_[i]; }
+
+  const char* ValueData(int i) const {
+    return buffer_.data() + value_offsets_[i];
+  }
+  int ValueSize(int i) const {
+    return lazy_key_offsets_[i] - value_offsets_[i];
+  }
+
+  // Copy fields of the i-th record.
+  std::string Key(int i) const {
+    return std::string(KeyData(i), KeySize(i));
+  }
+  std::string Value(int i) const {
+    return std::string(ValueData(i), ValueSize(i));
+  }
+  std::string LazyKey(int i) const;
+
+ private:
+  // The end of the i-th record in buffer_.
+  int RecordEnd(int i) const {
+    return i + 1 < Size() ? key_offsets_[i + 1] : buffer_.size();
+  }
+
+  std::string buffer_;              // Key, value, lazy key, key, ...
+  std::vector<int> key_offsets_;
+  std::vector<int> value_offsets_;
+  std::vector<int> lazy_key_offsets_;
+  std::vector<int64> record_offsets_;  // -1 if lazy key is in buffer_.
+  std::string filename_;
+
+  DISALLOW_COPY_AND_ASSIGN(RecordBatch);
+};
+
+}  // namespace mapreduce_lite
+
+#endif  // MAPREDUCE_LITE_RECORD_BATCH_H_
@@ -0,0 +1,88 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/mapreduce_lite/record_batch.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+using mapreduce_lite::RecordBatch;
+
+TEST(RecordBatchTest, AddAndAccess) {
+  RecordBatch batch;
+  EXPECT_EQ(0, batch.Size());
+  batch.Add("apple", "red", "");
+  batch.Add("", "", "lazy");
+  batch.Add(std::string("a\0b", 3), "yellow", "");
+  ASSERT_EQ(3, batch.Size());
+  EXPECT_EQ(3 + 5 + 3 + 4 + 6, batch.ByteSize());
+
+  EXPECT_EQ("apple", batch.Key(0));
+  EXPECT_EQ("red", batch.Value(0));
+  EXPECT_EQ("", batch.LazyKey(0));
+  EXPECT_EQ("", batch.Key(1));
+  EXPECT_EQ("", batch.Value(1));
+  EXPECT_EQ("lazy", batch.LazyKey(1));
+  EXPECT_EQ(std::string("a\0b", 3), batch.Key(2));
+  EXPECT_EQ(6, batch.ValueSize(2));
+  EXPECT_EQ("yellow", std::string(batch.ValueData(2), batch.ValueSize(2)));
+  EXPECT_EQ("", batch.LazyKey(2));
+
+  batch.Clear();
+  EXPECT_EQ(0, batch.Size());
+  EXPECT_EQ(0, batch.ByteSize());
+  batch.Add("k", "v", "");
+  EXPECT_EQ("v", batch.Value(0));
+}
+
+TEST(RecordBatchTest, CopyFrom) {
+  RecordBatch batch;
+  batch.Add("apple", "red", "");
+  batch.Add("", "", "lazy");
+
+  RecordBatch copy;
+  copy.Add("stale", "record", "");
+  copy.CopyFrom(batch);
+  batch.Clear();
+  ASSERT_EQ(2, copy.Size());
+  EXPECT_EQ("apple", copy.Key(0));
+  EXPECT_EQ("red", copy.Value(0));
+  EXPECT_EQ("lazy", copy.LazyKey(1));
+}
+
+TEST(RecordBatchTest, AddWithOffset) {
+  RecordBatch batch;
+  batch.set_filename("/data/text");
+  batch.AddWithOffset("line", 4, 12);
+  batch.Add("", "value", "lazy");
+  ASSERT_EQ(2, batch.Size());
+  EXPECT_EQ(4 + 5 + 4, batch.ByteSize());  // The key is not kept.
+  EXPECT_EQ("", batch.Key(0));
+  EXPECT_EQ("line", batch.Value(0));
+  EXPECT_EQ("/data/text-0000000012", batch.LazyKey(0));
+  EXPECT_EQ("value", batch.Value(1));
+  EXPECT_EQ("lazy", batch.LazyKey(1));
+
+  RecordBatch copy;
+  copy.CopyFrom(batch);
+  batch.Clear();
+  EXPECT_EQ("", batch.filename());
+  EXPECT_EQ("/data/text-0000000012", copy.LazyKey(0));
+}
@@ -145,6 +145,13 @@ class MRLiteJobScheduler(CmdTool):
                 assert(mesg == 'reducer_started')
             logging.info(map_mesg)
             self.start_map_workers()
+        elif options.mapreduce_native_shuffle:
+            # reduce workers fetch map outputs from map workers directly,
+            # so they work simultaneously
+            logging.info(reduce_mesg)
+            self.start_reduce_workers()
+            logging.info(map_mesg)
+            self.start_map_workers()
         else:
             logging.info(map_mesg)
             self.start_map_workers()
@@ -38,7 +38,8 @@ make_option("--mapreduce_map_io",
             "including:\n"
             "<machines>       machine list to run map worker\n"
             "<mapper_class>   class of map worker\n"
-            "<input_format>   either 'text' or 'recordio'\n"
+            "<input_format>   'text', 'mmap_text', 'gzip_text', 'bgzf_text',\n"
+            "                 'recordio' or 'blockfile'\n"
             "<input_path>     file pattern for input files\n"
             "<output_path>    output directory for storing\n"
             "                 intermediate result"
@@ -53,7 +54,7 @@ make_option("--mapreduce_reduce_io",
             "<reduce_class>   class of reduce worker\n"
             "<input_path>     reduce input directory for storing\n"
             "                 output of map workers\n"
-            "<output_format>  either 'text' or 'recordio'\n"
+            "<output_format>  'text', 'bgzf_text', 'recordio' or 'blockfile'\n"
             "<output_path>    output directory\n"
             ),
 
@@ -64,9 +65,10 @@ make_option("--mapreduce_maponly_map_io",
             "fields, inlcuding\n"
             "<machines>       machine list to run map worker\n"
             "<mapper_class>   class of map worker\n"
-            "<input_format>   either 'text' or 'recordio'\n"
+            "<input_format>   'text', 'mmap_text', 'gzip_text', 'bgzf_text',\n"
+            "                 'recordio' or 'blockfile'\n"
             "<input_path>     file pattern for input files\n"
-            "<output_format>  either 'text' or 'recordio'\n"
+            "<output_format>  'text', 'bgzf_text', 'recordio' or 'blockfile'\n"
             "<output_path>    output directory"
            ),
 
@@ -92,6 +94,22 @@ make_option("--mapreduce_incremental_mode", action="store_true",
             "function provided by MapReduce Lite for fast reduction. "
             "Please refer to 'mapreduce_lite.h' for more details"),
 
+make_option("--mapreduce_native_shuffle", action="store_true",
+            default=False,
+            help= "In batch reduction mode, by default, the scheduler copies "
+            "map outputs to reduce workers using scp after all map workers "
+            "finished. If this option is given, each map worker serves its "
+            "outputs on a TCP port, and reduce workers, which are started "
+            "together with map workers, fetch them in parallel"),
+
+make_option("--mapreduce_split_size", default=0, type="int",
+            help="If positive, in MB, map workers divide input files in text, "
+            "mmap_text or blockfile format into splits of this size. The machines "
+            "listed in one task of --mapreduce_map_io (or "
+            "--mapreduce_maponly_map_io) share the splits of the task's "
+            "input files, which must be on a shared file system. "
+            "default(0), map whole files"),
+
 make_option("--mapreduce_force_mkdir", action="store_true",
             default=False,
             help= "By default, the input and output directory of each worker "
@@ -251,6 +269,11 @@ class MRLiteOptionParser(OptionParser):
             self.parse_reduce_task(options)
             num_worker = options.num_map_worker + options.num_reduce_worker
             all_tasks = options.map_tasks + options.reduce_tasks
+        if options.mapreduce_native_shuffle and (
+            maponly_mode or options.mapreduce_incremental_mode):
+            mesg = ("--mapreduce_native_shuffle is valid only in batch "
+                    "reduction mode")
+            self.error_exit(mesg)
         options.ensure_value('num_worker', num_worker)
         options.ensure_value('all_tasks', all_tasks)
         self.post_check_validity(options)
@@ -327,14 +350,29 @@ class MRLiteOptionParser(OptionParser):
             machines = self.parse_machines(machine_str)
             machine_set.update(set(machines))
             output_format  = None
-            for machine in machines:
+            for i in range(len(machines)):
+                machine = machines[i]
                 tmp_dir = options.mapreduce_tmp_dir[machine]
                 log_filebase = options.mapreduce_log_filebase[machine]
                 task = [machine, class_name, input_format, input_path,
                         output_format, output_path, tmp_dir, log_filebase]
                 task = self.convert_task(task)
+                # machines of a task share splits of the same input files
+                if options.mapreduce_split_size > 0:
+                    task['num_split_readers'] = len(machines)
+                    task['split_reader_id'] = i
                 map_tasks.append(task)
+        # get the string of all map workers, which serve map outputs to
+        # reduce workers in native shuffle mode
+        map_workers = []
+        if options.mapreduce_native_shuffle:
+            map_ports = self.get_free_ports(len(map_tasks))
+            for i in range(len(map_tasks)):
+                mapper = "%s:%s" %(map_tasks[i]['machine'], map_ports[i])
+                map_workers.append(mapper)
+
         options.ensure_value('map_tasks', map_tasks)
+        options.ensure_value('map_workers', ','.join(map_workers))
         options.ensure_value('map_machines', machine_set)
         options.ensure_value('num_map_worker', len(map_tasks))
         options.machines.update(machine_set)
@@ -352,12 +390,17 @@ class MRLiteOptionParser(OptionParser):
              input_path, output_format, output_path) = fields
             machines = self.parse_machines(machine_str)
             machine_set.update(set(machines))
-            for machine in machines:
+            for i in range(len(machines)):
+                machine = machines[i]
                 tmp_dir = options.mapreduce_tmp_dir[machine]
                 log_filebase = options.mapreduce_log_filebase[machine]
                 task = [machine, class_name, input_format, input_path,
                         output_format, output_path, tmp_dir, log_filebase]
                 task = self.convert_task(task)
+                # machines of a task share splits of the same input files
+                if options.mapreduce_split_size > 0:
+                    task['num_split_readers'] = len(machines)
+                    task['split_reader_id'] = i
                 map_tasks.append(task)
         options.ensure_value('map_tasks', map_tasks)
         options.ensure_value('map_machines', machine_set)
@@ -424,7 +467,7 @@ class MRLiteOptionParser(OptionParser):
                 mesg = 'illegal machine %s in mapreduce_log_filebase' %machine
                 self.error_exit(mesg)
 
-        formats = [None, 'text', 'recordio']
+        formats = [None, 'text', 'recordio', 'blockfile']
         for i in range(options.num_worker):
             task = options.all_tasks[i]
             assert(task['machine'])
@@ -433,8 +476,9 @@ class MRLiteOptionParser(OptionParser):
             assert(task['output_path'])
             assert(task['tmp_dir'])
             assert(task['log_filebase'])
-            assert(task['input_format'] in formats)
-            assert(task['output_format'] in formats)
+            assert(task['input_format'] in
+                   formats + ['mmap_text', 'gzip_text', 'bgzf_text'])
+            assert(task['output_format'] in formats + ['bgzf_text'])
 
     def get_identity(self, local_executable):
         """ Get identity of job
@@ -160,6 +160,50 @@ class TestMRLiteOptionParser(unittest.TestCase):
         ]
         self.assertEqual(expected_map_tasks, options.map_tasks)
 
+    def test_split_size(self):
+        argv = [
+         "--mapreduce_cmd=/bin/echo",
+         "--mapreduce_maponly_map_io=\
+            {m1, m2}:WordCountMapper:text:/input-*:text:/disk10/output;\
+            {m3}:BigramCountMapper:text:/text-*:text:/disk7/output",
+         "--mapreduce_log_filebase={m1,m2,m3}/tmp/log",
+         "--mapreduce_tmp_dir={m1,m2,m3}/tmp",
+         ]
+        # with splitting off, each machine maps all of its input files
+        parser = MRLiteOptionParser(debug=True)
+        options, args = parser.parse_args(argv)
+        for task in options.map_tasks:
+            self.assertFalse('num_split_readers' in task)
+            self.assertFalse('split_reader_id' in task)
+
+        # with splitting on, machines of a task share splits
+        argv.append("--mapreduce_split_size=64")
+        parser = MRLiteOptionParser(debug=True)
+        options, args = parser.parse_args(argv)
+        self.assertEqual([(2, 0), (2, 1), (1, 0)],
+                         [(task['num_split_readers'], task['split_reader_id'])
+                          for task in options.map_tasks])
+
+    def test_native_shuffle(self):
+        argv = [
+         "--mapreduce_cmd=/bin/echo",
+         "--mapreduce_map_io={m1, m2}:WordCountMapper:text:/text-*:/tmp/output",
+         "--mapreduce_reduce_io={m3}:WordCountReducer:/tmp/input:text:/tmp/out",
+         "--mapreduce_log_filebase={m1,m2,m3}/tmp/log",
+         "--mapreduce_tmp_dir={m1,m2,m3}/tmp",
+         "--mapreduce_native_shuffle",
+         ]
+        parser = MRLiteOptionParser(debug=True)
+        options, args = parser.parse_args(argv)
+        map_workers = options.map_workers.split(',')
+        self.assertEqual(2, len(map_workers))
+        self.assertTrue(map_workers[0].startswith('m1:'))
+        self.assertTrue(map_workers[1].startswith('m2:'))
+
+        # native shuffle is forbidden in incremental mode
+        argv.append("--mapreduce_incremental_mode")
+        self.assertRaises(SystemExit, parser.parse_args, argv)
+
 #----------------------------------------------------------------------------#
 if __name__ == '__main__':
     unittest.main()
@@ -65,10 +65,26 @@ class Worker(CmdTool):
     def is_batch_mode(self):
         return not self.options.mapreduce_incremental_mode
 
+    def is_native_shuffle(self):
+        return self.options.mapreduce_native_shuffle
+
     def get_worker_cmd(self):
         mesg = 'Please reimplement get_worker_cmd in derived class'
         raise NotImplementedError(mesg)
 
+    def get_split_flags(self, task):
+        """ Get flags dividing input files into splits, which are shared by
+        machines of a map task, if --mapreduce_split_size is positive
+        """
+        if 'num_split_readers' not in task:
+            return ''
+        return """--mr_split_size=%s
+        --mr_num_split_readers=%s
+        --mr_split_reader_id=%s""" %(self.options.mapreduce_split_size,
+                                     task['num_split_readers'],
+                                     task['split_reader_id'])
+
+
 class MapWorker(Worker):
     def __init__(self, options, rank, sock):
         Worker.__init__(self, options, rank, sock)
@@ -86,7 +102,7 @@ class MapWorker(Worker):
         """ Wait for worker to finish
         """
         self.wait_cmd(self.process, self.get_worker_cmd())
-        if self.is_batch_mode():
+        if self.is_batch_mode() and not self.is_native_shuffle():
             self.push_reduce_buffers()
             logging.info('%s fininsed at %s' %(self.name, time.asctime()))
             time.sleep(0.5)
@@ -115,9 +131,11 @@ class MapWorker(Worker):
                  options.num_map_worker,
                  reduce_input_buffer_size,
                  options.reduce_workers,
+                 options.map_workers,
                  map_worker_id,
                  task['class'],
-                 task['input_format'])
+                 task['input_format'],
+                 self.get_split_flags(task))
         cmd_map_worker = """ %s
         --mr_input_filepattern="%s"
         --mr_reduce_input_filebase="%s"
@@ -126,10 +144,12 @@ class MapWorker(Worker):
         --mr_num_map_workers=%s
         --mr_reduce_input_buffer_size=%s
         --mr_reduce_workers=%s
+        --mr_map_workers=%s
         --mr_map_worker_id=%s
         --mr_map_only=false
         --mr_mapper_class=%s
         --mr_input_format=%s
+        %s
         """ % param
         return cmd_map_worker
 
@@ -207,7 +227,8 @@ class MapOnlyWorker(Worker):
                  map_worker_id,
                  task['class'],
                  task['input_format'],
-                 task['output_format'])
+                 task['output_format'],
+                 self.get_split_flags(task))
         cmd_map_worker = """ %s
         --mr_input_filepattern="%s"
         --mr_output_files="%s"
@@ -219,6 +240,7 @@ class MapOnlyWorker(Worker):
         --mr_mapper_class=%s
         --mr_input_format=%s
         --mr_output_format=%s
+        %s
         """ % param
         return cmd_map_worker
 
@@ -233,7 +255,7 @@ class ReduceWorker(Worker):
         """ Start to run the worker
         """
         logging.debug('%s started at %s' %(self.name, time.asctime()))
-        if self.is_batch_mode():
+        if self.is_batch_mode() and not self.is_native_shuffle():
             self.prepare_reduce_buffers()
         cmd_str = self.get_worker_cmd()
         self.process = self.run_cmd(cmd_str)
@@ -275,6 +297,7 @@ class ReduceWorker(Worker):
                  task['log_filebase'],
                  options.num_map_worker,
                  options.reduce_workers,
+                 options.map_workers,
                  reduce_worker_id,
                  task['class'],
                  task['output_format'])
@@ -286,6 +309,7 @@ class ReduceWorker(Worker):
         --mr_log_filebase="%s"
         --mr_num_map_workers=%s
         --mr_reduce_workers=%s
+        --mr_map_workers=%s
         --mr_reduce_worker_id=%s
         --mr_reducer_class=%s
         --mr_output_format=%s
@@ -0,0 +1,432 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/mapreduce_lite/shuffle.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "boost/bind.hpp"
+
+#include "src/base/stl-util.h"
+#include "src/sorted_buffer/sorted_file_merger.h"
+#include "src/strutil/stringprintf.h"
+
+namespace mapreduce_lite {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+// A reduce worker may start before the map worker listens.
+const int kMaxConnectRetries = 600;
+const int kConnectRetryInterval = 1;        // in seconds
+const int kFetchBufferSize = 1024 * 1024;   // 1 MB
+
+// After a connection breaks, a reduce worker reconnects to the map
+// worker this number of times, each trying kMaxReconnectRetries times.
+const int kMaxFetchRetries = 3;
+const int kMaxReconnectRetries = 10;
+
+}  // namespace
+
+//-----------------------------------------------------------------------------
+// Implementation of ShuffleServer
+//-----------------------------------------------------------------------------
+ShuffleServer::ShuffleServer()
+    : num_reduce_workers_(0),
+      finished_(false),
+      stopping_(false),
+      last_served_time_(time(NULL)) {}
+
+ShuffleServer::~ShuffleServer() {
+  Finish();
+  Stop();
+  STLDeleteElementsAndClear(&sockets_);
+}
+
+bool ShuffleServer::Start(const string& address, int num_reduce_workers) {
+  CHECK_LT(0, num_reduce_workers);
+  num_reduce_workers_ = num_reduce_workers;
+  segments_.resize(num_reduce_workers);
+  // Sending to a reduce worker that has gone should fail with EPIPE,
+  // not kill the map worker.
+  signal(SIGPIPE, SIG_IGN);
+
+  string ip;
+  uint16 port;
+  if (!SplitAddress(address, &ip, &port) ||
+      !listener_.Bind(ip.c_str(), port) ||
+      !listener_.Listen(num_reduce_workers)) {
+    LOG(ERROR) << "Cannot start shuffle server on " << address;
+    return false;
+  }
+  accept_thread_.reset(new boost::thread(AcceptLoop, this));
+  LOG(INFO) << "Shuffle server listening on " << address;
+  return true;
+}
+
+void ShuffleServer::Publish(int reduce_worker_id, const string& filename) {
+  MutexLocker locker(&mutex_);
+  CHECK_LE(0, reduce_worker_id);
+  CHECK_LT(reduce_worker_id, segments_.size());
+  CHECK(!finished_);
+  segments_[reduce_worker_id].push_back(filename);
+  published_.Broadcast();
+}
+
+void ShuffleServer::Finish() {
+  MutexLocker locker(&mutex_);
+  if (!finished_) {
+    finished_ = true;
+    last_served_time_ = time(NULL);
+    published_.Broadcast();
+  }
+}
+
+bool ShuffleServer::WaitForReduceWorkers(int timeout) {
+  bool succeeded = true;
+  {
+    MutexLocker locker(&mutex_);
+    while (served_reduce_workers_.size() < num_reduce_workers_) {
+      if (time(NULL) - last_served_time_ >= timeout) {
+        LOG(ERROR) << "Only " << served_reduce_workers_.size() << " of "
+                   << num_reduce_workers_ << " reduce workers fetched their "
+                   << "segments, and none was served in " << timeout
+                   << " seconds.";
+        succeeded = false;
+        break;
+      }
+      served_.Wait(&mutex_, 1000);
+    }
+  }
+  Stop();
+  if (succeeded) {
+    LOG(INFO) << "All reduce workers fetched their segments.";
+  }
+  return succeeded;
+}
+
+void ShuffleServer::Stop() {
+  if (accept_thread_.get() == NULL) {
+    return;
+  }
+  {
+    MutexLocker locker(&mutex_);
+    stopping_ = true;
+    published_.Broadcast();
+    // Shutting down wakes up threads blocked in accept() or recv().
+    listener_.ShutDown(SHUT_RDWR);
+    for (int i = 0; i < sockets_.size(); ++i) {
+      if (sockets_[i]->Socket() >= 0) {
+        sockets_[i]->ShutDown(SHUT_RDWR);
+      }
+    }
+  }
+  accept_thread_->join();
+  accept_thread_.reset(NULL);
+  serve_threads_.join_all();
+  listener_.Close();
+}
+
+bool ShuffleServer::WaitForSegment(int reduce_worker_id, int index,
+                                   string* filename) {
+  MutexLocker locker(&mutex_);
+  while (index >= segments_[reduce_worker_id].size() &&
+         !finished_ && !stopping_) {
+    published_.Wait(&mutex_);
+  }
+  if (index < segments_[reduce_worker_id].size()) {
+    *filename = segments_[reduce_worker_id][index];
+    return true;
+  }
+  return false;
+}
+
+bool ShuffleServer::IsStopping() {
+  MutexLocker locker(&mutex_);
+  return stopping_;
+}
+
+void ShuffleServer::MarkServed(int reduce_worker_id, bool done) {
+  MutexLocker locker(&mutex_);
+  last_served_time_ = time(NULL);
+  if (done) {
+    served_reduce_workers_.insert(reduce_worker_id);
+  }
+  served_.Broadcast();
+}
+
+/*static*/
+void ShuffleServer::AcceptLoop(ShuffleServer* server) {
+  // A reduce worker reconnects if its connection breaks, so accept
+  // connections until stopped.
+  while (true) {
+    TCPSocket* socket = new TCPSocket;
+    string client_ip;
+    uint16 client_port;
+    bool accepted = server->listener_.Accept(socket, &client_ip,
+                                             &client_port);
+    if (!accepted) {
+      delete socket;
+      if (server->IsStopping()) {
+        return;
+      }
+      LOG(ERROR) << "Shuffle server failed accepting a connection.";
+      sleep(kConnectRetryInterval);
+      continue;
+    }
+    MutexLocker locker(&server->mutex_);
+    if (server->stopping_) {
+      delete socket;
+      return;
+    }
+    LOG(INFO) << "Shuffle server accepted " << client_ip << ":" << client_port;
+    server->sockets_.push_back(socket);
+    server->serve_threads_.create_thread(
+        boost::bind(ServeLoop, server, socket));
+  }
+}
+
+/*static*/
+void ShuffleServer::ServeLoop(ShuffleServer* server, TCPSocket* socket) {
+  while (true) {
+    uint32 request[2];  // reduce_worker_id and segment index.
+    if (!ReceiveAll(socket, reinterpret_cast<char*>(request),
+                    sizeof(request))) {
+      break;  // Closed by the reduce worker, or stopped.
+    }
+    if (request[0] >= server->num_reduce_workers_ ||
+        request[1] > static_cast<uint32>(kInt32Max)) {
+      LOG(ERROR) << "Invalid shuffle request of reduce worker " << request[0]
+                 << " for segment " << request[1] << ".";
+      break;
+    }
+    int reduce_worker_id = request[0];
+    int index = request[1];
+
+    string filename;
+    if (!server->WaitForSegment(reduce_worker_id, index, &filename)) {
+      int64 no_more = -1;
+      if (SendAll(socket, reinterpret_cast<char*>(&no_more),
+                  sizeof(no_more))) {
+        server->MarkServed(reduce_worker_id, true);
+      }
+      break;
+    }
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat file_stat;
+    if (fd < 0 || fstat(fd, &file_stat) < 0) {
+      LOG(FATAL) << "Cannot open segment: " << filename;
+    }
+    int64 size = file_stat.st_size;
+    bool sent_all = SendAll(socket, reinterpret_cast<char*>(&size),
+                            sizeof(size));
+    off_t offset = 0;
+    while (sent_all && offset < size) {
+      sent_all = sendfile(socket->Socket(), fd, &offset, size - offset) > 0;
+    }
+    close(fd);
+    if (!sent_all) {
+      LOG(ERROR) << "Failed sending segment " << filename << " to reduce "
+                 << "worker " << reduce_worker_id << "; it may reconnect.";
+      break;
+    }
+    server->MarkServed(reduce_worker_id, false);
+    LOG(INFO) << "Served " << filename << " (" << size << " bytes) "
+              << "to reduce worker " << reduce_worker_id;
+  }
+
+  MutexLocker locker(&server->mutex_);
+  socket->Close();
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of ShuffleFetcher
+//-----------------------------------------------------------------------------
+ShuffleFetcher::ShuffleFetcher(const vector<string>& map_workers,
+                               int reduce_worker_id,
+                               const string& filebase,
+                               int num_parallel_fetches)
+    : map_workers_(map_workers),
+      reduce_worker_id_(reduce_worker_id),
+      filebase_(filebase),
+      num_parallel_fetches_(std::max(1, num_parallel_fetches)),
+      merger_(NULL),
+      next_map_worker_(0),
+      failed_(false) {}
+
+string ShuffleFetcher::SegmentFilename(int map_worker_id, int index) const {
+  string filebase = filebase_;
+  if (!spill_dirs_.empty()) {
+    // Rotate by map_worker_id, as segments of the same index are
+    // likely fetched from different map workers at the same time.
+    string::size_type slash = filebase_.rfind('/');
+    filebase = spill_dirs_[(map_worker_id + index) % spill_dirs_.size()] +
+        "/" + filebase_.substr(slash == string::npos ? 0 : slash + 1);
+  }
+  return StringPrintf("%s-mapper-%05d-%010d",
+                      filebase.c_str(), map_worker_id, index);
+}
+
+bool ShuffleFetcher::FetchAll(vector<string>* filenames) {
+  boost::thread_group threads;
+  for (int i = 0; i < num_parallel_fetches_; ++i) {
+    threads.create_thread(boost::bind(FetchLoop, this));
+  }
+  threads.join_all();
+
+  MutexLocker locker(&mutex_);
+  if (merger_ != NULL && !failed_) {
+    merger_->Finish(filenames);
+  } else {
+    filenames->swap(fetched_);
+  }
+  return !failed_;
+}
+
+/*static*/
+void ShuffleFetcher::FetchLoop(ShuffleFetcher* fetcher) {
+  while (true) {
+    int map_worker_id;
+    {
+      MutexLocker locker(&fetcher->mutex_);
+      if (fetcher->failed_ ||
+          fetcher->next_map_worker_ >= fetcher->map_workers_.size()) {
+        return;
+      }
+      map_worker_id = fetcher->next_map_worker_++;
+    }
+
+    vector<string> filenames;
+    bool succeeded = fetcher->FetchFromMapWorker(map_worker_id, &filenames);
+
+    MutexLocker locker(&fetcher->mutex_);
+    fetcher->fetched_.insert(fetcher->fetched_.end(),
+                             filenames.begin(), filenames.end());
+    if (!succeeded) {
+      fetcher->failed_ = true;
+    }
+  }
+}
+
+bool ShuffleFetcher::FetchFromMapWorker(int map_worker_id,
+                                        vector<string>* filenames) {
+  int index = 0;
+  for (int retry = 0; retry <= kMaxFetchRetries; ++retry) {
+    if (retry > 0) {
+      LOG(WARNING) << "Reconnecting to map worker "
+                   << map_workers_[map_worker_id] << " for segment " << index;
+      sleep(kConnectRetryInterval);
+    }
+    if (FetchSegments(map_worker_id,
+                      retry == 0 ? kMaxConnectRetries : kMaxReconnectRetries,
+                      &index, filenames)) {
+      return true;
+    }
+  }
+  LOG(ERROR) << "Failed fetching from map worker "
+             << map_workers_[map_worker_id];
+  return false;
+}
+
+bool ShuffleFetcher::FetchSegments(int map_worker_id, int max_connect_retries,
+                                   int* index, vector<string>* filenames) {
+  const string& address = map_workers_[map_worker_id];
+  string ip;
+  uint16 port;
+  if (!SplitAddress(address, &ip, &port)) {
+    return false;
+  }
+
+  scoped_ptr<TCPSocket> socket;
+  for (int retry = 0; retry < max_connect_retries; ++retry) {
+    socket.reset(new TCPSocket);
+    if (socket->Connect(ip.c_str(), port)) {
+      break;
+    }
+    socket.reset(NULL);
+    sleep(kConnectRetryInterval);
+  }
+  if (socket.get() == NULL) {
+    LOG(ERROR) << "Cannot connect to map worker " << address;
+    return false;
+  }
+
+  scoped_array<char> buffer(new char[kFetchBufferSize]);
+  for (; ; ++*index) {
+    uint32 request[2];  // reduce_worker_id and segment index.
+    request[0] = reduce_worker_id_;
+    request[1] = *index;
+    int64 size = 0;
+    if (!SendAll(socket.get(), reinterpret_cast<char*>(request),
+                 sizeof(request)) ||
+        !ReceiveAll(socket.get(), reinterpret_cast<char*>(&size),
+                    sizeof(size))) {
+      LOG(ERROR) << "Failed requesting segment from " << address;
+      return false;
+    }
+    if (size < 0) {
+      break;  // No more segments.
+    }
+
+    string filename = SegmentFilename(map_worker_id, *index);
+    FILE* output = fopen(filename.c_str(), "w+");
+    if (output == NULL) {
+      LOG(ERROR) << "Cannot open fetched segment file: " << filename;
+      return false;
+    }
+    for (int64 received = 0; received < size; ) {
+      int chunk = std::min<int64>(size - received, kFetchBufferSize);
+      if (!ReceiveAll(socket.get(), buffer.get(), chunk) ||
+          fwrite(buffer.get(), 1, chunk, output) != chunk) {
+        LOG(ERROR) << "Failed fetching segment " << filename
+                   << " from " << address;
+        fclose(output);
+        remove(filename.c_str());  // Fetched again after reconnecting.
+        return false;
+      }
+      received += chunk;
+    }
+    if (fclose(output) != 0) {
+      LOG(ERROR) << "Failed writing fetched segment " << filename;
+      remove(filename.c_str());
+      return false;
+    }
+    LOG(INFO) << "Fetched " << filename << " (" << size << " bytes) from "
+              << address;
+    if (merger_ != NULL) {
+      merger_->Add(filename);  // Owned by merger_ from now on.
+    } else {
+      filenames->push_back(filename);
+    }
+  }
+  return true;
+}
+
+}  // namespace mapreduce_lite
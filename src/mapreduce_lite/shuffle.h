@@ -0,0 +1,178 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+// In batch reduction mode, ShuffleServer and ShuffleFetcher move
+// reduce input buffer files (segments) from map workers to reduce
+// workers, instead of the scheduler copying them using scp.
+//
+// Each map worker runs a ShuffleServer, to which each reduce worker
+// keeps one TCP connection.  Over the connection, the reduce worker
+// requests segments one by one, by sending its reduce worker id and
+// the zero-based index of the segment.  The map worker replies the
+// segment size (int64) followed by the content sent by sendfile(),
+// or -1 if no more segments would be published for the reduce
+// worker.  A request blocks until the segment is published, so reduce
+// workers can connect before map workers finish their work.
+//
+// If a connection breaks, the map worker closes it and keeps serving
+// other reduce workers, and the reduce worker reconnects and requests
+// the segment again.  A reduce worker is served after it receives -1.
+//
+#ifndef MAPREDUCE_LITE_SHUFFLE_H_
+#define MAPREDUCE_LITE_SHUFFLE_H_
+
+#include <time.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "boost/thread.hpp"
+
+#include "src/base/common.h"
+#include "src/base/scoped_ptr.h"
+#include "src/mapreduce_lite/tcp_socket.h"
+#include "src/system/condition_variable.h"
+#include "src/system/mutex.h"
+
+namespace sorted_buffer {
+class SortedFileMerger;
+}
+
+namespace mapreduce_lite {
+
+class ShuffleServer {
+ public:
+  ShuffleServer();
+  ~ShuffleServer();
+
+  // Listen on address ("ip:port") and serve in background threads.
+  bool Start(const std::string& address, int num_reduce_workers);
+
+  // Make segment file available to reduce worker reduce_worker_id.
+  // Segments of a reduce worker are served in the published order.
+  void Publish(int reduce_worker_id, const std::string& filename);
+
+  // Claim that no more segments will be published.
+  void Finish();
+
+  // Blocks until all reduce workers have fetched all segments, then
+  // stops serving.  Returns false if no segment was served for timeout
+  // seconds before all reduce workers were served.
+  bool WaitForReduceWorkers(int timeout);
+
+ private:
+  static void AcceptLoop(ShuffleServer* server);
+  static void ServeLoop(ShuffleServer* server, TCPSocket* socket);
+
+  // Blocks until the index-th segment of reduce_worker_id is
+  // published, or returns false if it will never be.
+  bool WaitForSegment(int reduce_worker_id, int index, std::string* filename);
+
+  bool IsStopping();
+
+  // Record that a segment is sent to reduce_worker_id, or all segments
+  // if done is true.
+  void MarkServed(int reduce_worker_id, bool done);
+
+  // Close the listener and all connections, and join threads.
+  void Stop();
+
+  TCPSocket listener_;
+  int num_reduce_workers_;
+
+  Mutex mutex_;                   // Protects the following.
+  ConditionVariable published_;   // Signaled by Publish() and Finish().
+  ConditionVariable served_;      // Signaled by MarkServed().
+  std::vector<std::vector<std::string> > segments_;
+  bool finished_;
+  bool stopping_;
+  std::set<int> served_reduce_workers_;
+  time_t last_served_time_;       // Of the last segment or Finish().
+  std::vector<TCPSocket*> sockets_;
+
+  scoped_ptr<boost::thread> accept_thread_;
+  boost::thread_group serve_threads_;
+
+  DISALLOW_COPY_AND_ASSIGN(ShuffleServer);
+};
+
+class ShuffleFetcher {
+ public:
+  // Fetched segments are saved as local files with filebase.
+  ShuffleFetcher(const std::vector<std::string>& map_workers,
+                 int reduce_worker_id,
+                 const std::string& filebase,
+                 int num_parallel_fetches);
+
+  // If merger is set, each fetched segment is added to it right away,
+  // so segments are merged while map workers are still working.  Does
+  // not take the ownership of merger.
+  void set_merger(sorted_buffer::SortedFileMerger* merger) {
+    merger_ = merger;
+  }
+
+  // Place fetched segments round-robin in dirs instead of beside
+  // filebase, so that parallel fetches write to different disks.
+  void set_spill_directories(const std::vector<std::string>& dirs) {
+    spill_dirs_ = dirs;
+  }
+
+  // Fetch segments from all map workers, with at most
+  // num_parallel_fetches map workers at a time.  Blocks until all
+  // map workers finished serving, and returns the local files, or the
+  // files left by SortedFileMerger::Finish() if merger is set.
+  bool FetchAll(std::vector<std::string>* filenames);
+
+  // The local file saving the index-th segment from map_worker_id.
+  std::string SegmentFilename(int map_worker_id, int index) const;
+
+ private:
+  static void FetchLoop(ShuffleFetcher* fetcher);
+
+  // Fetch all segments from a map worker, reconnecting if the
+  // connection breaks.
+  bool FetchFromMapWorker(int map_worker_id,
+                          std::vector<std::string>* filenames);
+
+  // Connect to a map worker, trying max_connect_retries times, and
+  // fetch segments from *index on.  *index is advanced past each
+  // fetched segment.  Returns true after the map worker replied that
+  // there are no more segments.
+  bool FetchSegments(int map_worker_id, int max_connect_retries, int* index,
+                     std::vector<std::string>* filenames);
+
+  std::vector<std::string> map_workers_;
+  int reduce_worker_id_;
+  std::string filebase_;
+  int num_parallel_fetches_;
+  sorted_buffer::SortedFileMerger* merger_;
+  std::vector<std::string> spill_dirs_;
+
+  Mutex mutex_;                      // Protects the following three.
+  int next_map_worker_;              // The next map worker to fetch from.
+  std::vector<std::string> fetched_;
+  bool failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(ShuffleFetcher);
+};
+
+}  // namespace mapreduce_lite
+
+#endif  // MAPREDUCE_LITE_SHUFFLE_H_
@@ -0,0 +1,164 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/mapreduce_lite/shuffle.h"
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/strutil/stringprintf.h"
+#include "gtest/gtest.h"
+
+using std::string;
+using std::vector;
+using mapreduce_lite::ShuffleFetcher;
+using mapreduce_lite::ShuffleServer;
+using mapreduce_lite::TCPSocket;
+
+namespace {
+
+void WriteFile(const string& filename, const string& content) {
+  FILE* file = fopen(filename.c_str(), "w");
+  CHECK(file != NULL);
+  CHECK_EQ(content.size(), fwrite(content.data(), 1, content.size(), file));
+  fclose(file);
+}
+
+string ReadFile(const string& filename) {
+  FILE* file = fopen(filename.c_str(), "r");
+  CHECK(file != NULL);
+  string content;
+  char buffer[1024];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    content.append(buffer, size);
+  }
+  fclose(file);
+  return content;
+}
+
+}  // namespace
+
+TEST(ShuffleTest, FetchFromTwoMapWorkers) {
+  static const char* kMapWorkers[] = { "127.0.0.1:11331", "127.0.0.1:11332" };
+  static const int kNumReduceWorkers = 2;
+  vector<string> map_workers(kMapWorkers, kMapWorkers + 2);
+
+  // Map worker m publishes segment i of reduce worker r with content
+  // "m-r-i", where the 2nd segment of each reduce worker is large.
+  ShuffleServer servers[2];
+  for (int m = 0; m < map_workers.size(); ++m) {
+    ASSERT_TRUE(servers[m].Start(map_workers[m], kNumReduceWorkers));
+  }
+  for (int m = 0; m < map_workers.size(); ++m) {
+    for (int r = 0; r < kNumReduceWorkers; ++r) {
+      for (int i = 0; i < 2; ++i) {
+        string filename = StringPrintf("/tmp/shuffle_test_segment-%d-%d-%d",
+                                       m, r, i);
+        string content = StringPrintf("%d-%d-%d", m, r, i);
+        if (i == 1) {
+          content.append(3 * 1024 * 1024, 'x');
+        }
+        WriteFile(filename, content);
+        servers[m].Publish(r, filename);
+      }
+    }
+    servers[m].Finish();
+  }
+
+  for (int r = 0; r < kNumReduceWorkers; ++r) {
+    ShuffleFetcher fetcher(map_workers, r, "/tmp/shuffle_test_fetched", 2);
+    vector<string> filenames;
+    ASSERT_TRUE(fetcher.FetchAll(&filenames));
+    EXPECT_EQ(4, filenames.size());
+    for (int m = 0; m < map_workers.size(); ++m) {
+      for (int i = 0; i < 2; ++i) {
+        string content = ReadFile(fetcher.SegmentFilename(m, i));
+        EXPECT_EQ(StringPrintf("%d-%d-%d", m, r, i), content.substr(0, 5));
+        EXPECT_EQ(i == 0 ? 5 : 5 + 3 * 1024 * 1024, content.size());
+        remove(fetcher.SegmentFilename(m, i).c_str());
+      }
+    }
+  }
+
+  for (int m = 0; m < map_workers.size(); ++m) {
+    EXPECT_TRUE(servers[m].WaitForReduceWorkers(10));
+  }
+}
+
+TEST(ShuffleTest, SurviveBadAndBrokenConnections) {
+  static const char* kMapWorker = "127.0.0.1:11333";
+  vector<string> map_workers(1, kMapWorker);
+  ShuffleServer server;
+  ASSERT_TRUE(server.Start(kMapWorker, 1));
+  string filename = "/tmp/shuffle_test_segment";
+  WriteFile(filename, string(3 * 1024 * 1024, 'x'));
+  server.Publish(0, filename);
+  server.Finish();
+
+  // A request for an unknown reduce worker is rejected by closing the
+  // connection.
+  TCPSocket bad_client;
+  ASSERT_TRUE(bad_client.Connect("127.0.0.1", 11333));
+  uint32 request[2] = { 99, 0 };
+  ASSERT_TRUE(SendAll(&bad_client, reinterpret_cast<char*>(request),
+                      sizeof(request)));
+  int64 size = 0;
+  EXPECT_FALSE(ReceiveAll(&bad_client, reinterpret_cast<char*>(&size),
+                          sizeof(size)));
+
+  // A reduce worker disconnecting in the middle of a segment.
+  TCPSocket broken_client;
+  ASSERT_TRUE(broken_client.Connect("127.0.0.1", 11333));
+  request[0] = 0;
+  ASSERT_TRUE(SendAll(&broken_client, reinterpret_cast<char*>(request),
+                      sizeof(request)));
+  ASSERT_TRUE(ReceiveAll(&broken_client, reinterpret_cast<char*>(&size),
+                         sizeof(size)));
+  EXPECT_EQ(3 * 1024 * 1024, size);
+  broken_client.Close();
+
+  // The map worker still serves the reduce worker reconnecting.
+  ShuffleFetcher fetcher(map_workers, 0, "/tmp/shuffle_test_fetched", 1);
+  vector<string> filenames;
+  ASSERT_TRUE(fetcher.FetchAll(&filenames));
+  ASSERT_EQ(1, filenames.size());
+  EXPECT_EQ(3 * 1024 * 1024, ReadFile(filenames[0]).size());
+  remove(filenames[0].c_str());
+  EXPECT_TRUE(server.WaitForReduceWorkers(10));
+  remove(filename.c_str());
+}
+
+TEST(ShuffleTest, TimeOutWaitingForReduceWorkers) {
+  static const char* kMapWorker = "127.0.0.1:11334";
+  vector<string> map_workers(1, kMapWorker);
+  ShuffleServer server;
+  ASSERT_TRUE(server.Start(kMapWorker, 2));
+  server.Finish();
+
+  // Reduce worker 1 never comes.
+  ShuffleFetcher fetcher(map_workers, 0, "/tmp/shuffle_test_fetched", 1);
+  vector<string> filenames;
+  ASSERT_TRUE(fetcher.FetchAll(&filenames));
+  EXPECT_EQ(0, filenames.size());
+  EXPECT_FALSE(server.WaitForReduceWorkers(1));
+}
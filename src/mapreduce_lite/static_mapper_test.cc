@@ -0,0 +1,87 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "gtest/gtest.h"
+
+#include "src/mapreduce_lite/mapreduce_lite.h"
+#include "src/mapreduce_lite/record_batch.h"
+
+DECLARE_int32(mr_map_worker_id);
+DECLARE_bool(mr_map_only);
+
+namespace {
+
+using mapreduce_lite::RecordBatch;
+
+// Shards keys by their first character.
+struct FirstCharPartitioner {
+  static int Shard(const std::string& key, int num_reduce_shards) {
+    return key.empty() ? 0 : key[0] % num_reduce_shards;
+  }
+};
+
+// Saves map inputs and their lazy keys.
+class SavingMapper
+    : public mapreduce_lite::StaticMapper<SavingMapper, FirstCharPartitioner> {
+ public:
+  void Map(const std::string& key, const std::string& value) {
+    keys.push_back(key);
+    values.push_back(value);
+    lazy_keys.push_back(LazyInputKey());
+  }
+
+  std::vector<std::string> keys;
+  std::vector<std::string> values;
+  std::vector<std::string> lazy_keys;
+};
+
+}  // namespace
+
+TEST(StaticMapperTest, MapBatch) {
+  RecordBatch batch;
+  batch.Add("k1", "v1", "");
+  batch.Add("", "v2", "lazy");
+  batch.Add("k3", "", "");
+
+  // MapBatch() checks the worker type.
+  FLAGS_mr_map_worker_id = 0;
+  FLAGS_mr_map_only = true;
+  SavingMapper mapper;
+  mapreduce_lite::Mapper* base = &mapper;
+  base->MapBatch(batch);
+  ASSERT_EQ(3, mapper.keys.size());
+  EXPECT_EQ("k1", mapper.keys[0]);
+  EXPECT_EQ("v1", mapper.values[0]);
+  EXPECT_EQ("", mapper.keys[1]);
+  EXPECT_EQ("lazy", mapper.lazy_keys[1]);
+  EXPECT_EQ("", mapper.values[2]);
+}
+
+TEST(StaticMapperTest, Shard) {
+  SavingMapper mapper;
+  mapreduce_lite::Mapper* base = &mapper;
+  EXPECT_EQ('a' % 3, base->Shard("abc", 3));
+  EXPECT_EQ(0, base->Shard("", 3));
+  EXPECT_EQ(JSHash("abc") % 7,
+            mapreduce_lite::HashPartitioner::Shard("abc", 7));
+}
@@ -25,8 +25,13 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
 #include <netinet/in.h>
 #include <pthread.h>
 #include <sys/socket.h>
+#include <stdlib.h>
 #include <unistd.h>
 
+#include <vector>
+
+#include "src/strutil/split_string.h"
+
 namespace mapreduce_lite {
 
 typedef struct sockaddr_in SAI;
@@ -66,6 +71,11 @@ bool TCPSocket::Bind(const char * ip, uint16 port) {
   sa_server.sin_family      = AF_INET;
   sa_server.sin_port        = htons(port);
 
+  // allow re-binding a port with connections in TIME_WAIT, e.g., of a
+  // previous job
+  int reuse = 1;
+  setsockopt(socket_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
   if (0 < inet_pton(AF_INET, ip, &sa_server.sin_addr) &&
       0 <= bind(socket_, reinterpret_cast<SA*>(&sa_server),
                 sizeof(sa_server))) {
@@ -154,4 +164,40 @@ int TCPSocket::Socket() const {
   return socket_;
 }
 
+bool SendAll(TCPSocket* socket, const char* data, int size) {
+  while (size > 0) {
+    int sent = socket->Send(data, size);
+    if (sent <= 0) {
+      return false;
+    }
+    data += sent;
+    size -= sent;
+  }
+  return true;
+}
+
+bool ReceiveAll(TCPSocket* socket, char* buffer, int size) {
+  while (size > 0) {
+    int received = socket->Receive(buffer, size);
+    if (received <= 0) {
+      return false;
+    }
+    buffer += received;
+    size -= received;
+  }
+  return true;
+}
+
+bool SplitAddress(const std::string& address, std::string* ip, uint16* port) {
+  std::vector<std::string> ip_and_port;
+  SplitStringUsing(address, ":", &ip_and_port);
+  if (ip_and_port.size() != 2) {
+    LOG(ERROR) << "Invalid address: " << address;
+    return false;
+  }
+  *ip = ip_and_port[0];
+  *port = atoi(ip_and_port[1].c_str());
+  return true;
+}
+
 }  // namespace mapreduce_lite
@@ -81,6 +81,14 @@ class TCPSocket {
   DISALLOW_COPY_AND_ASSIGN(TCPSocket);
 };
 
+// Send or receive exactly size bytes over a blocking socket.  Return
+// false on error or if the peer closed the connection.
+bool SendAll(TCPSocket* socket, const char* data, int size);
+bool ReceiveAll(TCPSocket* socket, char* buffer, int size);
+
+// Split address "ip:port".
+bool SplitAddress(const std::string& address, std::string* ip, uint16* port);
+
 }  // namespace mapreduce_lite
 
 #endif  // MAPREDUCE_LITE_TCP_SOCKET_H_
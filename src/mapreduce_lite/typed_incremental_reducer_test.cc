@@ -0,0 +1,93 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include <stdlib.h>
+
+#include <map>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "src/mapreduce_lite/mapreduce_lite.h"
+
+namespace {
+
+struct SumAndCount {
+  int sum;
+  int count;
+};
+
+// Sums up and counts values of each key.
+class SumReducer
+    : public mapreduce_lite::TypedIncrementalReducer<SumAndCount> {
+ public:
+  SumReducer() : num_inits(0) {}
+
+  virtual void Init(SumAndCount* state) {
+    ++num_inits;
+  }
+
+  virtual void Update(SumAndCount* state, const std::string& value) {
+    state->sum += atoi(value.c_str());
+    ++state->count;
+  }
+
+  virtual void Finalize(const std::string& key, const SumAndCount& state) {
+    sums[key] = state.sum;
+    counts[key] = state.count;
+  }
+
+  int num_inits;
+  std::map<std::string, int> sums;
+  std::map<std::string, int> counts;
+};
+
+}  // namespace
+
+TEST(TypedIncrementalReducerTest, Reduce) {
+  SumReducer reducer;
+  mapreduce_lite::IncrementalReducer* base = &reducer;
+
+  void* a = base->BeginReduce("a", "1");
+  void* b = base->BeginReduce("b", "10");
+  for (int i = 0; i < 10000; ++i) {       // Many states stay in place.
+    base->BeginReduce("x", "0");
+  }
+  base->PartialReduce("a", "2", a);
+  base->PartialReduce("b", "20", b);
+  base->PartialReduce("a", "3", a);
+  EXPECT_EQ(10002, reducer.num_inits);
+
+  base->EndReduce("a", a);
+  base->EndReduce("b", b);
+  EXPECT_EQ(6, reducer.sums["a"]);
+  EXPECT_EQ(3, reducer.counts["a"]);
+  EXPECT_EQ(30, reducer.sums["b"]);
+  EXPECT_EQ(2, reducer.counts["b"]);
+}
+
+TEST(TypedIncrementalReducerTest, ReuseAfterEndReduce) {
+  SumReducer reducer;
+  for (int round = 0; round < 2; ++round) {
+    void* a = reducer.BeginReduce("a", "5");
+    reducer.PartialReduce("a", "5", a);
+    reducer.EndReduce("a", a);
+    EXPECT_EQ(10, reducer.sums["a"]);    // Each round starts from zero.
+  }
+}
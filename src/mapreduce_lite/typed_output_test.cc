@@ -0,0 +1,82 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "src/mapreduce_lite/mapreduce_lite.h"
+#include "src/sorted_buffer/sorted_buffer_iterator.h"
+
+namespace {
+
+// Keeps map outputs instead of sending them to reduce workers.
+class TypedOutputMapper : public mapreduce_lite::Mapper {
+ public:
+  using Mapper::Output;
+
+  virtual void Map(const std::string& key, const std::string& value) {
+    Output(key, 7);
+    Output(key, static_cast<int64>(-1) << 40);
+    Output(key, 0.25);
+    Output(key, value.data(), 3);
+  }
+
+  virtual void Output(const std::string& key, const std::string& value) {
+    values.push_back(value);
+  }
+
+  std::vector<std::string> values;
+};
+
+// Iterates over values of a key in memory.
+class VectorIterator : public mapreduce_lite::ReduceInputIterator {
+ public:
+  explicit VectorIterator(const std::vector<std::string>& values)
+      : values_(values), index_(0) {}
+  virtual const std::string& key() const { return key_; }
+  virtual const std::string& value() const { return values_[index_]; }
+  virtual bool Done() const { return index_ >= values_.size(); }
+  virtual void Next() { ++index_; }
+  virtual void DiscardRestValues() { index_ = values_.size(); }
+
+ private:
+  std::string key_;
+  const std::vector<std::string>& values_;
+  int index_;
+};
+
+}  // namespace
+
+TEST(TypedOutputTest, MapAndReduce) {
+  TypedOutputMapper mapper;
+  mapper.Map("key", "abcdef");
+  ASSERT_EQ(4, mapper.values.size());
+  EXPECT_EQ(sizeof(int64), mapper.values[0].size());
+  EXPECT_EQ(sizeof(double), mapper.values[2].size());
+  EXPECT_EQ("abc", mapper.values[3]);
+
+  VectorIterator values(mapper.values);
+  EXPECT_EQ(7, values.value_int64());
+  values.Next();
+  EXPECT_EQ(static_cast<int64>(-1) << 40, values.value_int64());
+  values.Next();
+  EXPECT_EQ(0.25, values.value_double());
+}
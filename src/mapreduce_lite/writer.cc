@@ -0,0 +1,230 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/mapreduce_lite/writer.h"
+
+#include "src/mapreduce_lite/bgzf.h"
+#include "src/mapreduce_lite/flags.h"
+#include "src/mapreduce_lite/protofile.h"
+
+namespace mapreduce_lite {
+
+// A writer hands its output buffer to the flushing thread once the
+// buffer has this number of bytes.
+static const int kWriterBufferSize = 4 * 1024 * 1024;     // 4 MB
+
+static const int kBlockFileBlockSize = 1024 * 1024;       // 1 MB
+
+CLASS_REGISTER_IMPLEMENT_REGISTRY(mapreduce_lite_writer_registry, Writer);
+REGISTER_WRITER("text", TextWriter);
+REGISTER_WRITER("bgzf_text", BgzfTextWriter);
+REGISTER_WRITER("protofile", ProtoRecordWriter);
+REGISTER_WRITER("blockfile", BlockFileRecordWriter);
+
+//-----------------------------------------------------------------------------
+// Implementation of Writer
+//-----------------------------------------------------------------------------
+Writer::Writer()
+    : output_stream_(NULL),
+      has_pending_(false),
+      closing_(false),
+      failed_(false) {}
+
+Writer::~Writer() {
+  Close();
+}
+
+bool Writer::Open(const std::string& filename) {
+  CHECK(output_stream_ == NULL);
+  filename_ = filename;
+  output_stream_ = fopen(filename.c_str(), "w");
+  if (output_stream_ == NULL) {
+    LOG(ERROR) << "Cannot open output file: " << filename;
+    return false;
+  }
+  buffer_.reserve(kWriterBufferSize);
+  flushing_.reserve(kWriterBufferSize);
+  has_pending_ = closing_ = failed_ = false;
+  flush_thread_.reset(new boost::thread(FlushLoop, this));
+  Start();
+  return true;
+}
+
+bool Writer::Close() {
+  if (output_stream_ == NULL) {
+    return true;
+  }
+  Finish();
+  HandOff();
+  {
+    MutexLocker locker(&mutex_);
+    closing_ = true;
+    pending_.Signal();
+  }
+  flush_thread_->join();
+  flush_thread_.reset(NULL);
+
+  if (fclose(output_stream_) != 0) {
+    LOG(ERROR) << "Failed closing output file: " << filename_;
+    failed_ = true;
+  }
+  output_stream_ = NULL;
+  return !failed_;
+}
+
+void Writer::MaybeFlush() {
+  if (buffer_.size() >= kWriterBufferSize) {
+    HandOff();
+  }
+}
+
+void Writer::HandOff() {
+  MutexLocker locker(&mutex_);
+  while (has_pending_) {
+    flushed_.Wait(&mutex_);
+  }
+  // flushing_ was cleared by FlushLoop, and keeps its capacity.
+  buffer_.swap(flushing_);
+  has_pending_ = true;
+  pending_.Signal();
+}
+
+void Writer::FlushLoop(Writer* writer) {
+  while (true) {
+    {
+      MutexLocker locker(&writer->mutex_);
+      while (!writer->has_pending_ && !writer->closing_) {
+        writer->pending_.Wait(&writer->mutex_);
+      }
+      if (!writer->has_pending_) {
+        return;
+      }
+    }
+    // HandOff() does not touch flushing_ while has_pending_ is set.
+    const std::string& data = writer->flushing_;
+    bool failed = !data.empty() &&
+        fwrite(data.data(), data.size(), 1, writer->output_stream_) != 1;
+    if (failed) {
+      LOG(ERROR) << "Failed writing " << data.size() << " bytes to "
+                 << writer->filename_;
+    }
+    MutexLocker locker(&writer->mutex_);
+    writer->failed_ = writer->failed_ || failed;
+    writer->flushing_.clear();
+    writer->has_pending_ = false;
+    writer->flushed_.Signal();
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of TextWriter
+//-----------------------------------------------------------------------------
+void TextWriter::Write(const std::string& key, const std::string& value) {
+  OutputBuffer()->append(value);
+  OutputBuffer()->push_back('\n');
+  MaybeFlush();
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of BgzfTextWriter
+//-----------------------------------------------------------------------------
+static void CompressBgzfBlock(const std::string& data, std::string* block) {
+  DeflateBgzfBlock(data.data(), data.size(), block);
+}
+
+BgzfTextWriter::~BgzfTextWriter() {
+  Close();
+}
+
+void BgzfTextWriter::Start() {
+  compressor_.reset(new ParallelCompressor(CompressBgzfBlock,
+                                           NumCodecThreads()));
+  text_.clear();
+}
+
+void BgzfTextWriter::Write(const std::string& key, const std::string& value) {
+  text_.append(value);
+  text_.push_back('\n');
+  if (text_.size() >= kBgzfMaxDataSize) {
+    CompressText(false);
+  }
+}
+
+void BgzfTextWriter::Finish() {
+  CompressText(true);
+  OutputBuffer()->append(kBgzfEofBlock, kBgzfEofBlockSize);
+  compressor_.reset(NULL);
+}
+
+void BgzfTextWriter::CompressText(bool all) {
+  // Blocks may end in the middle of lines.
+  size_t begin = 0;
+  while (begin + kBgzfMaxDataSize <= text_.size() ||
+         (all && begin < text_.size())) {
+    block_.assign(text_, begin, kBgzfMaxDataSize);
+    begin += block_.size();
+    compressor_->Add(&block_);
+    while (compressor_->Take(&block_, compressor_->Full())) {
+      OutputBuffer()->append(block_);
+      MaybeFlush();
+    }
+  }
+  text_.erase(0, begin);
+  while (all && compressor_->Take(&block_, true)) {
+    OutputBuffer()->append(block_);
+    MaybeFlush();
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of ProtoRecordWriter
+//-----------------------------------------------------------------------------
+void ProtoRecordWriter::Write(const std::string& key,
+                              const std::string& value) {
+  protofile::AppendRecord(key.data(), key.size(), value.data(), value.size(),
+                          OutputBuffer());
+  MaybeFlush();
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of BlockFileRecordWriter
+//-----------------------------------------------------------------------------
+BlockFileRecordWriter::~BlockFileRecordWriter() {
+  Close();
+}
+
+void BlockFileRecordWriter::Start() {
+  writer_.reset(new BlockFileWriter(
+      OutputBuffer(), kBlockFileBlockSize,
+      CompressOutput() ? kBlockFileZlibCompression : kBlockFileNoCompression,
+      NumCodecThreads()));
+}
+
+void BlockFileRecordWriter::Write(const std::string& key,
+                                  const std::string& value) {
+  writer_->Write(key, value);
+  MaybeFlush();
+}
+
+void BlockFileRecordWriter::Finish() {
+  writer_->Close();
+  writer_.reset(NULL);
+}
+
+}  // namespace mapreduce_lite
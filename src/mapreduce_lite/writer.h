@@ -0,0 +1,187 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+// Writer is the interface of output formats of reduce workers and
+// map-only workers.  A writer is created by the format name, which is
+// resolved once when MapReduce Lite initializes, and each output file
+// has a writer.
+//
+// Writers encode records into a large output buffer.  Once the buffer
+// is full, it is swapped with a second buffer, which a background
+// thread writes to the file, so the reducer keeps encoding records
+// while the previous buffer is being written.  The reducer waits only
+// if it fills a buffer before the previous one is written.
+//
+#ifndef MAPREDUCE_LITE_WRITER_H_
+#define MAPREDUCE_LITE_WRITER_H_
+
+#include <stdio.h>
+
+#include <string>
+
+#include "boost/thread.hpp"
+
+#include "src/base/class_register.h"
+#include "src/base/common.h"
+#include "src/base/scoped_ptr.h"
+#include "src/mapreduce_lite/blockfile.h"
+#include "src/mapreduce_lite/parallel_compressor.h"
+#include "src/system/condition_variable.h"
+#include "src/system/mutex.h"
+
+namespace mapreduce_lite {
+
+//-----------------------------------------------------------------------------
+// The interface implemented by ``real'' writers.
+//-----------------------------------------------------------------------------
+class Writer {
+ public:
+  Writer();
+  // Invokes Close(), where Finish() is not dispatched to derived
+  // writers any more, so those overriding Finish() invoke Close() in
+  // their own destructors.
+  virtual ~Writer();
+
+  // Creates or truncates filename, and starts the flushing thread.
+  bool Open(const std::string& filename);
+
+  virtual void Write(const std::string& key, const std::string& value) = 0;
+
+  // Writes the rest of the output and closes the file.  Returns false
+  // if any write failed.
+  bool Close();
+
+ protected:
+  // Derived writers append encoded records to the output buffer, and
+  // then invoke MaybeFlush().
+  std::string* OutputBuffer() { return &buffer_; }
+  void MaybeFlush();
+
+  // Invoked by Open(), e.g., to write a file header.
+  virtual void Start() {}
+  // Invoked by Close() before the output buffer is flushed, e.g., to
+  // write a file trailer.
+  virtual void Finish() {}
+
+ private:
+  static void FlushLoop(Writer* writer);
+
+  // Hands buffer_ to the flushing thread, waiting for it to finish
+  // writing the previous buffer.
+  void HandOff();
+
+  std::string filename_;
+  FILE* output_stream_;
+  std::string buffer_;               // Filled by Write().
+
+  Mutex mutex_;                      // Protects the following five.
+  ConditionVariable pending_;        // Signaled by HandOff() and Close().
+  ConditionVariable flushed_;        // Signaled by FlushLoop().
+  std::string flushing_;             // Written by the flushing thread.
+  bool has_pending_;                 // flushing_ is to be written.
+  bool closing_;
+  bool failed_;
+  scoped_ptr<boost::thread> flush_thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(Writer);
+};
+
+
+//-----------------------------------------------------------------------------
+// Write the value of each record as a line.
+//-----------------------------------------------------------------------------
+class TextWriter : public Writer {
+ public:
+  virtual void Write(const std::string& key, const std::string& value);
+};
+
+
+//-----------------------------------------------------------------------------
+// Write the value of each record as a line into a BGZF file (see
+// bgzf.h), which can be read by zcat and the "gzip_text" and
+// "bgzf_text" readers.  Blocks are compressed in
+// --mr_num_codec_threads threads.
+//-----------------------------------------------------------------------------
+class BgzfTextWriter : public Writer {
+ public:
+  virtual ~BgzfTextWriter();  // Invokes Close().
+
+  virtual void Write(const std::string& key, const std::string& value);
+
+ protected:
+  virtual void Start();
+  virtual void Finish();
+
+ private:
+  // Compress full blocks of text_, or all of text_ if all is true,
+  // and append compressed blocks to the output buffer.
+  void CompressText(bool all);
+
+  scoped_ptr<ParallelCompressor> compressor_;
+  std::string text_;         // Lines not compressed yet.
+  std::string block_;
+};
+
+
+//-----------------------------------------------------------------------------
+// Write each record as a KeyValuePair proto message in a protofile.
+//-----------------------------------------------------------------------------
+class ProtoRecordWriter : public Writer {
+ public:
+  virtual void Write(const std::string& key, const std::string& value);
+};
+
+
+//-----------------------------------------------------------------------------
+// Write records into a blockfile (see blockfile.h), whose blocks are
+// compressed in --mr_num_codec_threads threads if --mr_compress_output
+// is set.
+//-----------------------------------------------------------------------------
+class BlockFileRecordWriter : public Writer {
+ public:
+  virtual ~BlockFileRecordWriter();  // Invokes Close().
+
+  virtual void Write(const std::string& key, const std::string& value);
+
+ protected:
+  virtual void Start();
+  virtual void Finish();
+
+ private:
+  scoped_ptr<BlockFileWriter> writer_;
+};
+
+
+CLASS_REGISTER_DEFINE_REGISTRY(mapreduce_lite_writer_registry, Writer);
+
+#define REGISTER_WRITER(format_name, writer_name)       \
+  CLASS_REGISTER_OBJECT_CREATOR(                        \
+      mapreduce_lite_writer_registry,                   \
+      Writer,                                           \
+      format_name,                                      \
+      writer_name)
+
+#define CREATE_WRITER(format_name)              \
+  CLASS_REGISTER_CREATE_OBJECT(                 \
+      mapreduce_lite_writer_registry,           \
+      format_name)
+
+}  // namespace mapreduce_lite
+
+#endif  // MAPREDUCE_LITE_WRITER_H_
@@ -0,0 +1,153 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/mapreduce_lite/writer.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "src/base/scoped_ptr.h"
+#include "src/mapreduce_lite/reader.h"
+#include "src/strutil/stringprintf.h"
+
+namespace mapreduce_lite {
+namespace {
+
+const char* kFilename = "/tmp/writer_test";
+// Enough records to fill several output buffers.
+const int kNumRecords = 200000;
+
+std::string Key(int i) { return StringPrintf("key-%d", i); }
+std::string Value(int i) {
+  // Text values cannot have '\n', but may have '\0'.
+  std::string value = StringPrintf("value-%d", i);
+  value.push_back('\0');
+  return value + std::string(i % 100, 'a' + i % 26);
+}
+
+// Write records in format, and read them back with the reader of the
+// same format.
+void CheckWriteAndRead(const std::string& format) {
+  scoped_ptr<Writer> writer(CREATE_WRITER(format));
+  ASSERT_TRUE(writer.get() != NULL);
+  ASSERT_TRUE(writer->Open(kFilename));
+  for (int i = 0; i < kNumRecords; ++i) {
+    writer->Write(Key(i), Value(i));
+  }
+  EXPECT_TRUE(writer->Close());
+
+  scoped_ptr<Reader> reader(CREATE_READER(format));
+  ASSERT_TRUE(reader.get() != NULL);
+  reader->Open(kFilename);
+  std::string key, value;
+  for (int i = 0; i < kNumRecords; ++i) {
+    ASSERT_TRUE(reader->Read(&key, &value));
+    EXPECT_EQ(Key(i), key);
+    EXPECT_EQ(Value(i), value);
+  }
+  EXPECT_FALSE(reader->Read(&key, &value));
+  reader->Close();
+  remove(kFilename);
+}
+
+}  // namespace
+
+TEST(WriterTest, CreateWriter) {
+  EXPECT_TRUE(CREATE_WRITER("text") != NULL);
+  EXPECT_TRUE(CREATE_WRITER("bgzf_text") != NULL);
+  EXPECT_TRUE(CREATE_WRITER("protofile") != NULL);
+  EXPECT_TRUE(CREATE_WRITER("blockfile") != NULL);
+  EXPECT_TRUE(CREATE_WRITER("unknown") == NULL);
+}
+
+TEST(WriterTest, WriteAndRead) {
+  CheckWriteAndRead("protofile");
+  CheckWriteAndRead("blockfile");
+}
+
+TEST(WriterTest, TextWriterKeepsNul) {
+  scoped_ptr<Writer> writer(CREATE_WRITER("text"));
+  ASSERT_TRUE(writer->Open(kFilename));
+  for (int i = 0; i < kNumRecords; ++i) {
+    writer->Write(Key(i), Value(i));
+  }
+  EXPECT_TRUE(writer->Close());
+
+  scoped_ptr<Reader> reader(CREATE_READER("mmap_text"));
+  reader->Open(kFilename);
+  std::string key, value;
+  for (int i = 0; i < kNumRecords; ++i) {
+    ASSERT_TRUE(reader->Read(&key, &value));
+    EXPECT_EQ(Value(i), value);
+  }
+  EXPECT_FALSE(reader->Read(&key, &value));
+  reader->Close();
+  remove(kFilename);
+}
+
+TEST(WriterTest, BgzfTextWriter) {
+  scoped_ptr<Writer> writer(CREATE_WRITER("bgzf_text"));
+  ASSERT_TRUE(writer->Open(kFilename));
+  for (int i = 0; i < kNumRecords; ++i) {
+    writer->Write(Key(i), Value(i));
+  }
+  EXPECT_TRUE(writer->Close());
+
+  const char* formats[] = { "bgzf_text", "gzip_text" };
+  for (int f = 0; f < 2; ++f) {
+    scoped_ptr<Reader> reader(CREATE_READER(formats[f]));
+    reader->Open(kFilename);
+    std::string key, value;
+    for (int i = 0; i < kNumRecords; ++i) {
+      ASSERT_TRUE(reader->Read(&key, &value));
+      EXPECT_EQ(Value(i), value);
+    }
+    EXPECT_FALSE(reader->Read(&key, &value));
+  }
+  remove(kFilename);
+}
+
+// Deleting a writer closes it with its own trailer.
+TEST(WriterTest, CloseByDestructor) {
+  const char* formats[] = { "bgzf_text", "blockfile" };
+  for (int f = 0; f < 2; ++f) {
+    {
+      scoped_ptr<Writer> writer(CREATE_WRITER(formats[f]));
+      ASSERT_TRUE(writer->Open(kFilename));
+      writer->Write(Key(0), Value(0));
+    }
+    scoped_ptr<Reader> reader(CREATE_READER(formats[f]));
+    reader->Open(kFilename);
+    std::string key, value;
+    ASSERT_TRUE(reader->Read(&key, &value));
+    EXPECT_EQ(Value(0), value);
+    EXPECT_FALSE(reader->Read(&key, &value));
+    reader->Close();
+  }
+  remove(kFilename);
+}
+
+TEST(WriterTest, CloseWithoutOpen) {
+  scoped_ptr<Writer> writer(CREATE_WRITER("text"));
+  EXPECT_TRUE(writer->Close());
+  EXPECT_FALSE(writer->Open("/nonexistent/directory/file"));
+}
+
+}  // namespace mapreduce_lite
@@ -66,19 +66,18 @@ bool ReadMemoryPiece(FILE* input, std::string* piece) {
   if (!ReadVarint32(input, &size)) {
     return false;
   }
-  // TODO(rickjin): make this re-entrant
+  // Read directly into piece, so that files can be read (e.g., merged)
+  // by multiple threads.
   static const int kMaxBufferSize = 32 * 1024 * 1024;
-  static char buffer[kMaxBufferSize];
   if (size >= kMaxBufferSize) {
     LOG(FATAL) << "The size of string exceeds kMaxBufferSize "
                << kMaxBufferSize;
   }
   piece->resize(size);
   if (size > 0) {
-    if (fread(buffer, 1, size, input) < size) {
+    if (fread(&(*piece)[0], 1, size, input) < size) {
       return false;
     }
-    piece->assign(buffer, size);
   }
   return true;
 }
@@ -36,16 +36,62 @@ std::string SortedBuffer::SortedFilename(const std::string filebase,
   return StringPrintf("%s-%010d", filebase.c_str(), index);
 }
 
+/*static*/
+std::string SortedBuffer::SpillFilename(const std::string& filebase,
+                                        const std::vector<std::string>& dirs,
+                                        int index) {
+  if (dirs.empty()) {
+    return SortedFilename(filebase, index);
+  }
+  std::string::size_type slash = filebase.rfind('/');
+  std::string basename = (slash == std::string::npos) ?
+      filebase : filebase.substr(slash + 1);
+  return SortedFilename(dirs[index % dirs.size()] + "/" + basename, index);
+}
+
+namespace {
+
+// Poor guy's singleton.  NULL if async I/O is not enabled.
+boost::scoped_ptr<AsyncFileOptions>& GetAsyncFileOptions() {
+  static boost::scoped_ptr<AsyncFileOptions> async_file_options;
+  return async_file_options;
+}
+
+}  // namespace
+
+/*static*/
+void SortedBuffer::EnableAsyncIO(const AsyncFileOptions& options) {
+  GetAsyncFileOptions().reset(new AsyncFileOptions(options));
+}
+
+/*static*/
+bool SortedBuffer::AsyncIOEnabled() {
+  return GetAsyncFileOptions().get() != NULL;
+}
+
+/*static*/
+FILE* SortedBuffer::OpenSortedFile(const std::string& filename,
+                                   const char* mode) {
+  if (AsyncIOEnabled()) {
+    return OpenAsyncFile(filename, mode, *GetAsyncFileOptions());
+  }
+  return fopen(filename.c_str(), mode);
+}
+
 SortedBuffer::SortedBuffer(const std::string& filebase,
                                      int in_memory_buffer_size)
     : filebase_(filebase),
       allocator_(new NaiveMemoryAllocator(in_memory_buffer_size)),
-      count_files_(0) {
+      count_files_(0),
+      merging_(false),
+      merge_factor_(0),
+      combiner_(NULL) {
   CHECK(allocator_->IsInitialized());  // Ensure the memory pool is allocated.
 }
 
 SortedBuffer::~SortedBuffer() {
   Flush();
+  WaitForBackgroundMerge();
 }
 
 void SortedBuffer::Insert(const std::string& key,
@@ -85,14 +131,12 @@ void SortedBuffer::Flush() {
   if (!allocator_->IsInitialized() || allocator_->AllocatedSize() == 0)
     return;
 
-  FILE* output = fopen(SortedFilename(filebase_, count_files_).c_str(), "w+");
+  std::string filename = NewFilename();
+  FILE* output = OpenSortedFile(filename, "w");
   if (output == NULL) {
-    LOG(FATAL) << "Cannot open disk swap file: "
-               << SortedFilename(filebase_, count_files_);
+    LOG(FATAL) << "Cannot open disk swap file: " << filename;
   }
 
-  ++count_files_;
-
   std::sort(key_value_list_.begin(), key_value_list_.end(),
             KeyValuePairLessThan);
 
@@ -114,24 +158,216 @@ void SortedBuffer::Flush() {
     }
   }
 
-  fclose(output);
+  // Write errors of async I/O are reported only by fclose.
+  if (fclose(output) != 0) {
+    LOG(FATAL) << "Error writing disk swap file: " << filename;
+  }
   key_value_list_.clear();
   allocator_->Reset();
+
+  {
+    MutexLocker locker(&mutex_);
+    sorted_files_.push_back(filename);
+  }
+  if (!flush_callback_.empty()) {
+    flush_callback_(filename);
+  }
+  MaybeStartBackgroundMerge();
+}
+
+int SortedBuffer::NumFiles() {
+  MutexLocker locker(&mutex_);
+  return sorted_files_.size();
+}
+
+std::vector<std::string> SortedBuffer::Filenames() {
+  MutexLocker locker(&mutex_);
+  return sorted_files_;
+}
+
+void SortedBuffer::SetSpillDirectories(const std::vector<std::string>& dirs) {
+  CHECK_EQ(0, count_files_);
+  spill_dirs_ = dirs;
+}
+
+std::string SortedBuffer::NewFilename() {
+  return SpillFilename(filebase_, spill_dirs_, count_files_++);
+}
+
+void SortedBuffer::EnableBackgroundMerge(int merge_factor,
+                                         Combiner* combiner) {
+  if (merge_factor > 1 && !flush_callback_.empty()) {
+    LOG(FATAL) << "Background merge does not work with flush callback.";
+  }
+  merge_factor_ = merge_factor;
+  combiner_ = combiner;
+}
+
+void SortedBuffer::SetFlushCallback(const FlushCallback& callback) {
+  if (merge_factor_ > 1) {
+    LOG(FATAL) << "Flush callback does not work with background merge.";
+  }
+  flush_callback_ = callback;
+}
+
+void SortedBuffer::MaybeStartBackgroundMerge() {
+  if (merge_factor_ <= 1) {
+    return;
+  }
+
+  std::vector<std::string> inputs;
+  {
+    MutexLocker locker(&mutex_);
+    if (merging_ || sorted_files_.size() < merge_factor_) {
+      return;
+    }
+    inputs.assign(sorted_files_.begin(),
+                  sorted_files_.begin() + merge_factor_);
+    sorted_files_.erase(sorted_files_.begin(),
+                        sorted_files_.begin() + merge_factor_);
+    merging_ = true;
+  }
+
+  if (merge_thread_.get() != NULL) {
+    merge_thread_->join();  // The previous merge has finished.
+  }
+  std::string output = NewFilename();
+  merge_thread_.reset(new boost::thread(BackgroundMerge, this,
+                                        inputs, output));
+}
+
+/*static*/
+void SortedBuffer::BackgroundMerge(SortedBuffer* buffer,
+                                   std::vector<std::string> inputs,
+                                   std::string output) {
+  MergeSortedFiles(inputs, output, buffer->combiner_, 0);
+  for (int i = 0; i < inputs.size(); ++i) {
+    if (remove(inputs[i].c_str()) < 0) {
+      LOG(ERROR) << "Cannot remove merged file: " << inputs[i];
+    }
+  }
+
+  MutexLocker locker(&buffer->mutex_);
+  buffer->sorted_files_.push_back(output);
+  buffer->merging_ = false;
+}
+
+void SortedBuffer::WaitForBackgroundMerge() {
+  if (merge_thread_.get() != NULL) {
+    merge_thread_->join();
+    merge_thread_.reset(NULL);
+  }
+}
+
+void SortedBuffer::MergeFiles() {
+  Flush();
+  WaitForBackgroundMerge();
+  if (sorted_files_.size() <= 1) {
+    return;
+  }
+
+  std::string output = NewFilename();
+  MergeSortedFiles(sorted_files_, output, combiner_, 0);
+  for (int i = 0; i < sorted_files_.size(); ++i) {
+    if (remove(sorted_files_[i].c_str()) < 0) {
+      LOG(ERROR) << "Cannot remove merged file: " << sorted_files_[i];
+    }
+  }
+  sorted_files_.clear();
+  sorted_files_.push_back(output);
+}
+
+namespace {
+
+void WriteString(FILE* output, const std::string& str,
+                 const std::string& filename) {
+  if (!WriteVarint32(output, str.size()) ||
+      fwrite(str.data(), 1, str.size(), output) != str.size()) {
+    LOG(FATAL) << "Error writing merged file: " << filename;
+  }
+}
+
+void WriteValues(FILE* output, const std::string& key,
+                 const std::vector<std::string>& values,
+                 const std::string& filename) {
+  if (values.empty()) {
+    return;
+  }
+  WriteString(output, key, filename);
+  CHECK_LT(values.size(), kInt32Max);
+  WriteVarint32(output, values.size());
+  for (int i = 0; i < values.size(); ++i) {
+    WriteString(output, values[i], filename);
+  }
+}
+
+}  // namespace
+
+/*static*/
+void SortedBuffer::MergeSortedFiles(const std::vector<std::string>& inputs,
+                                    const std::string& output_filename,
+                                    Combiner* combiner,
+                                    int read_buffer_size) {
+  // Without a combiner, values of a key are copied in chunks of at
+  // most this size, each written as a key followed by its values.
+  // SortedBufferIteratorImpl concatenates consecutive chunks of the
+  // same key, so this bounds memory usage for hot keys.
+  static const int kMaxChunkSize = 4 * 1024 * 1024;
+
+  FILE* output = OpenSortedFile(output_filename, "w");
+  if (output == NULL) {
+    LOG(FATAL) << "Cannot open merged file: " << output_filename;
+  }
+
+  SortedBufferIteratorImpl iter(inputs, read_buffer_size);
+  std::vector<std::string> values;
+  for (; !iter.FinishedAll(); iter.NextKey()) {
+    values.clear();
+    if (combiner != NULL) {
+      combiner->Combine(iter.key(), &iter, &values);
+    } else {
+      int chunk_size = 0;
+      for (; !iter.Done(); iter.Next()) {
+        values.push_back(iter.value());
+        chunk_size += iter.value().size();
+        if (chunk_size >= kMaxChunkSize) {
+          WriteValues(output, iter.key(), values, output_filename);
+          values.clear();
+          chunk_size = 0;
+        }
+      }
+    }
+    WriteValues(output, iter.key(), values, output_filename);
+  }
+
+  // Inputs are removed after merging, so a short merged file would
+  // lose records.
+  if (fclose(output) != 0) {
+    LOG(FATAL) << "Error writing merged file: " << output_filename;
+  }
 }
 
 SortedBufferIterator* SortedBuffer::CreateIterator() const {
   if (allocator_->AllocatedSize() > 0) {
     LOG(FATAL) << "You must invoke Flush before CreateIterator.";
   }
-  return new SortedBufferIteratorImpl(filebase_, count_files_);
+  if (merge_thread_.get() != NULL) {
+    LOG(FATAL) << "You must invoke MergeFiles before CreateIterator if "
+               << "background merge is enabled.";
+  }
+  return new SortedBufferIteratorImpl(sorted_files_);
 }
 
 void SortedBuffer::RemoveBufferFiles() const {
   if (allocator_->AllocatedSize() > 0) {
     LOG(FATAL) << "You must invoke Flush before RemoveBufferFiles.";
   }
-  for (int i = 0; i < count_files_; ++i) {
-    std::string filename = SortedFilename(filebase_, i);
+  if (merge_thread_.get() != NULL) {
+    LOG(FATAL) << "You must invoke MergeFiles before RemoveBufferFiles if "
+               << "background merge is enabled.";
+  }
+  for (int i = 0; i < sorted_files_.size(); ++i) {
+    const std::string& filename = sorted_files_[i];
     LOG(INFO) << "Removing : " << filename;
     if (remove(filename.c_str()) < 0) {
       LOG(ERROR) << "Cannot remove file: " << filename;
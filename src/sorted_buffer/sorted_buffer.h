@@ -25,23 +25,48 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
 #include <string>
 #include <vector>
 
+#include "boost/function.hpp"
 #include "boost/scoped_ptr.hpp"
+#include "boost/thread.hpp"
 
 #include "src/base/common.h"
 #include "src/sorted_buffer/memory_piece.h"
 #include "src/sorted_buffer/memory_allocator.h"
+#include "src/system/async_file.h"
+#include "src/system/mutex.h"
 
 namespace sorted_buffer {
 
 class SortedBufferIterator;
 
+// A combiner collapses the values of a key, which come from several
+// buffer files, into fewer values (e.g., summing up partial word
+// counts).  Combine() appends the combined values to *combined; values
+// not consumed from the iterator are discarded by the caller.
+class Combiner {
+ public:
+  virtual ~Combiner() {}
+  virtual void Combine(const std::string& key,
+                       SortedBufferIterator* values,
+                       std::vector<std::string>* combined) = 0;
+};
+
 // To buffer a massive set of map outputs (key-value pairs) sorted by
 // key.  Once the buffer is close to full, the content is output into
 // a disk file and the buffer is cleared.  This ensures that key-value
 // pairs in each file are sorted.  This gives SortedBufferIterator the
 // chance to traverse all files for sorted map outputs.
+//
+// If EnableBackgroundMerge() is invoked, once there are merge_factor
+// buffer files on disk, Flush() starts a background thread that
+// merges them into one, so the number of files is kept small while
+// the buffer continues accepting inputs.  MergeFiles() merges all
+// buffer files into a single one, e.g., before shipping them to a
+// reduce worker.
 class SortedBuffer {
  public:
+  typedef boost::function<void (const std::string&)> FlushCallback;
+
   SortedBuffer(const std::string& disk_file_base,
                     int in_memory_buffer_size);
   ~SortedBuffer();
@@ -50,6 +75,27 @@ class SortedBuffer {
 
   void Flush();
 
+  // Does not take the ownership of combiner, which can be NULL.  The
+  // combiner is invoked only by the merging thread, so it needs not
+  // be thread-safe as long as it is not shared by other buffers.
+  void EnableBackgroundMerge(int merge_factor, Combiner* combiner);
+
+  // callback is invoked with each buffer file right after Flush()
+  // writes it, e.g., to ship the file before the buffer is full again.
+  // As the file may be in use by others, it cannot be merged, so this
+  // does not work with background merge.
+  void SetFlushCallback(const FlushCallback& callback);
+
+  // Place buffer files round-robin in dirs (e.g., one per local disk)
+  // instead of beside disk_file_base, so that dumping and merging
+  // spread over disks.  Files are named after the last component of
+  // disk_file_base.  Invoke before inserting anything.
+  void SetSpillDirectories(const std::vector<std::string>& dirs);
+
+  // Flush, wait for the background merge, and merge all buffer files
+  // into one.
+  void MergeFiles();
+
   // The caller is responsible to delete the iterator.
   SortedBufferIterator* CreateIterator() const;
 
@@ -58,8 +104,37 @@ class SortedBuffer {
 
   static std::string SortedFilename(const std::string filebase, int index);
 
+  // The index-th sorted file of filebase, placed in dirs[index %
+  // dirs.size()] if dirs is not empty.
+  static std::string SpillFilename(const std::string& filebase,
+                                   const std::vector<std::string>& dirs,
+                                   int index);
+
+  // Merge sorted files in inputs into sorted file output.  Values of
+  // the same key are combined by combiner if it is not NULL.  Each
+  // input is read through a buffer of read_buffer_size bytes (see
+  // SortedBufferIteratorImpl).
+  static void MergeSortedFiles(const std::vector<std::string>& inputs,
+                               const std::string& output,
+                               Combiner* combiner,
+                               int read_buffer_size);
+
+  // Make all sorted files of this process written (by Flush() and
+  // merging) and read (by SortedBufferIteratorImpl) using async I/O.
+  // Invoke before creating any buffer or iterator.
+  static void EnableAsyncIO(const AsyncFileOptions& options);
+
+  // Open a sorted file for writing ("w") or reading ("r"), using async
+  // I/O if enabled.
+  static FILE* OpenSortedFile(const std::string& filename, const char* mode);
+  static bool AsyncIOEnabled();
+
   NaiveMemoryAllocator* Allocator() { return allocator_.get(); }
-  int NumFiles() { return count_files_; }
+  int NumFiles();
+
+  // Buffer files generated by Flush() and merging.  If background
+  // merge is enabled, invoke MergeFiles() before this.
+  std::vector<std::string> Filenames();
 
  private:
   struct KeyValuePair {
@@ -76,10 +151,29 @@ class SortedBuffer {
   static bool KeyValuePairEqual(const KeyValuePair& x,
                                 const KeyValuePair& y);
 
+  // Name a new buffer file.
+  std::string NewFilename();
+
+  // Invoked by Flush() to start merging the first merge_factor_ files.
+  void MaybeStartBackgroundMerge();
+  void WaitForBackgroundMerge();
+  static void BackgroundMerge(SortedBuffer* buffer,
+                              std::vector<std::string> inputs,
+                              std::string output);
+
   KeyValueList key_value_list_;
   std::string filebase_;
   boost::scoped_ptr<NaiveMemoryAllocator> allocator_;
-  int count_files_;
+  int count_files_;                     // Used to name new buffer files.
+  std::vector<std::string> spill_dirs_;
+
+  Mutex mutex_;                         // Protects the following two.
+  std::vector<std::string> sorted_files_;  // Files not being merged.
+  bool merging_;
+  int merge_factor_;                    // <= 1 disables background merge.
+  Combiner* combiner_;
+  FlushCallback flush_callback_;
+  boost::scoped_ptr<boost::thread> merge_thread_;
 
   DISALLOW_COPY_AND_ASSIGN(SortedBuffer);
 };
@@ -19,6 +19,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
 //
 #include "src/sorted_buffer/sorted_buffer_iterator.h"
 
+#include <fcntl.h>
+#include <stdio.h>
+
 #include <algorithm>
 #include "src/base/varint32.h"
 #include "src/sorted_buffer/memory_piece.h"
@@ -27,34 +30,64 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
 namespace sorted_buffer {
 
 SortedBufferIteratorImpl::SortedBufferIteratorImpl(const std::string& filebase,
-                                                   int num_files) {
-  Initialize(filebase, num_files);
+                                                   int num_files)
+    : read_buffer_size_(0) {
+  CHECK_LE(0, num_files);
+  for (int i = 0; i < num_files; ++i) {
+    filenames_.push_back(SortedBuffer::SortedFilename(filebase, i));
+  }
+  Initialize();
+}
+
+SortedBufferIteratorImpl::SortedBufferIteratorImpl(
+    const std::vector<std::string>& filenames)
+    : filenames_(filenames), read_buffer_size_(0) {
+  Initialize();
+}
+
+SortedBufferIteratorImpl::SortedBufferIteratorImpl(
+    const std::vector<std::string>& filenames,
+    int read_buffer_size)
+    : filenames_(filenames), read_buffer_size_(read_buffer_size) {
+  Initialize();
 }
 
 SortedBufferIteratorImpl::~SortedBufferIteratorImpl() {
   Clear();
 }
 
-void SortedBufferIteratorImpl::Initialize(const std::string& filebase,
-                                          int num_files) {
-  CHECK_LE(0, num_files);
-  filebase_ = filebase;
-
-  for (int i = 0; i < num_files; ++i) {
+void SortedBufferIteratorImpl::Initialize() {
+  for (int i = 0; i < filenames_.size(); ++i) {
     SortedStringFile* file = new SortedStringFile;
     file->index = i;
-    file->input =
-        fopen(SortedBuffer::SortedFilename(filebase, i).c_str(), "r");
+    file->input = SortedBuffer::OpenSortedFile(filenames_[i], "r");
+    file->read_buffer = NULL;
     if (file->input == NULL) {
-      LOG(FATAL) << "Cannot open file: "
-                 << SortedBuffer::SortedFilename(filebase, i);
+      LOG(FATAL) << "Cannot open file: " << filenames_[i];
+    }
+    // Async I/O reads ahead by itself, in its own buffers.
+    if (!SortedBuffer::AsyncIOEnabled()) {
+      if (read_buffer_size_ > 0) {
+        file->read_buffer = new char[read_buffer_size_];
+        setvbuf(file->input, file->read_buffer, _IOFBF, read_buffer_size_);
+      }
+      // Let the kernel read ahead aggressively, so reads of files on
+      // different disks overlap with each other.
+      posix_fadvise(fileno(file->input), 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    if (!LoadKey(file)) {  // An empty file, e.g., all values combined away.
+      CloseFile(file);
+      continue;
     }
-    CHECK(LoadKey(file));
     CHECK(LoadValue(file));
     files_.push_back(file);
   }
 
   heap_size_ = files_.size();
+  if (heap_size_ == 0) {  // No input at all.
+    done_ = true;
+    return;
+  }
   std::make_heap(files_.begin(), files_.end(), compare_);
   current_key_ = files_[0]->top_key;
   done_ = false;
@@ -114,7 +147,7 @@ bool SortedBufferIteratorImpl::LoadValue(SortedStringFile* file) {
     if (!ReadMemoryPiece(file->input, &(file->top_value))) {
       LOG(FATAL) << "Error loading value for "
                  << "key = " << file->top_key << " file = "
-                 << SortedBuffer::SortedFilename(filebase_, file->index);
+                 << filenames_[file->index];
     }
     return true;
   }
@@ -128,11 +161,11 @@ bool SortedBufferIteratorImpl::LoadKey(SortedStringFile* file) {
   if (!ReadVarint32(file->input,
                     reinterpret_cast<uint32*>(&(file->num_rest_values)))) {
     LOG(FATAL) << "Error load num_rest_values from: "
-               << SortedBuffer::SortedFilename(filebase_, file->index);
+               << filenames_[file->index];
   }
   if (file->num_rest_values <= 0) {
     LOG(FATAL) << "Zero num_rest_values loaded from "
-               << SortedBuffer::SortedFilename(filebase_, file->index);
+               << filenames_[file->index];
   }
   return true;
 }
@@ -168,10 +201,16 @@ void SortedBufferIteratorImpl::SiftDown() {
 
 void SortedBufferIteratorImpl::Clear() {
   for (SSFileList::iterator i = files_.begin(); i != files_.end(); ++i) {
-    fclose((*i)->input);
-    delete *i;
+    CloseFile(*i);
   }
   files_.clear();
 }
 
+/*static*/
+void SortedBufferIteratorImpl::CloseFile(SortedStringFile* file) {
+  fclose(file->input);
+  delete [] file->read_buffer;  // Must outlive file->input.
+  delete file;
+}
+
 }  // namespace sorted_buffer
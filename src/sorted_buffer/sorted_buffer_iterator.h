@@ -25,6 +25,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
 
 #include "src/base/common.h"
 #include "src/sorted_buffer/memory_piece.h"
+#include "src/strutil/strcodec.h"
 
 namespace sorted_buffer {
 
@@ -37,6 +38,11 @@ class SortedBufferIterator {
   virtual bool Done() const = 0;          // Done with values of current key.
   virtual void Next() = 0;                // Jump to the next value
   virtual void DiscardRestValues() = 0;   // Jump until all values are skipped.
+
+  // Decode the current value, encoded by EncodeInt64() or
+  // EncodeDouble(), e.g., by typed mapreduce_lite::Mapper::Output().
+  int64 value_int64() const { return DecodeInt64(value()); }
+  double value_double() const { return DecodeDouble(value()); }
 };
 
 
@@ -44,6 +50,13 @@ class SortedBufferIterator {
 class SortedBufferIteratorImpl : public SortedBufferIterator {
  public:
   SortedBufferIteratorImpl(const std::string& filebase, int num_files);
+  explicit SortedBufferIteratorImpl(const std::vector<std::string>& filenames);
+  // Each file is read through a buffer of read_buffer_size bytes, so
+  // merging N files takes about N * read_buffer_size bytes of memory.
+  // A non-positive read_buffer_size means the default of stdio.  It is
+  // ignored if async I/O is enabled by SortedBuffer::EnableAsyncIO().
+  SortedBufferIteratorImpl(const std::vector<std::string>& filenames,
+                           int read_buffer_size);
   virtual ~SortedBufferIteratorImpl();
 
   virtual const std::string& key() const;
@@ -58,6 +71,7 @@ class SortedBufferIteratorImpl : public SortedBufferIterator {
  private:
   struct SortedStringFile {
     FILE* input;
+    char* read_buffer;  // NULL if using the default buffer of stdio.
     int index;
     std::string top_key;
     std::string top_value;
@@ -77,19 +91,23 @@ class SortedBufferIteratorImpl : public SortedBufferIterator {
   typedef std::vector<SortedStringFile*> SSFileList;
 
   std::string current_key_;
-  std::string filebase_;
+  std::vector<std::string> filenames_;
+  int read_buffer_size_;
   SSFileCompare compare_;
   SSFileList files_;  // A min-heap structure is maintained inside
   int heap_size_;
   bool done_;
 
-  // Invoked by ctor. Open all block files (specified by filebase and
-  // num_files).  Requires that each file contains at least one key-value pair.
-  void Initialize(const std::string& filebase, int num_files);
+  // Invoked by ctor. Open all block files in filenames_.  Empty files
+  // are skipped.
+  void Initialize();
 
   // Invoked by dtor.
   void Clear();
 
+  // Close file and release its read buffer.
+  static void CloseFile(SortedStringFile* file);
+
   // Returns false if file->num_rest_values <= 0
   bool LoadValue(SortedStringFile* file);
 
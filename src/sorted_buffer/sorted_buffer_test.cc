@@ -19,8 +19,18 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
 //
 #include "src/sorted_buffer/sorted_buffer.h"
 
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
 #include "src/base/common.h"
+#include "src/base/scoped_ptr.h"
 #include "src/base/varint32.h"
+#include "src/sorted_buffer/sorted_buffer_iterator.h"
+#include "src/strutil/stringprintf.h"
 #include "gtest/gtest.h"
 
 namespace sorted_buffer {
@@ -83,4 +93,116 @@ TEST_F(SortedBufferTest, MultipleFlushFiles) {
   }
 }
 
+// Sums up values, which are decimal integers in text.
+class SumCombiner : public Combiner {
+ public:
+  virtual void Combine(const std::string& key,
+                       SortedBufferIterator* values,
+                       std::vector<std::string>* combined) {
+    int sum = 0;
+    for (; !values->Done(); values->Next()) {
+      sum += atoi(values->value().c_str());
+    }
+    combined->push_back(StringPrintf("%d", sum));
+  }
+};
+
+TEST_F(SortedBufferTest, MergeFilesWithCombiner) {
+  static const std::string kTmpFilebase("/tmp/testMergeFilesWithCombiner");
+  static const int kInMemBufferSize = 40;  // Can hold two key-value pairs
+  static const int kNumInserts = 100;
+  static const std::string kSomeStrings[] = { "applee", "banana", "papaya" };
+  static const int kNumStrings = sizeof(kSomeStrings)/sizeof(kSomeStrings[0]);
+
+  SumCombiner combiner;
+  SortedBuffer buffer(kTmpFilebase, kInMemBufferSize);
+  buffer.EnableBackgroundMerge(4, &combiner);
+  for (int i = 0; i < kNumInserts; ++i) {
+    buffer.Insert(kSomeStrings[i % kNumStrings], "1");
+  }
+  buffer.MergeFiles();
+  EXPECT_EQ(buffer.NumFiles(), 1);
+
+  scoped_ptr<SortedBufferIteratorImpl> iter(
+      reinterpret_cast<SortedBufferIteratorImpl*>(buffer.CreateIterator()));
+  int total = 0;
+  for (int k = 0; !iter->FinishedAll(); iter->NextKey(), ++k) {
+    EXPECT_EQ(iter->key(), kSomeStrings[k]);
+    EXPECT_FALSE(iter->Done());
+    total += atoi(iter->value().c_str());
+    iter->Next();
+    EXPECT_TRUE(iter->Done());  // Values were combined into one.
+  }
+  EXPECT_EQ(kNumInserts, total);
+  iter.reset(NULL);
+  buffer.RemoveBufferFiles();
+}
+
+TEST_F(SortedBufferTest, MergeFilesWithoutCombiner) {
+  static const std::string kTmpFilebase("/tmp/testMergeFilesWithoutCombiner");
+  static const int kInMemBufferSize = 40;  // Can hold two key-value pairs
+  static const int kNumInserts = 50;
+  static const std::string kSomeStrings[] = { "applee", "banana" };
+
+  SortedBuffer buffer(kTmpFilebase, kInMemBufferSize);
+  for (int i = 0; i < kNumInserts; ++i) {
+    buffer.Insert(kSomeStrings[i % 2], "123456");
+  }
+  buffer.MergeFiles();
+  EXPECT_EQ(buffer.NumFiles(), 1);
+
+  scoped_ptr<SortedBufferIteratorImpl> iter(
+      reinterpret_cast<SortedBufferIteratorImpl*>(buffer.CreateIterator()));
+  for (int k = 0; !iter->FinishedAll(); iter->NextKey(), ++k) {
+    EXPECT_EQ(iter->key(), kSomeStrings[k]);
+    int num_values = 0;
+    for (; !iter->Done(); iter->Next()) {
+      EXPECT_EQ(iter->value(), "123456");
+      ++num_values;
+    }
+    EXPECT_EQ(kNumInserts / 2, num_values);
+  }
+  iter.reset(NULL);
+  buffer.RemoveBufferFiles();
+}
+
+TEST_F(SortedBufferTest, SpillDirectories) {
+  static const std::string kTmpFilebase("/tmp/not-used/testSpillDirectories");
+  static const int kInMemBufferSize = 40;  // Can hold two key-value pairs
+  static const int kNumInserts = 10;
+  std::vector<std::string> dirs;
+  dirs.push_back("/tmp/testSpillDirectories-0");
+  dirs.push_back("/tmp/testSpillDirectories-1");
+  for (int i = 0; i < dirs.size(); ++i) {
+    mkdir(dirs[i].c_str(), 0755);
+  }
+
+  SortedBuffer buffer(kTmpFilebase, kInMemBufferSize);
+  buffer.SetSpillDirectories(dirs);
+  for (int i = 0; i < kNumInserts; ++i) {
+    buffer.Insert("applee", "1");
+  }
+  buffer.Flush();
+
+  std::vector<std::string> filenames = buffer.Filenames();
+  EXPECT_EQ(kNumInserts / 2, filenames.size());
+  for (int i = 0; i < filenames.size(); ++i) {
+    EXPECT_EQ(SortedBuffer::SortedFilename(
+        dirs[i % 2] + "/testSpillDirectories", i), filenames[i]);
+  }
+
+  scoped_ptr<SortedBufferIteratorImpl> iter(
+      reinterpret_cast<SortedBufferIteratorImpl*>(buffer.CreateIterator()));
+  int num_values = 0;
+  for (; !iter->Done(); iter->Next()) {
+    ++num_values;
+  }
+  EXPECT_EQ(kNumInserts, num_values);
+  iter.reset(NULL);
+  buffer.RemoveBufferFiles();
+  for (int i = 0; i < dirs.size(); ++i) {
+    EXPECT_EQ(0, rmdir(dirs[i].c_str()));
+  }
+}
+
 }  // namespace sorted_buffer
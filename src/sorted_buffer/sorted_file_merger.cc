@@ -0,0 +1,163 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/sorted_buffer/sorted_file_merger.h"
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+#include "src/sorted_buffer/sorted_buffer.h"
+
+namespace sorted_buffer {
+
+namespace {
+
+int64 FileSize(const std::string& filename) {
+  struct stat file_stat;
+  if (stat(filename.c_str(), &file_stat) < 0) {
+    LOG(FATAL) << "Cannot stat sorted file: " << filename;
+  }
+  return file_stat.st_size;
+}
+
+}  // namespace
+
+SortedFileMerger::SortedFileMerger(const std::string& filebase,
+                                   int merge_factor,
+                                   int read_buffer_size,
+                                   Combiner* combiner)
+    : filebase_(filebase),
+      merge_factor_(merge_factor),
+      read_buffer_size_(read_buffer_size),
+      combiner_(combiner),
+      merging_(false),
+      count_files_(0) {
+  CHECK_LE(2, merge_factor_);
+}
+
+SortedFileMerger::~SortedFileMerger() {
+  if (merge_thread_.get() != NULL) {
+    merge_thread_->join();
+  }
+}
+
+void SortedFileMerger::SetSpillDirectories(
+    const std::vector<std::string>& dirs) {
+  MutexLocker locker(&mutex_);
+  CHECK(files_.empty() && count_files_ == 0);
+  spill_dirs_ = dirs;
+}
+
+/*static*/
+int SortedFileMerger::MergeFactorForMemoryBudget(int64 memory_budget,
+                                                 int read_buffer_size) {
+  CHECK_LT(0, read_buffer_size);
+  return static_cast<int>(
+      std::min<int64>(kInt32Max,
+                      std::max<int64>(2, memory_budget / read_buffer_size)));
+}
+
+void SortedFileMerger::Add(const std::string& filename) {
+  int64 size = FileSize(filename);
+  MutexLocker locker(&mutex_);
+  files_.push_back(std::make_pair(size, filename));
+  if (!merging_ && files_.size() >= merge_factor_) {
+    if (merge_thread_.get() != NULL) {
+      merge_thread_->join();  // It has quitted as merging_ is false.
+    }
+    merging_ = true;
+    merge_thread_.reset(new boost::thread(MergeLoop, this));
+  }
+}
+
+void SortedFileMerger::Finish(std::vector<std::string>* filenames) {
+  if (merge_thread_.get() != NULL) {
+    merge_thread_->join();
+    merge_thread_.reset(NULL);
+  }
+
+  // Merge just enough files so that merge_factor_ files are left.
+  while (files_.size() > merge_factor_) {
+    std::vector<std::string> inputs;
+    {
+      MutexLocker locker(&mutex_);
+      TakeSmallestFiles(std::min<int>(merge_factor_,
+                                      files_.size() - merge_factor_ + 1),
+                        &inputs);
+    }
+    Merge(inputs);
+  }
+
+  filenames->clear();
+  for (int i = 0; i < files_.size(); ++i) {
+    filenames->push_back(files_[i].second);
+  }
+  files_.clear();
+}
+
+/*static*/
+void SortedFileMerger::MergeLoop(SortedFileMerger* merger) {
+  while (true) {
+    std::vector<std::string> inputs;
+    {
+      MutexLocker locker(&merger->mutex_);
+      if (merger->files_.size() < merger->merge_factor_) {
+        merger->merging_ = false;
+        return;
+      }
+      merger->TakeSmallestFiles(merger->merge_factor_, &inputs);
+    }
+    merger->Merge(inputs);
+  }
+}
+
+void SortedFileMerger::TakeSmallestFiles(int num_inputs,
+                                         std::vector<std::string>* inputs) {
+  CHECK_LE(num_inputs, files_.size());
+  std::sort(files_.begin(), files_.end());
+  for (int i = 0; i < num_inputs; ++i) {
+    inputs->push_back(files_[i].second);
+  }
+  files_.erase(files_.begin(), files_.begin() + num_inputs);
+}
+
+void SortedFileMerger::Merge(const std::vector<std::string>& inputs) {
+  std::string output;
+  {
+    MutexLocker locker(&mutex_);
+    output = SortedBuffer::SpillFilename(filebase_, spill_dirs_,
+                                         count_files_++);
+  }
+  SortedBuffer::MergeSortedFiles(inputs, output, combiner_,
+                                 read_buffer_size_);
+  for (int i = 0; i < inputs.size(); ++i) {
+    if (remove(inputs[i].c_str()) < 0) {
+      LOG(ERROR) << "Cannot remove merged file: " << inputs[i];
+    }
+  }
+  LOG(INFO) << "Merged " << inputs.size() << " sorted files into " << output;
+
+  int64 size = FileSize(output);
+  MutexLocker locker(&mutex_);
+  files_.push_back(std::make_pair(size, output));
+}
+
+}  // namespace sorted_buffer
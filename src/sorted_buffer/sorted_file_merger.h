@@ -0,0 +1,106 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+// SortedFileMerger merges sorted files (in the format written by
+// SortedBuffer) as they arrive, e.g., while a reduce worker is still
+// fetching map outputs.  Once merge_factor files are pending, a
+// background thread merges the smallest merge_factor ones into a
+// larger file.  Finish() then merges the rest until at most
+// merge_factor files are left, so the final merge done by
+// SortedBufferIteratorImpl reads no more than merge_factor files.
+//
+// Each merge reads its inputs through buffers of read_buffer_size
+// bytes, so a merge takes about merge_factor * read_buffer_size bytes
+// of memory.  Use MergeFactorForMemoryBudget to derive merge_factor
+// from a memory budget.
+//
+#ifndef SORTED_BUFFER_SORTED_FILE_MERGER_H_
+#define SORTED_BUFFER_SORTED_FILE_MERGER_H_
+
+#include <string>
+#include <vector>
+
+#include "boost/scoped_ptr.hpp"
+#include "boost/thread.hpp"
+
+#include "src/base/common.h"
+#include "src/system/mutex.h"
+
+namespace sorted_buffer {
+
+class Combiner;
+
+class SortedFileMerger {
+ public:
+  // Merged files are named by SortedBuffer::SpillFilename(filebase,
+  // dirs, i).  Does not take the ownership of combiner, which can be NULL.
+  SortedFileMerger(const std::string& filebase,
+                   int merge_factor,
+                   int read_buffer_size,
+                   Combiner* combiner);
+  ~SortedFileMerger();
+
+  // Place merged files round-robin in dirs.  See
+  // SortedBuffer::SetSpillDirectories.  Invoke before adding files.
+  void SetSpillDirectories(const std::vector<std::string>& dirs);
+
+  // The largest merge factor, no less than 2, that makes a merge fit
+  // in memory_budget bytes.
+  static int MergeFactorForMemoryBudget(int64 memory_budget,
+                                        int read_buffer_size);
+
+  // Add a complete sorted file.  The merger takes the ownership of
+  // the file and removes it after merging.  Thread-safe.
+  void Add(const std::string& filename);
+
+  // Blocks until all merges finish, merges the rest files until at
+  // most merge_factor ones are left, and returns them.  The caller
+  // takes the ownership of returned files.
+  void Finish(std::vector<std::string>* filenames);
+
+ private:
+  // Merge the smallest merge_factor files as long as there are
+  // merge_factor pending files.
+  static void MergeLoop(SortedFileMerger* merger);
+
+  // Take the num_inputs smallest files out of files_.  Must be called
+  // with mutex_ locked.
+  void TakeSmallestFiles(int num_inputs, std::vector<std::string>* inputs);
+
+  // Merge inputs into a new file and add it to files_.
+  void Merge(const std::vector<std::string>& inputs);
+
+  std::string filebase_;
+  int merge_factor_;
+  int read_buffer_size_;
+  Combiner* combiner_;
+  std::vector<std::string> spill_dirs_;
+
+  Mutex mutex_;                       // Protects the following three.
+  std::vector<std::pair<int64, std::string> > files_;  // Size and name.
+  bool merging_;
+  int count_files_;                   // Used to name merged files.
+  boost::scoped_ptr<boost::thread> merge_thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(SortedFileMerger);
+};
+
+}  // namespace sorted_buffer
+
+#endif  // SORTED_BUFFER_SORTED_FILE_MERGER_H_
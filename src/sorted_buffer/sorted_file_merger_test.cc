@@ -0,0 +1,92 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/sorted_buffer/sorted_file_merger.h"
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "boost/bind.hpp"
+
+#include "src/base/common.h"
+#include "src/sorted_buffer/sorted_buffer.h"
+#include "src/sorted_buffer/sorted_buffer_iterator.h"
+#include "gtest/gtest.h"
+
+namespace sorted_buffer {
+
+TEST(SortedFileMergerTest, MergeFactorForMemoryBudget) {
+  EXPECT_EQ(2, SortedFileMerger::MergeFactorForMemoryBudget(0, 1024));
+  EXPECT_EQ(2, SortedFileMerger::MergeFactorForMemoryBudget(1024, 1024));
+  EXPECT_EQ(64, SortedFileMerger::MergeFactorForMemoryBudget(64 * 1024,
+                                                             1024));
+}
+
+TEST(SortedFileMergerTest, MergeWhileAdding) {
+  static const std::string kTmpFilebase("/tmp/testSortedFileMerger");
+  static const int kInMemBufferSize = 40;  // Can hold two key-value pairs
+  static const int kNumInserts = 100;
+  static const int kMergeFactor = 3;
+  static const std::string kSomeStrings[] = { "applee", "banana", "papaya" };
+  static const int kNumStrings = sizeof(kSomeStrings)/sizeof(kSomeStrings[0]);
+
+  // Flushed files are handed to the merger one by one, as if they are
+  // fetched from map workers.
+  SortedFileMerger merger(kTmpFilebase + "-merged", kMergeFactor, 1024, NULL);
+  std::vector<std::string> flushed;
+  {
+    SortedBuffer buffer(kTmpFilebase, kInMemBufferSize);
+    buffer.SetFlushCallback(boost::bind(&SortedFileMerger::Add, &merger, _1));
+    for (int i = 0; i < kNumInserts; ++i) {
+      buffer.Insert(kSomeStrings[i % kNumStrings], "1");
+    }
+    buffer.Flush();
+    flushed = buffer.Filenames();
+  }
+  EXPECT_LT(kMergeFactor, flushed.size());
+
+  std::vector<std::string> filenames;
+  merger.Finish(&filenames);
+  EXPECT_GE(kMergeFactor, filenames.size());
+  EXPECT_LT(0, filenames.size());
+
+  int num_values = 0;
+  {
+    SortedBufferIteratorImpl iter(filenames);
+    for (int k = 0; !iter.FinishedAll(); iter.NextKey(), ++k) {
+      EXPECT_EQ(kSomeStrings[k], iter.key());
+      for (; !iter.Done(); iter.Next()) {
+        EXPECT_EQ("1", iter.value());
+        ++num_values;
+      }
+    }
+  }
+  EXPECT_EQ(kNumInserts, num_values);
+
+  for (int i = 0; i < filenames.size(); ++i) {
+    EXPECT_EQ(0, remove(filenames[i].c_str()));
+  }
+  for (int i = 0; i < flushed.size(); ++i) {  // No file is left behind.
+    EXPECT_NE(0, remove(flushed[i].c_str()));
+  }
+}
+
+}  // namespace sorted_buffer
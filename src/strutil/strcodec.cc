@@ -188,3 +188,27 @@ std::string EncodeUint64(uint64 value) {
 uint64 DecodeUint64(const std::string& str) {
   return DecodeNumericValue<uint64>(str);
 }
+
+void EncodeFloat(float value, std::string* str) {
+  EncodeNumericValue<float>(value, str);
+}
+
+std::string EncodeFloat(float value) {
+  return EncodeNumericValue<float>(value);
+}
+
+float DecodeFloat(const std::string& str) {
+  return DecodeNumericValue<float>(str);
+}
+
+void EncodeDouble(double value, std::string* str) {
+  EncodeNumericValue<double>(value, str);
+}
+
+std::string EncodeDouble(double value) {
+  return EncodeNumericValue<double>(value);
+}
+
+double DecodeDouble(const std::string& str) {
+  return DecodeNumericValue<double>(str);
+}
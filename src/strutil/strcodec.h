@@ -71,4 +71,12 @@ std::string EncodeUint64(uint64 value);
 
 uint64 DecodeUint64(const std::string& str);
 
+void EncodeFloat(float value, std::string* str);
+std::string EncodeFloat(float value);
+float DecodeFloat(const std::string& str);
+
+void EncodeDouble(double value, std::string* str);
+std::string EncodeDouble(double value);
+double DecodeDouble(const std::string& str);
+
 #endif  // STRUTIL_STRCODEC_H_
@@ -48,6 +48,20 @@ TEST(StrCodecTest, testFastCodecUint64) {
   EXPECT_EQ(0xffffffffffffffffLLU, DecodeUint64(str));
 }
 
+TEST(StrCodecTest, testFastCodecDouble) {
+  std::string str;
+  EncodeDouble(0.0, &str);
+  EXPECT_EQ(sizeof(double), str.size());
+  EXPECT_EQ(0.0, DecodeDouble(str));
+
+  EncodeDouble(-1.5e300, &str);
+  EXPECT_EQ(-1.5e300, DecodeDouble(str));
+
+  EncodeFloat(0.25f, &str);
+  EXPECT_EQ(sizeof(float), str.size());
+  EXPECT_EQ(0.25f, DecodeFloat(str));
+}
+
 TEST(StrCodecTest, testInt32ToKey) {
   std::string key;
   Int32ToKey(0, &key);
@@ -0,0 +1,659 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/system/async_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include "boost/bind.hpp"
+#include "boost/thread.hpp"
+
+#include "src/base/common.h"
+#include "src/base/scoped_ptr.h"
+#include "src/system/condition_variable.h"
+#include "src/system/mutex.h"
+
+// io_uring is used by raw system calls, so it requires only the kernel
+// header, not liburing.
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define ASYNC_FILE_HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+namespace {
+
+// The number of threads serving I/O requests of all async files.
+const int kNumIOThreads = 8;
+
+// The number of submission queue entries of the io_uring shared by all
+// async files, which bounds the number of requests in flight.
+const int kIOUringEntries = 256;
+
+struct IORequest {
+  int fd;
+  char* buffer;
+  int size;
+  off_t offset;
+  bool write;
+  ssize_t result;   // The number of bytes transferred, or -1 on error.
+  bool done;        // True also if never submitted.
+
+  ssize_t transferred;  // Used by IOUring to resubmit short transfers.
+  struct iovec iov;     // The remaining part of buffer, used by IOUring.
+};
+
+// An engine performs I/O requests asynchronously.  Wait() returns
+// after the request is done.
+class IOEngine {
+ public:
+  virtual ~IOEngine() {}
+  virtual void Submit(IORequest* request) = 0;
+  virtual void Wait(IORequest* request) = 0;
+};
+
+class IOThreadPool : public IOEngine {
+ public:
+  explicit IOThreadPool(int num_threads) : stopping_(false) {
+    for (int i = 0; i < num_threads; ++i) {
+      threads_.create_thread(boost::bind(&IOThreadPool::Loop, this));
+    }
+  }
+
+  ~IOThreadPool() {
+    {
+      MutexLocker locker(&mutex_);
+      stopping_ = true;
+      pending_.Broadcast();
+    }
+    threads_.join_all();
+  }
+
+  void Submit(IORequest* request) {
+    MutexLocker locker(&mutex_);
+    request->done = false;
+    queue_.push_back(request);
+    pending_.Signal();
+  }
+
+  void Wait(IORequest* request) {
+    MutexLocker locker(&mutex_);
+    while (!request->done) {
+      completed_.Wait(&mutex_);
+    }
+  }
+
+ private:
+  void Loop() {
+    while (true) {
+      IORequest* request = NULL;
+      {
+        MutexLocker locker(&mutex_);
+        while (queue_.empty() && !stopping_) {
+          pending_.Wait(&mutex_);
+        }
+        if (queue_.empty()) {
+          return;
+        }
+        request = queue_.front();
+        queue_.pop_front();
+      }
+      ssize_t result = Execute(*request);
+      MutexLocker locker(&mutex_);
+      request->result = result;
+      request->done = true;
+      completed_.Broadcast();
+    }
+  }
+
+  // A write transfers the whole buffer.  A read stops at the end of
+  // file, where it transfers less than request.size bytes.
+  static ssize_t Execute(const IORequest& request) {
+    ssize_t transferred = 0;
+    while (transferred < request.size) {
+      ssize_t requested = request.size - transferred;
+      ssize_t n = request.write ?
+          pwrite(request.fd, request.buffer + transferred, requested,
+                 request.offset + transferred) :
+          pread(request.fd, request.buffer + transferred, requested,
+                request.offset + transferred);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0 || (request.write && n == 0)) {
+        return -1;
+      }
+      transferred += n;
+      if (!request.write && n < requested) {
+        break;  // A short read means the end of file.
+      }
+    }
+    return transferred;
+  }
+
+  Mutex mutex_;                     // Protects the following three.
+  ConditionVariable pending_;       // Signaled by Submit().
+  ConditionVariable completed_;     // Signaled when a request is done.
+  std::deque<IORequest*> queue_;
+  bool stopping_;
+  boost::thread_group threads_;
+};
+
+IOThreadPool& GetIOThreadPool() {
+  static IOThreadPool io_thread_pool(kNumIOThreads);
+  return io_thread_pool;
+}
+
+#ifdef ASYNC_FILE_HAVE_IO_URING
+
+// Requests are submitted to an io_uring as READV/WRITEV operations,
+// which are supported since the first kernel with io_uring.  A
+// completion thread reaps completions and resubmits the remaining part
+// of short transfers, so a request is done when, like in IOThreadPool,
+// the whole buffer is written, or the buffer is filled or the end of
+// file is reached by a read.
+class IOUring : public IOEngine {
+ public:
+  // Returns NULL if the kernel does not support io_uring, or it is
+  // forbidden, e.g., by seccomp in a container.
+  static IOUring* Create(int entries) {
+    scoped_ptr<IOUring> ring(new IOUring);
+    if (!ring->Setup(entries)) {
+      return NULL;
+    }
+    ring->reaper_.reset(new boost::thread(
+        boost::bind(&IOUring::ReapLoop, ring.get())));
+    return ring.release();
+  }
+
+  ~IOUring() {
+    if (reaper_.get() != NULL) {
+      {
+        MutexLocker locker(&mutex_);
+        stopping_ = true;
+        while (in_flight_ >= sq_entries_) {
+          not_full_.Wait(&mutex_);
+        }
+        // A no-op without a request wakes up the completion thread.
+        struct io_uring_sqe* sqe = NextSqe();
+        sqe->opcode = IORING_OP_NOP;
+        sqe->user_data = 0;
+        SubmitSqe();
+      }
+      reaper_->join();
+    }
+    if (sqes_ != MAP_FAILED) {
+      munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != MAP_FAILED) {
+      munmap(sq_ring_, sq_ring_size_);
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  void Submit(IORequest* request) {
+    MutexLocker locker(&mutex_);
+    while (in_flight_ >= sq_entries_) {
+      not_full_.Wait(&mutex_);
+    }
+    request->done = false;
+    request->transferred = 0;
+    SubmitRemaining(request);
+  }
+
+  void Wait(IORequest* request) {
+    MutexLocker locker(&mutex_);
+    while (!request->done) {
+      completed_.Wait(&mutex_);
+    }
+  }
+
+ private:
+  IOUring()
+      : fd_(-1), sq_ring_(MAP_FAILED), cq_ring_(MAP_FAILED),
+        sqes_(reinterpret_cast<struct io_uring_sqe*>(MAP_FAILED)),
+        sq_entries_(0), in_flight_(0), stopping_(false) {}
+
+  bool Setup(int entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    fd_ = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd_ < 0) {
+      LOG(INFO) << "io_uring is not available (" << strerror(errno)
+                << "); async files use I/O threads.";
+      return false;
+    }
+    sq_entries_ = params.sq_entries;
+
+    sq_ring_size_ = params.sq_off.array +
+        params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes +
+        params.cq_entries * sizeof(struct io_uring_cqe);
+#ifdef IORING_FEAT_SINGLE_MMAP
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+#else
+    bool single_mmap = false;
+#endif
+    if (single_mmap) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+      LOG(ERROR) << "Cannot map io_uring submission queue.";
+      return false;
+    }
+    cq_ring_ = single_mmap ? sq_ring_ :
+        mmap(NULL, cq_ring_size_, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      LOG(ERROR) << "Cannot map io_uring completion queue.";
+      return false;
+    }
+    sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = reinterpret_cast<struct io_uring_sqe*>(
+        mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED) {
+      LOG(ERROR) << "Cannot map io_uring submission queue entries.";
+      return false;
+    }
+
+    char* sq = reinterpret_cast<char*>(sq_ring_);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    char* cq = reinterpret_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  // The entry at the tail of the submission queue.  Each entry is
+  // submitted right after it is filled, so the queue is never full.
+  // Requires mutex_.
+  struct io_uring_sqe* NextSqe() {
+    unsigned index = *sq_tail_ & sq_mask_;
+    struct io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+    return sqe;
+  }
+
+  // Submit the entry returned by NextSqe().  Requires mutex_.
+  void SubmitSqe() {
+    __atomic_store_n(sq_tail_, *sq_tail_ + 1, __ATOMIC_RELEASE);
+    ++in_flight_;
+    while (syscall(__NR_io_uring_enter, fd_, 1, 0, 0, NULL, 0) < 0) {
+      if (errno != EINTR && errno != EAGAIN) {
+        LOG(FATAL) << "Cannot submit to io_uring: " << strerror(errno);
+      }
+    }
+  }
+
+  // Submit the part of request not transferred yet.  Requires mutex_.
+  void SubmitRemaining(IORequest* request) {
+    request->iov.iov_base = request->buffer + request->transferred;
+    request->iov.iov_len = request->size - request->transferred;
+    struct io_uring_sqe* sqe = NextSqe();
+    sqe->opcode = request->write ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe->fd = request->fd;
+    sqe->off = request->offset + request->transferred;
+    sqe->addr = reinterpret_cast<uintptr_t>(&request->iov);
+    sqe->len = 1;
+    sqe->user_data = reinterpret_cast<uintptr_t>(request);
+    SubmitSqe();
+  }
+
+  // Account a completion of request, which transferred result bytes or
+  // failed with -result as errno.  Requires mutex_.
+  void Complete(IORequest* request, int result) {
+    if (result == -EINTR || result == -EAGAIN) {
+      SubmitRemaining(request);
+      return;
+    }
+    if (result < 0 || (request->write && result == 0)) {
+      request->result = -1;
+      request->done = true;
+      return;
+    }
+    request->transferred += result;
+    if (result > 0 && request->transferred < request->size) {
+      SubmitRemaining(request);  // A short transfer.
+      return;
+    }
+    request->result = request->transferred;  // Filled, or end of file.
+    request->done = true;
+  }
+
+  void ReapLoop() {
+    while (true) {
+      if (syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS,
+                  NULL, 0) < 0 && errno != EINTR) {
+        LOG(FATAL) << "Cannot wait for io_uring: " << strerror(errno);
+      }
+      MutexLocker locker(&mutex_);
+      bool stopped = false;
+      unsigned head = *cq_head_;
+      unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+      for (; head != tail; ++head) {
+        const struct io_uring_cqe& cqe = cqes_[head & cq_mask_];
+        --in_flight_;
+        IORequest* request = reinterpret_cast<IORequest*>(
+            static_cast<uintptr_t>(cqe.user_data));
+        if (request == NULL) {
+          stopped = true;
+        } else {
+          Complete(request, cqe.res);
+        }
+      }
+      __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+      completed_.Broadcast();
+      not_full_.Broadcast();
+      if (stopped) {
+        return;
+      }
+    }
+  }
+
+  int fd_;
+  void* sq_ring_;
+  size_t sq_ring_size_;
+  void* cq_ring_;
+  size_t cq_ring_size_;
+  struct io_uring_sqe* sqes_;
+  size_t sqes_size_;
+  unsigned* sq_tail_;
+  unsigned sq_mask_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned cq_mask_;
+  struct io_uring_cqe* cqes_;
+  int sq_entries_;
+
+  Mutex mutex_;                     // Protects the following and rings.
+  ConditionVariable completed_;     // Signaled when requests are done.
+  ConditionVariable not_full_;      // Signaled when in_flight_ drops.
+  int in_flight_;                   // Submitted and not reaped entries.
+  bool stopping_;
+  scoped_ptr<boost::thread> reaper_;
+
+  DISALLOW_COPY_AND_ASSIGN(IOUring);
+};
+
+// Returns NULL if io_uring is not available.
+IOUring* GetIOUring() {
+  static scoped_ptr<IOUring> io_uring(IOUring::Create(kIOUringEntries));
+  return io_uring.get();
+}
+
+#endif  // ASYNC_FILE_HAVE_IO_URING
+
+IOEngine* GetIOEngine(bool io_uring) {
+#ifdef ASYNC_FILE_HAVE_IO_URING
+  if (io_uring && GetIOUring() != NULL) {
+    return GetIOUring();
+  }
+#endif
+  return &GetIOThreadPool();
+}
+
+// The cookie of a FILE returned by OpenAsyncFile.  requests_ is used
+// as a ring of blocks, where requests_[current_] is the block being
+// consumed (reading) or filled (writing).
+class AsyncFile {
+ public:
+  AsyncFile(int fd, bool write, bool direct, const AsyncFileOptions& options)
+      : engine_(GetIOEngine(options.io_uring)),
+        fd_(fd), write_(write), direct_(direct),
+        block_size_(options.block_size),
+        requests_(options.queue_depth),
+        current_(0), position_(0), next_offset_(0), failed_(false) {
+    for (int i = 0; i < requests_.size(); ++i) {
+      IORequest* request = &requests_[i];
+      void* buffer = NULL;
+      if (posix_memalign(&buffer, kDirectIOAlignment, block_size_) != 0) {
+        LOG(FATAL) << "Cannot allocate aligned buffer of " << block_size_;
+      }
+      request->fd = fd_;
+      request->buffer = reinterpret_cast<char*>(buffer);
+      request->size = block_size_;
+      request->write = write_;
+      request->result = write_ ? block_size_ : 0;
+      request->done = true;
+      if (!write_) {  // Start reading ahead.
+        Submit(request);
+      }
+    }
+  }
+
+  ~AsyncFile() {
+    for (int i = 0; i < requests_.size(); ++i) {
+      engine_->Wait(&requests_[i]);
+      free(requests_[i].buffer);
+    }
+  }
+
+  ssize_t Read(char* buffer, size_t size) {
+    size_t copied = 0;
+    while (copied < size) {
+      IORequest* request = &requests_[current_];
+      engine_->Wait(request);
+      if (request->result < 0) {
+        LOG(ERROR) << "Failed reading at offset " << request->offset;
+        return -1;
+      }
+      if (position_ < request->result) {
+        size_t n = std::min<size_t>(size - copied,
+                                    request->result - position_);
+        memcpy(buffer + copied, request->buffer + position_, n);
+        position_ += n;
+        copied += n;
+        continue;
+      }
+      if (request->result < request->size) {
+        break;  // The end of file.
+      }
+      // Reuse the consumed buffer to read a block further ahead.
+      request->size = block_size_;
+      Submit(request);
+      current_ = (current_ + 1) % requests_.size();
+      position_ = 0;
+    }
+    return copied;
+  }
+
+  ssize_t Write(const char* buffer, size_t size) {
+    size_t copied = 0;
+    while (copied < size) {
+      IORequest* request = &requests_[current_];
+      size_t n = std::min<size_t>(size - copied, block_size_ - position_);
+      memcpy(request->buffer + position_, buffer + copied, n);
+      position_ += n;
+      copied += n;
+      if (position_ == block_size_) {
+        request->size = block_size_;
+        Submit(request);
+        current_ = (current_ + 1) % requests_.size();
+        position_ = 0;
+        if (!WaitForWrite(&requests_[current_])) {  // Before reusing it.
+          return -1;
+        }
+      }
+    }
+    return copied;
+  }
+
+  int Close() {
+    off_t file_size = next_offset_;
+    if (write_ && position_ > 0) {
+      // O_DIRECT requires writing whole aligned blocks, so pad the
+      // last block and truncate the file afterwards.
+      IORequest* request = &requests_[current_];
+      request->size = position_;
+      if (direct_) {
+        request->size = (position_ + kDirectIOAlignment - 1) /
+            kDirectIOAlignment * kDirectIOAlignment;
+        memset(request->buffer + position_, 0, request->size - position_);
+      }
+      file_size += position_;
+      Submit(request);
+    }
+    // Wait for all requests, including reads ahead, before closing fd_.
+    for (int i = 0; i < requests_.size(); ++i) {
+      if (write_) {
+        WaitForWrite(&requests_[i]);
+      } else {
+        engine_->Wait(&requests_[i]);
+      }
+    }
+    if (write_ && direct_ && ftruncate(fd_, file_size) < 0) {
+      LOG(ERROR) << "Cannot truncate file to " << file_size;
+      failed_ = true;
+    }
+    if (close(fd_) < 0) {
+      failed_ = true;
+    }
+    return failed_ ? EOF : 0;
+  }
+
+ private:
+  void Submit(IORequest* request) {
+    request->offset = next_offset_;
+    next_offset_ += request->size;
+    engine_->Submit(request);
+  }
+
+  bool WaitForWrite(IORequest* request) {
+    engine_->Wait(request);
+    if (request->result != request->size) {
+      LOG(ERROR) << "Failed writing at offset " << request->offset;
+      failed_ = true;
+    }
+    request->result = request->size;  // Report a failure only once.
+    return !failed_;
+  }
+
+  IOEngine* engine_;
+  int fd_;
+  bool write_;
+  bool direct_;
+  int block_size_;
+  std::vector<IORequest> requests_;
+  int current_;
+  int position_;          // In the block being consumed or filled.
+  off_t next_offset_;     // The offset of the next block to submit.
+  bool failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(AsyncFile);
+};
+
+ssize_t AsyncFileRead(void* cookie, char* buffer, size_t size) {
+  return reinterpret_cast<AsyncFile*>(cookie)->Read(buffer, size);
+}
+
+ssize_t AsyncFileWrite(void* cookie, const char* buffer, size_t size) {
+  ssize_t written = reinterpret_cast<AsyncFile*>(cookie)->Write(buffer, size);
+  return written < 0 ? 0 : written;  // fopencookie expects 0 on error.
+}
+
+int AsyncFileClose(void* cookie) {
+  AsyncFile* file = reinterpret_cast<AsyncFile*>(cookie);
+  int result = file->Close();
+  delete file;
+  return result;
+}
+
+}  // namespace
+
+bool IOUringAvailable() {
+#ifdef ASYNC_FILE_HAVE_IO_URING
+  return GetIOUring() != NULL;
+#else
+  return false;
+#endif
+}
+
+FILE* OpenAsyncFile(const std::string& filename, const char* mode,
+                    const AsyncFileOptions& options) {
+  CHECK_LT(0, options.block_size);
+  CHECK_EQ(0, options.block_size % kDirectIOAlignment);
+  CHECK_LT(0, options.queue_depth);
+
+  bool write = (mode[0] == 'w');
+  if (!write && mode[0] != 'r') {
+    LOG(ERROR) << "Unsupported mode of async file: " << mode;
+    return NULL;
+  }
+  int flags = write ? (O_WRONLY | O_CREAT | O_TRUNC) : O_RDONLY;
+
+  bool direct = options.direct;
+  int fd = -1;
+  if (direct) {
+    fd = open(filename.c_str(), flags | O_DIRECT, 0644);
+    if (fd < 0 && errno == EINVAL) {  // E.g., tmpfs.
+      LOG(WARNING) << "O_DIRECT is not supported for " << filename;
+      direct = false;
+    }
+  }
+  if (!direct) {
+    fd = open(filename.c_str(), flags, 0644);
+  }
+  if (fd < 0) {
+    LOG(ERROR) << "Cannot open async file: " << filename;
+    return NULL;
+  }
+
+  cookie_io_functions_t functions;
+  functions.read = AsyncFileRead;
+  functions.write = AsyncFileWrite;
+  functions.seek = NULL;
+  functions.close = AsyncFileClose;
+  AsyncFile* file = new AsyncFile(fd, write, direct, options);
+  FILE* stream = fopencookie(file, write ? "w" : "r", functions);
+  if (stream == NULL) {
+    file->Close();
+    delete file;
+    LOG(ERROR) << "Cannot create stream for async file: " << filename;
+  }
+  return stream;
+}
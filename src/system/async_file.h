@@ -0,0 +1,71 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+// Sequential file I/O performed asynchronously on fixed-size blocks
+// held in aligned buffers.  A file opened for reading keeps queue_depth
+// blocks being read ahead; a file opened for writing keeps up to
+// queue_depth blocks being written behind.  With direct set, files are
+// opened with O_DIRECT, so they do not pollute the page cache.
+//
+// Blocks are transferred by an io_uring shared by all files, which is
+// set up by raw system calls without liburing.  If the kernel does not
+// support io_uring, or io_uring is not set in options, a pool of I/O
+// threads issues pread/pwrite instead.
+//
+// OpenAsyncFile returns a stdio FILE (using fopencookie), so existing
+// codecs like ReadVarint32 and WriteMemoryPiece work unchanged.
+// Usage:
+/*
+  AsyncFileOptions options;
+  options.direct = true;
+  FILE* output = OpenAsyncFile("/tmp/a_file", "w", options);
+  fwrite(data, 1, size, output);
+  fclose(output);   // Waits for all blocks to be written.
+*/
+#ifndef SYSTEM_ASYNC_FILE_H_
+#define SYSTEM_ASYNC_FILE_H_
+
+#include <stdio.h>
+#include <string>
+
+// The alignment of buffers, file offsets and sizes required by O_DIRECT.
+const int kDirectIOAlignment = 4096;
+
+struct AsyncFileOptions {
+  int block_size;    // In bytes, a multiple of kDirectIOAlignment.
+  int queue_depth;   // The number of blocks in flight per file.
+  bool direct;       // Bypass the page cache using O_DIRECT.
+  bool io_uring;     // Use io_uring if available, or I/O threads.
+
+  AsyncFileOptions()
+      : block_size(1024 * 1024), queue_depth(4), direct(false),
+        io_uring(true) {}
+};
+
+// Returns true if the kernel supports io_uring.
+bool IOUringAvailable();
+
+// Open filename for sequential reading (mode "r") or writing (mode
+// "w").  Returns NULL on failure.  Seeking is not supported.  If the
+// file system does not support O_DIRECT, the file is opened without
+// it.
+FILE* OpenAsyncFile(const std::string& filename, const char* mode,
+                    const AsyncFileOptions& options);
+
+#endif  // SYSTEM_ASYNC_FILE_H_
@@ -0,0 +1,130 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+*/
+// Copyright 2010 Tencent Inc.
+// Author: Yi Wang (yiwang@tencent.com)
+//
+#include "src/system/async_file.h"
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "src/strutil/stringprintf.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+const char* kTestFile = "/tmp/async_file_test";
+
+std::string MakeContent(int size) {
+  std::string content;
+  for (int i = 0; i < size; ++i) {
+    content.push_back('a' + i % 26);
+  }
+  return content;
+}
+
+std::string ReadAll(FILE* input) {
+  std::string content;
+  char buffer[1000];  // Not a divisor of the block size.
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), input)) > 0) {
+    content.append(buffer, size);
+  }
+  return content;
+}
+
+void WriteAndReadBack(bool direct, bool io_uring, int size) {
+  AsyncFileOptions options;
+  options.block_size = kDirectIOAlignment;
+  options.queue_depth = 2;
+  options.direct = direct;
+  options.io_uring = io_uring;
+  std::string content = MakeContent(size);
+
+  FILE* output = OpenAsyncFile(kTestFile, "w", options);
+  ASSERT_TRUE(output != NULL);
+  EXPECT_EQ(content.size(), fwrite(content.data(), 1, content.size(), output));
+  EXPECT_EQ(0, fclose(output));
+
+  FILE* input = fopen(kTestFile, "r");  // Not padded by O_DIRECT.
+  ASSERT_TRUE(input != NULL);
+  EXPECT_EQ(content, ReadAll(input));
+  fclose(input);
+
+  input = OpenAsyncFile(kTestFile, "r", options);
+  ASSERT_TRUE(input != NULL);
+  EXPECT_EQ(content, ReadAll(input));
+  EXPECT_EQ(0, fclose(input));
+  remove(kTestFile);
+}
+
+}  // namespace
+
+// Runs with io_uring if the kernel supports it, and with I/O threads.
+TEST(AsyncFileTest, WriteAndRead) {
+  for (int io_uring = 0; io_uring < 2; ++io_uring) {
+    WriteAndReadBack(false, io_uring, 0);
+    WriteAndReadBack(false, io_uring, kDirectIOAlignment);
+    WriteAndReadBack(false, io_uring, 7 * kDirectIOAlignment / 2);
+  }
+}
+
+TEST(AsyncFileTest, WriteAndReadDirect) {
+  for (int io_uring = 0; io_uring < 2; ++io_uring) {
+    WriteAndReadBack(true, io_uring, 0);
+    WriteAndReadBack(true, io_uring, kDirectIOAlignment);
+    WriteAndReadBack(true, io_uring, 7 * kDirectIOAlignment / 2);
+  }
+}
+
+TEST(AsyncFileTest, OpenNonExistingFile) {
+  EXPECT_TRUE(OpenAsyncFile("/tmp/async_file_test-not-exist", "r",
+                            AsyncFileOptions()) == NULL);
+}
+
+// More blocks in flight than entries of the io_uring.
+TEST(AsyncFileTest, ManyFilesInFlight) {
+  static const int kNumFiles = 100;
+  AsyncFileOptions options;
+  options.block_size = kDirectIOAlignment;
+  options.queue_depth = 4;
+  std::string content = MakeContent(10 * kDirectIOAlignment + 1);
+
+  std::vector<FILE*> outputs;
+  for (int i = 0; i < kNumFiles; ++i) {
+    outputs.push_back(OpenAsyncFile(StringPrintf("%s-%d", kTestFile, i),
+                                    "w", options));
+    ASSERT_TRUE(outputs.back() != NULL);
+  }
+  for (int i = 0; i < kNumFiles; ++i) {
+    EXPECT_EQ(content.size(),
+              fwrite(content.data(), 1, content.size(), outputs[i]));
+  }
+  for (int i = 0; i < kNumFiles; ++i) {
+    EXPECT_EQ(0, fclose(outputs[i]));
+  }
+  for (int i = 0; i < kNumFiles; ++i) {
+    std::string filename = StringPrintf("%s-%d", kTestFile, i);
+    FILE* input = OpenAsyncFile(filename, "r", options);
+    ASSERT_TRUE(input != NULL);
+    EXPECT_EQ(content, ReadAll(input));
+    EXPECT_EQ(0, fclose(input));
+    remove(filename.c_str());
+  }
+}